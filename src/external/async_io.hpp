@@ -0,0 +1,661 @@
+#pragma once
+
+// asynchronous block io for the merge phase of the external sort
+//
+// async_io is a tiny submit / wait interface with two implementations:
+//  - uring_io:       io_uring through raw syscalls (linux 5.6+, no liburing)
+//  - thread_pool_io: a few threads doing blocking pread / pwrite
+// on top of it async_record_reader prefetches the next block of a run while
+// the current one drains and async_record_writer writes behind, both with two
+// buffers, so the loser tree replays while the device is busy
+//
+// posix only, EXTERNAL_ASYNC_IO is not defined elsewhere and the external sort
+// stays on the synchronous record_reader / record_writer
+
+enum class io_backend { sync, thread_pool, io_uring, automatic };
+
+inline const char *to_string(io_backend backend) {
+  switch (backend) {
+  case io_backend::sync:
+    return "sync";
+  case io_backend::thread_pool:
+    return "thread_pool";
+  case io_backend::io_uring:
+    return "io_uring";
+  default:
+    return "automatic";
+  }
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+#define EXTERNAL_ASYNC_IO 1
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define EXTERNAL_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+// one outstanding read or write, result is the byte count or -errno
+struct io_request {
+  std::atomic<bool> done{true};
+  int64_t result{};
+};
+
+class async_io {
+public:
+  virtual ~async_io() = default;
+
+  virtual io_backend backend() const = 0;
+
+  virtual void read(int fd, void *buf, size_t len, uint64_t offset,
+                    io_request *req) = 0;
+
+  virtual void write(int fd, const void *buf, size_t len, uint64_t offset,
+                     io_request *req) = 0;
+
+  // block until req is done
+  virtual void wait(io_request *req) = 0;
+};
+
+class thread_pool_io : public async_io {
+public:
+  explicit thread_pool_io(unsigned threads = 4) {
+    for (unsigned i = 0; i < std::max(threads, 1u); i++) {
+      m_threads.emplace_back([this]() { work(); });
+    }
+  }
+
+  ~thread_pool_io() override {
+    {
+      std::lock_guard<std::mutex> lock{m_mutex};
+      m_stop = true;
+    }
+    m_work_cv.notify_all();
+    for (auto &t : m_threads) {
+      t.join();
+    }
+  }
+
+  io_backend backend() const override { return io_backend::thread_pool; }
+
+  void read(int fd, void *buf, size_t len, uint64_t offset,
+            io_request *req) override {
+    submit({false, fd, buf, len, offset, req});
+  }
+
+  void write(int fd, const void *buf, size_t len, uint64_t offset,
+             io_request *req) override {
+    submit({true, fd, const_cast<void *>(buf), len, offset, req});
+  }
+
+  void wait(io_request *req) override {
+    if (req->done.load(std::memory_order_acquire)) {
+      return;
+    }
+    std::unique_lock<std::mutex> lock{m_mutex};
+    m_done_cv.wait(lock, [&]() {
+      return req->done.load(std::memory_order_acquire);
+    });
+  }
+
+private:
+  struct task {
+    bool write{};
+    int fd{};
+    void *buf{};
+    size_t len{};
+    uint64_t offset{};
+    io_request *req{};
+  };
+
+  void submit(task t) {
+    t.req->done.store(false, std::memory_order_relaxed);
+    {
+      std::lock_guard<std::mutex> lock{m_mutex};
+      m_tasks.push_back(t);
+    }
+    m_work_cv.notify_one();
+  }
+
+  void work() {
+    while (true) {
+      task t;
+      {
+        std::unique_lock<std::mutex> lock{m_mutex};
+        m_work_cv.wait(lock, [&]() { return m_stop || !m_tasks.empty(); });
+        if (m_tasks.empty()) {
+          return;
+        }
+        t = m_tasks.front();
+        m_tasks.pop_front();
+      }
+      ssize_t res = t.write ? ::pwrite(t.fd, t.buf, t.len, t.offset)
+                            : ::pread(t.fd, t.buf, t.len, t.offset);
+      t.req->result = res < 0 ? -errno : res;
+      {
+        // under the lock, so a waiter can not miss the notification
+        std::lock_guard<std::mutex> lock{m_mutex};
+        t.req->done.store(true, std::memory_order_release);
+      }
+      m_done_cv.notify_all();
+    }
+  }
+
+private:
+  std::mutex m_mutex{};
+  std::condition_variable m_work_cv{};
+  std::condition_variable m_done_cv{};
+  std::deque<task> m_tasks{};
+  std::vector<std::thread> m_threads{};
+  bool m_stop{};
+};
+
+#ifdef EXTERNAL_IO_URING
+// single threaded: all submits and waits must come from the owning thread
+class uring_io : public async_io {
+public:
+  explicit uring_io(unsigned entries = 64) {
+    io_uring_params params{};
+    m_ring_fd = static_cast<int>(
+        ::syscall(__NR_io_uring_setup, std::max(entries, 2u), &params));
+    if (m_ring_fd < 0) {
+      throw std::runtime_error("io_uring_setup failed: " +
+                               std::string(std::strerror(errno)));
+    }
+    try {
+      m_sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+      m_cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+      bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+      if (single_mmap) {
+        m_sq_size = m_cq_size = std::max(m_sq_size, m_cq_size);
+      }
+      m_sq_ptr = map(m_sq_size, IORING_OFF_SQ_RING);
+      m_cq_ptr = single_mmap ? m_sq_ptr : map(m_cq_size, IORING_OFF_CQ_RING);
+      m_sqes = static_cast<io_uring_sqe *>(
+          map(params.sq_entries * sizeof(io_uring_sqe), IORING_OFF_SQES));
+      m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+
+      char *sq = static_cast<char *>(m_sq_ptr);
+      m_sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+      m_sq_mask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+      m_sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+      char *cq = static_cast<char *>(m_cq_ptr);
+      m_cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+      m_cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+      m_cq_mask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+      m_cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+      m_cq_entries = params.cq_entries;
+    } catch (...) {
+      release();
+      throw;
+    }
+  }
+
+  ~uring_io() override { release(); }
+
+  uring_io(const uring_io &) = delete;
+  uring_io &operator=(const uring_io &) = delete;
+
+  io_backend backend() const override { return io_backend::io_uring; }
+
+  void read(int fd, void *buf, size_t len, uint64_t offset,
+            io_request *req) override {
+    submit(IORING_OP_READ, fd, buf, len, offset, req);
+  }
+
+  void write(int fd, const void *buf, size_t len, uint64_t offset,
+             io_request *req) override {
+    submit(IORING_OP_WRITE, fd, const_cast<void *>(buf), len, offset, req);
+  }
+
+  void wait(io_request *req) override {
+    while (!req->done.load(std::memory_order_relaxed)) {
+      if (reap() == 0) {
+        enter(0, 1, IORING_ENTER_GETEVENTS);
+      }
+    }
+  }
+
+private:
+  void release() {
+    if (m_sqes) {
+      ::munmap(m_sqes, m_sqes_size);
+    }
+    if (m_cq_ptr && m_cq_ptr != m_sq_ptr) {
+      ::munmap(m_cq_ptr, m_cq_size);
+    }
+    if (m_sq_ptr) {
+      ::munmap(m_sq_ptr, m_sq_size);
+    }
+    if (m_ring_fd >= 0) {
+      ::close(m_ring_fd);
+    }
+  }
+
+  void *map(size_t size, uint64_t offset) {
+    void *ptr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, m_ring_fd,
+                       static_cast<off_t>(offset));
+    if (ptr == MAP_FAILED) {
+      throw std::runtime_error("io_uring mmap failed");
+    }
+    return ptr;
+  }
+
+  int enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+    while (true) {
+      int res = static_cast<int>(::syscall(__NR_io_uring_enter, m_ring_fd,
+                                           to_submit, min_complete, flags,
+                                           nullptr, 0));
+      if (res >= 0) {
+        return res;
+      }
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EBUSY) {
+        // the kernel is short of resources, retire completions and retry
+        reap();
+        continue;
+      }
+      throw std::runtime_error("io_uring_enter failed: " +
+                               std::string(std::strerror(errno)));
+    }
+  }
+
+  void submit(uint8_t opcode, int fd, void *buf, size_t len, uint64_t offset,
+              io_request *req) {
+    // never have more requests in flight than the completion queue can hold
+    while (m_inflight >= m_cq_entries) {
+      if (reap() == 0) {
+        enter(0, 1, IORING_ENTER_GETEVENTS);
+      }
+    }
+    req->done.store(false, std::memory_order_relaxed);
+    unsigned tail = *m_sq_tail;
+    unsigned index = tail & m_sq_mask;
+    io_uring_sqe &sqe = m_sqes[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = opcode;
+    sqe.fd = fd;
+    sqe.addr = reinterpret_cast<uint64_t>(buf);
+    sqe.len = static_cast<uint32_t>(len);
+    sqe.off = offset;
+    sqe.user_data = reinterpret_cast<uint64_t>(req);
+    m_sq_array[index] = index;
+    __atomic_store_n(m_sq_tail, tail + 1, __ATOMIC_RELEASE);
+    m_inflight++;
+    enter(1, 0, 0);
+  }
+
+  // retire all available completions, returns how many
+  unsigned reap() {
+    unsigned head = *m_cq_head;
+    unsigned tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+    unsigned count = tail - head;
+    for (; head != tail; head++) {
+      io_uring_cqe &cqe = m_cqes[head & m_cq_mask];
+      io_request *req = reinterpret_cast<io_request *>(cqe.user_data);
+      req->result = cqe.res;
+      req->done.store(true, std::memory_order_relaxed);
+    }
+    __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+    m_inflight -= count;
+    return count;
+  }
+
+private:
+  int m_ring_fd{-1};
+  void *m_sq_ptr{};
+  void *m_cq_ptr{};
+  size_t m_sq_size{};
+  size_t m_cq_size{};
+  io_uring_sqe *m_sqes{};
+  size_t m_sqes_size{};
+  unsigned *m_sq_tail{};
+  unsigned *m_sq_array{};
+  unsigned m_sq_mask{};
+  unsigned *m_cq_head{};
+  unsigned *m_cq_tail{};
+  io_uring_cqe *m_cqes{};
+  unsigned m_cq_mask{};
+  unsigned m_cq_entries{};
+  unsigned m_inflight{};
+};
+#endif
+
+// nullptr for io_backend::sync, automatic picks io_uring when the kernel
+// allows it (it is often disabled in containers) and the thread pool otherwise
+inline std::unique_ptr<async_io> make_async_io(io_backend backend,
+                                               unsigned queue_depth = 64) {
+  switch (backend) {
+  case io_backend::sync:
+    return nullptr;
+  case io_backend::thread_pool:
+    return std::make_unique<thread_pool_io>();
+  case io_backend::io_uring:
+#ifdef EXTERNAL_IO_URING
+    return std::make_unique<uring_io>(queue_depth);
+#else
+    throw std::runtime_error("io_uring is not supported on this platform");
+#endif
+  default:
+#ifdef EXTERNAL_IO_URING
+    try {
+      return std::make_unique<uring_io>(queue_depth);
+    } catch (const std::exception &) {
+    }
+#endif
+    return std::make_unique<thread_pool_io>();
+  }
+}
+
+class fd_handle {
+public:
+  fd_handle() = default;
+
+  fd_handle(const std::string &path, int flags, mode_t mode = 0644)
+      : m_fd(::open(path.c_str(), flags, mode)) {
+    if (m_fd < 0) {
+      throw std::runtime_error("failed to open " + path);
+    }
+  }
+
+  ~fd_handle() { reset(); }
+
+  fd_handle(fd_handle &&h) noexcept : m_fd(h.m_fd) { h.m_fd = -1; }
+
+  fd_handle &operator=(fd_handle &&h) noexcept {
+    if (this != &h) {
+      reset();
+      m_fd = h.m_fd;
+      h.m_fd = -1;
+    }
+    return *this;
+  }
+
+  int get() const { return m_fd; }
+
+  // returns the result of ::close
+  int close() {
+    int res = 0;
+    if (m_fd >= 0) {
+      res = ::close(m_fd);
+      m_fd = -1;
+    }
+    return res;
+  }
+
+  void reset() { close(); }
+
+private:
+  int m_fd{-1};
+};
+
+// finish a short transfer synchronously, throws on error
+inline void complete_io(bool write, int fd, char *buf, size_t len,
+                        uint64_t offset, int64_t result) {
+  if (result < 0) {
+    throw std::runtime_error(std::string("async ") +
+                             (write ? "write" : "read") +
+                             " failed: " + std::strerror(-result));
+  }
+  size_t done = static_cast<size_t>(result);
+  while (done < len) {
+    ssize_t res = write ? ::pwrite(fd, buf + done, len - done, offset + done)
+                        : ::pread(fd, buf + done, len - done, offset + done);
+    if (res < 0 && errno == EINTR) {
+      continue;
+    }
+    if (res <= 0) {
+      throw std::runtime_error(write ? "short write"
+                                     : "unexpected end of file");
+    }
+    done += static_cast<size_t>(res);
+  }
+}
+
+// record_reader with two buffers: while one is consumed the next block is
+// already being read into the other
+template <typename T> class async_record_reader {
+  static_assert(std::is_trivially_copyable_v<T>);
+
+public:
+  async_record_reader(async_io &io, const std::string &path,
+                      size_t block_records)
+      : m_io(&io), m_fd(path, O_RDONLY),
+        m_block_records(std::max<size_t>(block_records, 1)),
+        m_requests(std::make_unique<io_request[]>(2)) {
+    struct stat st {};
+    if (::fstat(m_fd.get(), &st) != 0) {
+      throw std::runtime_error("failed to stat " + path);
+    }
+    m_file_size = static_cast<uint64_t>(st.st_size);
+    for (auto &buffer : m_buffers) {
+      buffer.resize(m_block_records);
+    }
+    submit(0);
+    submit(1);
+    activate(0);
+  }
+
+  ~async_record_reader() { drain(); }
+
+  async_record_reader(async_record_reader &&) = default;
+  async_record_reader &operator=(async_record_reader &&) = delete;
+
+  bool empty() const { return m_pos == m_size; }
+
+  const T &front() const { return m_buffers[m_curr][m_pos]; }
+
+  T &front() { return m_buffers[m_curr][m_pos]; }
+
+  void pop() {
+    if (++m_pos == m_size) {
+      // refill the drained buffer (it reads the block after the other one)
+      submit(m_curr);
+      activate(m_curr ^ 1);
+    }
+  }
+
+  uint64_t bytes_read() const { return m_bytes_read; }
+
+private:
+  void submit(int i) {
+    m_pending[i] = false;
+    if (m_next_offset >= m_file_size) {
+      return;
+    }
+    uint64_t len = std::min<uint64_t>(m_block_records * sizeof(T),
+                                      m_file_size - m_next_offset);
+    m_offset[i] = m_next_offset;
+    m_len[i] = len;
+    m_io->read(m_fd.get(), m_buffers[i].data(), len, m_next_offset,
+               &m_requests[i]);
+    m_pending[i] = true;
+    m_next_offset += len;
+  }
+
+  void activate(int i) {
+    m_curr = i;
+    m_pos = 0;
+    m_size = 0;
+    if (!m_pending[i]) {
+      return;
+    }
+    m_io->wait(&m_requests[i]);
+    m_pending[i] = false;
+    complete_io(false, m_fd.get(),
+                reinterpret_cast<char *>(m_buffers[i].data()), m_len[i],
+                m_offset[i], m_requests[i].result);
+    m_size = m_len[i] / sizeof(T);
+    m_bytes_read += m_len[i];
+  }
+
+  // the buffers must outlive every read into them
+  void drain() {
+    // moved from
+    if (!m_requests) {
+      return;
+    }
+    for (int i = 0; i < 2; i++) {
+      if (m_pending[i]) {
+        m_io->wait(&m_requests[i]);
+        m_pending[i] = false;
+      }
+    }
+  }
+
+private:
+  async_io *m_io{};
+  fd_handle m_fd{};
+  size_t m_block_records{};
+  std::unique_ptr<io_request[]> m_requests{};
+  std::vector<T> m_buffers[2]{};
+  uint64_t m_offset[2]{};
+  uint64_t m_len[2]{};
+  bool m_pending[2]{};
+  int m_curr{};
+  size_t m_pos{};
+  size_t m_size{};
+  uint64_t m_file_size{};
+  uint64_t m_next_offset{};
+  uint64_t m_bytes_read{};
+};
+
+// record_writer with write behind: a full buffer is handed to the device and
+// filling continues in the other one
+template <typename T> class async_record_writer {
+  static_assert(std::is_trivially_copyable_v<T>);
+
+public:
+  async_record_writer(async_io &io, const std::string &path,
+                      size_t block_records)
+      : m_io(&io), m_fd(path, O_WRONLY | O_CREAT | O_TRUNC),
+        m_block_records(std::max<size_t>(block_records, 1)),
+        m_requests(std::make_unique<io_request[]>(2)) {
+    for (auto &buffer : m_buffers) {
+      buffer.resize(m_block_records);
+    }
+  }
+
+  // like record_writer the records still buffered are written when close()
+  // was not called, only close() reports a failed write though
+  ~async_record_writer() {
+    if (m_fd.get() >= 0) {
+      try {
+        submit();
+      } catch (...) {
+      }
+    }
+    // the buffers must outlive every write from them
+    for (int i = 0; i < 2; i++) {
+      try {
+        finish(i);
+      } catch (...) {
+      }
+    }
+  }
+
+  async_record_writer(const async_record_writer &) = delete;
+  async_record_writer &operator=(const async_record_writer &) = delete;
+
+  void push(const T &value) {
+    m_buffers[m_curr][m_count++] = value;
+    if (m_count == m_block_records) {
+      submit();
+    }
+  }
+
+  void push(const T *data, size_t n) {
+    while (n > 0) {
+      size_t m = std::min(n, m_block_records - m_count);
+      std::copy(data, data + m, m_buffers[m_curr].data() + m_count);
+      m_count += m;
+      data += m;
+      n -= m;
+      if (m_count == m_block_records) {
+        submit();
+      }
+    }
+  }
+
+  void close() {
+    submit();
+    for (int i = 0; i < 2; i++) {
+      finish(i);
+    }
+    if (m_fd.close() != 0) {
+      throw std::runtime_error("failed to close record file");
+    }
+  }
+
+  uint64_t records() const { return m_records; }
+
+  uint64_t bytes_written() const { return m_records * sizeof(T); }
+
+private:
+  void submit() {
+    if (m_count == 0) {
+      return;
+    }
+    uint64_t len = m_count * sizeof(T);
+    m_offset[m_curr] = m_records * sizeof(T);
+    m_len[m_curr] = len;
+    m_io->write(m_fd.get(), m_buffers[m_curr].data(), len, m_offset[m_curr],
+                &m_requests[m_curr]);
+    m_pending[m_curr] = true;
+    m_records += m_count;
+    m_count = 0;
+    m_curr ^= 1;
+    // the other buffer may still be on its way to the device
+    finish(m_curr);
+  }
+
+  void finish(int i) {
+    if (!m_pending[i]) {
+      return;
+    }
+    m_io->wait(&m_requests[i]);
+    m_pending[i] = false;
+    complete_io(true, m_fd.get(),
+                reinterpret_cast<char *>(m_buffers[i].data()), m_len[i],
+                m_offset[i], m_requests[i].result);
+  }
+
+private:
+  async_io *m_io{};
+  fd_handle m_fd{};
+  size_t m_block_records{};
+  std::unique_ptr<io_request[]> m_requests{};
+  std::vector<T> m_buffers[2]{};
+  uint64_t m_offset[2]{};
+  uint64_t m_len[2]{};
+  bool m_pending[2]{};
+  int m_curr{};
+  size_t m_count{};
+  uint64_t m_records{};
+};
+
+#endif
@@ -0,0 +1,383 @@
+#pragma once
+
+#include "async_io.hpp"
+#include "loser_tree.hpp"
+#include "merge_planner.hpp"
+#include "parallel_merge.hpp"
+#include "record_io.hpp"
+#include "run_codec.hpp"
+#include "run_generator.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// external merge sort of a file of fixed size binary records
+//
+//  1. stream the input and generate sorted runs with replacement selection
+//     (run_generator.hpp), the selection heap gets whatever the memory budget
+//     leaves after the io buffers, so on random input a run is ~2x the heap
+//  2. spill every run into a temp file
+//  3. k-way merge the runs (loser tree) into the output file, if there are
+//     more runs than the fan-in (open files / io buffers in the budget)
+//     allows, merge the shortest runs into longer ones first, following the
+//     huffman (or polyphase) plan of merge_planner.hpp
+//     while merging every run prefetches its next block and the output is
+//     written behind (async_io.hpp), unless io is io_backend::sync
+//
+// bytes_read / bytes_written count the bytes that really hit the files, so
+// with compress_runs they show the io saved by the compressed run format
+
+struct external_sort_options {
+  // bytes for the selection heap plus all io buffers
+  size_t memory_budget = size_t{64} << 20;
+  // bytes per io buffer (one per input run while merging)
+  size_t block_size = size_t{1} << 20;
+  // upper bound of simultaneously open runs in one merge
+  size_t max_fan_in = 256;
+  // directory for the spilled runs, empty for the system temp directory
+  std::string temp_dir{};
+  // io of the merge phase, the async backends use two buffers per run
+  io_backend io = io_backend::automatic;
+  // threads of the final merge pass, the output is cut into equal slices
+  // which are merged independently (synchronous io, the block size is divided
+  // among the threads so the budget still holds)
+  unsigned merge_threads = 1;
+  // spill runs in the compressed block format (run_codec.hpp), integer keys
+  // only, ignored for other record types. the output is always raw records
+  bool compress_runs = false;
+  // order of the merges when there are more runs than the fan-in
+  merge_schedule schedule = merge_schedule::huffman;
+};
+
+struct external_sort_stats {
+  uint64_t records{};
+  uint64_t runs{};
+  // depth of the merge plan, 1 when all runs fit in one merge
+  uint64_t merge_passes{};
+  uint64_t bytes_read{};
+  uint64_t bytes_written{};
+  // run count and lengths of the replacement selection
+  run_stats run_generation{};
+  // backend actually used by the merge phase
+  io_backend io = io_backend::sync;
+  // the merges that were executed with their predicted run io
+  merge_plan plan{};
+  double run_generation_ms{};
+  double merge_ms{};
+};
+
+// file formats of the spilled runs
+template <typename T> struct raw_runs {
+  using reader = record_reader<T>;
+  using writer = record_writer<T>;
+  using view = record_file_view<T>;
+  static constexpr bool compressed = false;
+};
+
+template <typename T> struct packed_runs {
+  using reader = compressed_run_reader<T>;
+  using writer = compressed_run_writer<T>;
+  using view = compressed_run_view<T>;
+  static constexpr bool compressed = true;
+};
+
+template <typename T, typename Comparator = std::less<T>>
+class external_sorter {
+public:
+  explicit external_sorter(external_sort_options options = {},
+                           Comparator comparator = Comparator())
+      : m_options(std::move(options)), m_comparator(comparator) {}
+
+  external_sort_stats sort(const std::string &input,
+                           const std::string &output) {
+    if constexpr (std::is_integral_v<T> && sizeof(T) <= 8) {
+      if (m_options.compress_runs) {
+        return sort_runs<packed_runs<T>>(input, output);
+      }
+    }
+    return sort_runs<raw_runs<T>>(input, output);
+  }
+
+  size_t block_records() const {
+    return std::max<size_t>(m_options.block_size / sizeof(T), 1);
+  }
+
+  // how many runs can be merged at once: one buffer per input, plus the
+  // output buffer and the batch popped from the loser tree (inputs and output
+  // take two buffers each with async io)
+  size_t fan_in_limit() const {
+    size_t buffers = m_options.memory_budget / (block_records() * sizeof(T));
+    size_t per_run = async_merge() ? 2 : 1;
+    size_t fixed = per_run + 1;
+    size_t fan_in = buffers > fixed ? (buffers - fixed) / per_run : 1;
+    return std::max<size_t>(2, std::min(m_options.max_fan_in, fan_in));
+  }
+
+  bool async_merge() const {
+#ifdef EXTERNAL_ASYNC_IO
+    return m_options.io != io_backend::sync;
+#else
+    return false;
+#endif
+  }
+
+  // bytes left for the selection heap during run generation
+  size_t heap_budget() const {
+    size_t io = 2 * block_records() * sizeof(T);
+    return m_options.memory_budget > io ? m_options.memory_budget - io : 0;
+  }
+
+private:
+  template <typename Format>
+  external_sort_stats sort_runs(const std::string &input,
+                                const std::string &output) {
+    namespace ch = std::chrono;
+    m_stats = {};
+    auto start = ch::steady_clock::now();
+    std::deque<temp_file> runs = generate_runs<Format>(input);
+    auto generated = ch::steady_clock::now();
+    m_stats.run_generation_ms =
+        ch::duration<double, std::milli>(generated - start).count();
+    m_stats.runs = runs.size();
+    size_t fan_in = fan_in_limit();
+#ifdef EXTERNAL_ASYNC_IO
+    // every open run and the output have two requests in flight at most
+    m_io = make_async_io(m_options.io,
+                         static_cast<unsigned>(2 * (fan_in + 1)));
+    m_stats.io = m_io ? m_io->backend() : io_backend::sync;
+#endif
+    // 先按计划合并短的 run，最后一步直接写到 output
+    m_stats.plan = plan_merge(m_run_bytes, fan_in, m_options.schedule);
+    m_stats.merge_passes = m_stats.plan.depth;
+    if (m_stats.plan.steps.empty()) {
+      // no input records, still create the (empty) output
+      open_file(output, "wb");
+    }
+    for (size_t i = 0; i < m_stats.plan.steps.size(); i++) {
+      std::vector<temp_file> inputs;
+      for (size_t id : m_stats.plan.steps[i].inputs) {
+        inputs.emplace_back(std::move(runs[id]));
+      }
+      if (i + 1 < m_stats.plan.steps.size()) {
+        temp_file merged{m_options.temp_dir};
+        merge_runs<Format>(inputs, merged.path(), false);
+        runs.emplace_back(std::move(merged));
+      } else if (m_options.merge_threads > 1) {
+        parallel_merge_runs<Format>(inputs, output);
+      } else {
+        merge_runs<Format>(inputs, output, true);
+      }
+    }
+#ifdef EXTERNAL_ASYNC_IO
+    m_io.reset();
+#endif
+    m_stats.merge_ms = ch::duration<double, std::milli>(
+                           ch::steady_clock::now() - generated)
+                           .count();
+    return m_stats;
+  }
+
+  // every run goes into its own temp file
+  template <typename Writer> struct spill_sink {
+    external_sorter *sorter{};
+    std::deque<temp_file> runs{};
+    std::unique_ptr<Writer> writer{};
+
+    void begin_run(uint64_t) {
+      runs.emplace_back(sorter->m_options.temp_dir);
+      writer = std::make_unique<Writer>(runs.back().path(),
+                                        sorter->block_records());
+    }
+
+    void push(T &&value) { writer->push(value); }
+
+    void end_run(uint64_t, uint64_t) {
+      writer->close();
+      sorter->m_stats.bytes_written += writer->bytes_written();
+      sorter->m_run_bytes.push_back(writer->bytes_written());
+      writer.reset();
+    }
+  };
+
+  template <typename Format>
+  std::deque<temp_file> generate_runs(const std::string &input) {
+    m_run_bytes.clear();
+    record_reader<T> reader{input, block_records()};
+    run_generator<T, Comparator> generator{heap_budget(), m_comparator};
+    spill_sink<typename Format::writer> sink{this};
+    m_stats.run_generation = generator.generate(reader, sink);
+    m_stats.records = m_stats.run_generation.records;
+    m_stats.bytes_read += reader.bytes_read();
+    return std::move(sink.runs);
+  }
+
+  // merge into a run (Format) or into the final output (raw records)
+  template <typename Format>
+  void merge_runs(std::vector<temp_file> &inputs, const std::string &output,
+                  bool final) {
+    if constexpr (Format::compressed) {
+      // compressed runs are read synchronously, the io saved by compression
+      // outweighs the overlap
+      auto readers = open_readers<typename Format::reader>(inputs);
+      if (!final) {
+        typename Format::writer writer{output, block_records()};
+        merge(std::move(readers), writer);
+        inputs.clear();
+        return;
+      }
+#ifdef EXTERNAL_ASYNC_IO
+      if (m_io) {
+        async_record_writer<T> writer{*m_io, output, block_records()};
+        merge(std::move(readers), writer);
+        inputs.clear();
+        return;
+      }
+#endif
+      record_writer<T> writer{output, block_records()};
+      merge(std::move(readers), writer);
+      inputs.clear();
+      return;
+    } else {
+#ifdef EXTERNAL_ASYNC_IO
+      if (m_io) {
+        std::vector<async_record_reader<T>> readers;
+        readers.reserve(inputs.size());
+        for (auto &run : inputs) {
+          readers.emplace_back(*m_io, run.path(), block_records());
+        }
+        async_record_writer<T> writer{*m_io, output, block_records()};
+        merge(std::move(readers), writer);
+        inputs.clear();
+        return;
+      }
+#endif
+      auto readers = open_readers<record_reader<T>>(inputs);
+      record_writer<T> writer{output, block_records()};
+      merge(std::move(readers), writer);
+      // the inputs are no longer needed
+      inputs.clear();
+    }
+  }
+
+  template <typename Reader>
+  std::vector<Reader> open_readers(const std::vector<temp_file> &inputs) const {
+    std::vector<Reader> readers;
+    readers.reserve(inputs.size());
+    for (auto &run : inputs) {
+      readers.emplace_back(run.path(), block_records());
+    }
+    return readers;
+  }
+
+  template <typename Reader, typename Writer>
+  void merge(std::vector<Reader> readers, Writer &writer) {
+    merge_bytes bytes = merge(std::move(readers), writer, block_records());
+    m_stats.bytes_read += bytes.read;
+    m_stats.bytes_written += bytes.written;
+  }
+
+  struct merge_bytes {
+    uint64_t read{};
+    uint64_t written{};
+  };
+
+  template <typename Reader, typename Writer>
+  merge_bytes merge(std::vector<Reader> readers, Writer &writer,
+                    size_t batch) const {
+    // ties go to the earlier run
+    loser_tree<Reader, Comparator> tree{std::move(readers), m_comparator};
+    std::vector<T> buffer(batch);
+    while (size_t n = tree.pop_n(buffer.data(), buffer.size())) {
+      writer.push(buffer.data(), n);
+    }
+    writer.close();
+    merge_bytes bytes{0, writer.bytes_written()};
+    for (auto &reader : tree.cursors()) {
+      bytes.read += reader.bytes_read();
+    }
+    return bytes;
+  }
+
+  // the final pass on several threads: every thread finds the cut points of
+  // its slice with binary searches on the run files (multiway_split) and
+  // merges exactly that part of every run into its part of the output
+  template <typename Format>
+  void parallel_merge_runs(std::vector<temp_file> &inputs,
+                           const std::string &output) {
+    using view_type = typename Format::view;
+    using reader_type = typename Format::reader;
+    uint64_t total = 0;
+    for (auto &run : inputs) {
+      total += view_type(run.path()).size();
+    }
+    // create (and truncate) the output, the slices are written in place
+    open_file(output, "wb");
+    size_t slices = static_cast<size_t>(std::max<uint64_t>(
+        1, std::min<uint64_t>(m_options.merge_threads,
+                              total / block_records())));
+    size_t block = std::max<size_t>(block_records() / slices, 1);
+    std::vector<merge_bytes> bytes(slices);
+    std::vector<std::exception_ptr> errors(slices);
+    auto merge_slice = [&](size_t s) {
+      try {
+        std::vector<view_type> views;
+        for (auto &run : inputs) {
+          views.emplace_back(run.path());
+        }
+        uint64_t first = total * s / slices;
+        uint64_t last = total * (s + 1) / slices;
+        std::vector<size_t> lo = multiway_split(views, first, m_comparator);
+        std::vector<size_t> hi = multiway_split(views, last, m_comparator);
+        std::vector<reader_type> readers;
+        readers.reserve(inputs.size());
+        for (size_t i = 0; i < inputs.size(); i++) {
+          readers.emplace_back(inputs[i].path(), block, lo[i], hi[i]);
+        }
+        record_writer<T> writer{output, block, first};
+        bytes[s] = merge(std::move(readers), writer, block);
+      } catch (...) {
+        errors[s] = std::current_exception();
+      }
+    };
+    std::vector<std::thread> workers;
+    for (size_t s = 1; s < slices; s++) {
+      workers.emplace_back(merge_slice, s);
+    }
+    merge_slice(0);
+    for (auto &w : workers) {
+      w.join();
+    }
+    for (size_t s = 0; s < slices; s++) {
+      if (errors[s]) {
+        std::rethrow_exception(errors[s]);
+      }
+      m_stats.bytes_read += bytes[s].read;
+      m_stats.bytes_written += bytes[s].written;
+    }
+    inputs.clear();
+  }
+
+private:
+  external_sort_options m_options{};
+  Comparator m_comparator{};
+  external_sort_stats m_stats{};
+  // file size of every spilled run, the input of the merge plan
+  std::vector<uint64_t> m_run_bytes{};
+#ifdef EXTERNAL_ASYNC_IO
+  std::unique_ptr<async_io> m_io{};
+#endif
+};
+
+template <typename T, typename Comparator = std::less<T>>
+external_sort_stats external_sort(const std::string &input,
+                                  const std::string &output,
+                                  const external_sort_options &options = {}) {
+  return external_sorter<T, Comparator>(options).sort(input, output);
+}
@@ -0,0 +1,260 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <fmt/core.h>
+
+// merge plans for runs of unequal length when there are more runs than the
+// fan-in allows to merge at once
+//
+//  - huffman:   always merge the K smallest runs (after padding with empty
+//               runs so that every merge, including the first, is a full
+//               K-way merge). this minimizes the bytes rewritten by
+//               intermediate merges, every byte is rewritten once per level
+//               of the merge tree above its run
+//  - polyphase: the classic tape schedule with K + 1 files, runs are dealt
+//               onto K files in a generalized fibonacci distribution (empty
+//               dummy runs fill it up) and every phase merges one run of each
+//               input file until one of them is empty. it never needs more
+//               than K + 1 files but rewrites more than huffman
+//
+// run ids: [0, runs) are the initial runs, runs + i is the output of step i.
+// the last step writes the final output
+
+enum class merge_schedule { huffman, polyphase };
+
+inline const char *to_string(merge_schedule schedule) {
+  return schedule == merge_schedule::huffman ? "huffman" : "polyphase";
+}
+
+struct merge_step {
+  std::vector<size_t> inputs{};
+  // bytes read and written by this step
+  uint64_t bytes{};
+};
+
+struct merge_plan {
+  size_t runs{};
+  std::vector<merge_step> steps{};
+  uint64_t bytes_read{};
+  uint64_t bytes_written{};
+  // bytes written by intermediate merges (and read back later)
+  uint64_t intermediate_bytes{};
+  // the largest number of merges a record goes through
+  size_t depth{};
+
+  size_t output_id(size_t step) const { return runs + step; }
+
+  // predicted seconds for the given device throughputs in bytes / second
+  double cost(double read_bandwidth, double write_bandwidth) const {
+    return bytes_read / read_bandwidth + bytes_written / write_bandwidth;
+  }
+
+  std::string to_string() const {
+    return fmt::format("{} runs, {} merge steps, depth {}, read {} bytes, "
+                       "write {} bytes ({} intermediate)",
+                       runs, steps.size(), depth, bytes_read, bytes_written,
+                       intermediate_bytes);
+  }
+};
+
+namespace merge_planner_detail {
+
+constexpr size_t DUMMY = SIZE_MAX;
+
+struct builder {
+  merge_plan plan{};
+  std::vector<uint64_t> bytes{};
+  std::vector<size_t> depth{};
+
+  explicit builder(const std::vector<uint64_t> &run_bytes)
+      : bytes(run_bytes), depth(run_bytes.size(), 0) {
+    plan.runs = run_bytes.size();
+  }
+
+  // merge the real (non dummy) inputs, returns the id of the result
+  size_t merge(const std::vector<size_t> &inputs) {
+    merge_step step{};
+    size_t d = 0;
+    for (size_t id : inputs) {
+      if (id != DUMMY) {
+        step.inputs.push_back(id);
+        step.bytes += bytes[id];
+        d = std::max(d, depth[id]);
+      }
+    }
+    if (step.inputs.empty()) {
+      return DUMMY;
+    }
+    // a single real run is just relabeled, no io
+    if (step.inputs.size() == 1) {
+      return step.inputs[0];
+    }
+    size_t id = plan.output_id(plan.steps.size());
+    bytes.push_back(step.bytes);
+    depth.push_back(d + 1);
+    plan.steps.push_back(std::move(step));
+    return id;
+  }
+
+  merge_plan finish(size_t last) {
+    // the final output has to be written even for a single run
+    if (last != DUMMY &&
+        (plan.steps.empty() || last != plan.output_id(plan.steps.size() - 1))) {
+      plan.steps.push_back({{last}, bytes[last]});
+      bytes.push_back(bytes[last]);
+      depth.push_back(depth[last] + 1);
+    }
+    for (auto &step : plan.steps) {
+      plan.bytes_read += step.bytes;
+      plan.bytes_written += step.bytes;
+    }
+    if (!plan.steps.empty()) {
+      plan.intermediate_bytes = plan.bytes_written - plan.steps.back().bytes;
+      plan.depth = depth.back();
+    }
+    return std::move(plan);
+  }
+};
+
+inline merge_plan huffman(const std::vector<uint64_t> &run_bytes,
+                          size_t fan_in) {
+  builder b{run_bytes};
+  size_t n = run_bytes.size();
+  // (bytes, id) min heap, empty dummies first so the first merge is the
+  // partial one
+  using entry = std::tuple<uint64_t, size_t, size_t>;
+  std::priority_queue<entry, std::vector<entry>, std::greater<>> heap;
+  size_t dummies = n > 1 ? (fan_in - 1 - (n - 1) % (fan_in - 1)) % (fan_in - 1)
+                         : 0;
+  for (size_t i = 0; i < dummies; i++) {
+    heap.emplace(0, 0, DUMMY);
+  }
+  for (size_t i = 0; i < n; i++) {
+    heap.emplace(run_bytes[i], 1, i);
+  }
+  while (heap.size() > 1) {
+    std::vector<size_t> inputs;
+    for (size_t i = 0; i < fan_in && !heap.empty(); i++) {
+      inputs.push_back(std::get<2>(heap.top()));
+      heap.pop();
+    }
+    size_t id = b.merge(inputs);
+    heap.emplace(id == DUMMY ? 0 : b.bytes[id], 1, id);
+  }
+  return b.finish(heap.empty() ? DUMMY : std::get<2>(heap.top()));
+}
+
+inline merge_plan polyphase(const std::vector<uint64_t> &run_bytes,
+                            size_t fan_in) {
+  builder b{run_bytes};
+  size_t n = run_bytes.size();
+  if (n <= 1) {
+    return b.finish(n ? 0 : DUMMY);
+  }
+  // perfect distribution: level 1 is one run per file, then
+  // next[i] = curr[0] + curr[i + 1] (with curr[fan_in] = 0)
+  std::vector<uint64_t> target(fan_in, 1);
+  auto total = [&]() {
+    uint64_t t = 0;
+    for (uint64_t v : target) {
+      t += v;
+    }
+    return t;
+  };
+  while (total() < n) {
+    std::vector<uint64_t> next(fan_in);
+    for (size_t i = 0; i < fan_in; i++) {
+      next[i] = target[0] + (i + 1 < fan_in ? target[i + 1] : 0);
+    }
+    target = std::move(next);
+  }
+  // the dummies go round robin to the front of the files, so the first
+  // phase merges them away with the least copying, then the runs are dealt
+  // round robin over the files that still need runs
+  std::vector<std::deque<size_t>> files(fan_in + 1);
+  uint64_t dummies = total() - n;
+  std::vector<uint64_t> missing = target;
+  for (size_t f = 0; dummies > 0; f = (f + 1) % fan_in) {
+    if (missing[f] > 0) {
+      files[f].push_back(DUMMY);
+      missing[f]--;
+      dummies--;
+    }
+  }
+  size_t next_run = 0;
+  for (bool placed = true; placed;) {
+    placed = false;
+    for (size_t f = 0; f < fan_in; f++) {
+      if (missing[f] > 0) {
+        files[f].push_back(next_run++);
+        missing[f]--;
+        placed = true;
+      }
+    }
+  }
+
+  size_t output = fan_in;
+  while (true) {
+    size_t remaining = 0;
+    for (auto &f : files) {
+      remaining += f.size();
+    }
+    if (remaining <= 1) {
+      break;
+    }
+    // one phase: merge until an input file runs dry
+    size_t m = SIZE_MAX;
+    for (size_t f = 0; f <= fan_in; f++) {
+      if (f != output) {
+        m = std::min(m, files[f].size());
+      }
+    }
+    for (size_t k = 0; k < m; k++) {
+      std::vector<size_t> inputs;
+      for (size_t f = 0; f <= fan_in; f++) {
+        if (f != output) {
+          inputs.push_back(files[f].front());
+          files[f].pop_front();
+        }
+      }
+      files[output].push_back(b.merge(inputs));
+    }
+    // the empty input file is the next output
+    for (size_t f = 0; f <= fan_in; f++) {
+      if (f != output && files[f].empty()) {
+        output = f;
+        break;
+      }
+    }
+  }
+  size_t last = DUMMY;
+  for (auto &f : files) {
+    if (!f.empty()) {
+      last = f.front();
+    }
+  }
+  return b.finish(last);
+}
+
+} // namespace merge_planner_detail
+
+// plan the merges of runs with the given sizes (bytes, or any unit of io),
+// at most fan_in runs per merge
+inline merge_plan
+plan_merge(const std::vector<uint64_t> &run_bytes, size_t fan_in,
+           merge_schedule schedule = merge_schedule::huffman) {
+  if (fan_in < 2) {
+    throw std::invalid_argument("fan-in must be at least 2");
+  }
+  return schedule == merge_schedule::huffman
+             ? merge_planner_detail::huffman(run_bytes, fan_in)
+             : merge_planner_detail::polyphase(run_bytes, fan_in);
+}
@@ -0,0 +1,337 @@
+#pragma once
+
+// sort a file of fixed size binary records in place through mmap, for files
+// that fit in the page cache: no copy into a std::vector and no heap
+// allocation at all, the engines work on a record_span (runtime record size)
+// with swaps through a small stack buffer
+//
+// the key is an unsigned little endian integer of 1..8 bytes at a fixed
+// offset inside the record
+//  - radix:     in place msd radix sort (american flag sort), one byte per
+//               level from the most significant one, small buckets are
+//               finished by insertion sort
+//  - introsort: median of 3 quick sort, heap sort when the recursion gets too
+//               deep, insertion sort for small ranges
+// neither is stable
+//
+// posix only, EXTERNAL_MMAP_SORT is defined when available
+
+#if defined(__unix__) || defined(__APPLE__)
+#define EXTERNAL_MMAP_SORT 1
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct record_key {
+  // byte offset of the key inside the record
+  size_t offset{};
+  // key bytes, 1..8
+  size_t width{8};
+};
+
+enum class mmap_sort_engine { radix, introsort };
+
+// a shared read / write mapping of a whole file
+class mapped_file {
+public:
+  explicit mapped_file(const std::string &path) {
+    m_fd = ::open(path.c_str(), O_RDWR);
+    if (m_fd < 0) {
+      throw std::runtime_error("failed to open " + path);
+    }
+    struct stat st {};
+    if (::fstat(m_fd, &st) != 0) {
+      ::close(m_fd);
+      throw std::runtime_error("failed to stat " + path);
+    }
+    m_size = static_cast<size_t>(st.st_size);
+    if (m_size == 0) {
+      // mmap of length 0 is an error, an empty file needs no mapping
+      return;
+    }
+    void *ptr = ::mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                       m_fd, 0);
+    if (ptr == MAP_FAILED) {
+      ::close(m_fd);
+      throw std::runtime_error("failed to mmap " + path);
+    }
+    m_data = static_cast<char *>(ptr);
+  }
+
+  ~mapped_file() {
+    if (m_data) {
+      ::munmap(m_data, m_size);
+    }
+    if (m_fd >= 0) {
+      ::close(m_fd);
+    }
+  }
+
+  mapped_file(const mapped_file &) = delete;
+  mapped_file &operator=(const mapped_file &) = delete;
+
+  char *data() const { return m_data; }
+
+  size_t size() const { return m_size; }
+
+  // madvise hint, a refused hint is not an error
+  void advise(int advice) const {
+    if (m_data) {
+      ::madvise(m_data, m_size, advice);
+    }
+  }
+
+  // write the dirty pages back and wait for it
+  void sync() const {
+    if (m_data && ::msync(m_data, m_size, MS_SYNC) != 0) {
+      throw std::runtime_error("msync failed");
+    }
+  }
+
+private:
+  int m_fd{-1};
+  char *m_data{};
+  size_t m_size{};
+};
+
+// records of a runtime size in one contiguous buffer
+class record_span {
+public:
+  record_span(char *data, size_t record_size, size_t count)
+      : m_data(data), m_record_size(record_size), m_count(count) {}
+
+  size_t size() const { return m_count; }
+
+  size_t record_size() const { return m_record_size; }
+
+  char *operator[](size_t i) const { return m_data + i * m_record_size; }
+
+  void swap(size_t i, size_t j) const {
+    if (i == j) {
+      return;
+    }
+    char *a = (*this)[i];
+    char *b = (*this)[j];
+    char buffer[64];
+    for (size_t done = 0; done < m_record_size; done += sizeof(buffer)) {
+      size_t n = std::min(sizeof(buffer), m_record_size - done);
+      std::memcpy(buffer, a + done, n);
+      std::memcpy(a + done, b + done, n);
+      std::memcpy(b + done, buffer, n);
+    }
+  }
+
+private:
+  char *m_data{};
+  size_t m_record_size{};
+  size_t m_count{};
+};
+
+namespace mmap_sort_detail {
+
+constexpr size_t INSERTION_THRESHOLD = 32;
+
+inline uint64_t load_key(const char *record, const record_key &key) {
+  const unsigned char *p =
+      reinterpret_cast<const unsigned char *>(record + key.offset);
+  uint64_t k = 0;
+  for (size_t b = key.width; b-- > 0;) {
+    k = k << 8 | p[b];
+  }
+  return k;
+}
+
+inline void insertion_sort(const record_span &span, size_t lo, size_t hi,
+                           const record_key &key) {
+  for (size_t i = lo + 1; i < hi; i++) {
+    uint64_t k = load_key(span[i], key);
+    for (size_t j = i; j > lo && load_key(span[j - 1], key) > k; j--) {
+      span.swap(j - 1, j);
+    }
+  }
+}
+
+// american flag sort on key byte `byte` (counted from the least significant)
+inline void radix_sort(const record_span &span, size_t lo, size_t hi,
+                       const record_key &key, size_t byte) {
+  while (true) {
+    size_t n = hi - lo;
+    if (n <= INSERTION_THRESHOLD) {
+      insertion_sort(span, lo, hi, key);
+      return;
+    }
+    auto digit = [&](size_t i) {
+      return static_cast<unsigned char>(span[i][key.offset + byte]);
+    };
+    size_t count[256] = {};
+    for (size_t i = lo; i < hi; i++) {
+      count[digit(i)]++;
+    }
+    // all in one bucket: nothing to permute on this byte
+    if (count[digit(lo)] == n) {
+      if (byte == 0) {
+        return;
+      }
+      byte--;
+      continue;
+    }
+    size_t start[257];
+    size_t next[256];
+    start[0] = lo;
+    for (int b = 0; b < 256; b++) {
+      start[b + 1] = start[b] + count[b];
+      next[b] = start[b];
+    }
+    // cycle every misplaced record into its bucket
+    for (int b = 0; b < 256; b++) {
+      while (next[b] < start[b + 1]) {
+        unsigned char d = digit(next[b]);
+        if (d == b) {
+          next[b]++;
+        } else {
+          span.swap(next[b], next[d]++);
+        }
+      }
+    }
+    if (byte == 0) {
+      return;
+    }
+    for (int b = 0; b < 256; b++) {
+      if (count[b] > 1) {
+        radix_sort(span, start[b], start[b + 1], key, byte - 1);
+      }
+    }
+    return;
+  }
+}
+
+inline void sift_down(const record_span &span, size_t lo, size_t i, size_t n,
+                      const record_key &key) {
+  while (true) {
+    size_t child = 2 * i + 1;
+    if (child >= n) {
+      return;
+    }
+    if (child + 1 < n && load_key(span[lo + child], key) <
+                             load_key(span[lo + child + 1], key)) {
+      child++;
+    }
+    if (load_key(span[lo + i], key) >= load_key(span[lo + child], key)) {
+      return;
+    }
+    span.swap(lo + i, lo + child);
+    i = child;
+  }
+}
+
+inline void heap_sort(const record_span &span, size_t lo, size_t hi,
+                      const record_key &key) {
+  size_t n = hi - lo;
+  for (size_t i = n / 2; i-- > 0;) {
+    sift_down(span, lo, i, n, key);
+  }
+  for (size_t end = n; end-- > 1;) {
+    span.swap(lo, lo + end);
+    sift_down(span, lo, 0, end, key);
+  }
+}
+
+inline void introsort(const record_span &span, size_t lo, size_t hi,
+                      const record_key &key, int depth) {
+  while (hi - lo > INSERTION_THRESHOLD) {
+    if (depth-- == 0) {
+      heap_sort(span, lo, hi, key);
+      return;
+    }
+    // median of 3 into lo, then hoare partition around its key
+    size_t mid = lo + (hi - lo) / 2;
+    if (load_key(span[mid], key) < load_key(span[lo], key)) {
+      span.swap(mid, lo);
+    }
+    if (load_key(span[hi - 1], key) < load_key(span[lo], key)) {
+      span.swap(hi - 1, lo);
+    }
+    if (load_key(span[hi - 1], key) < load_key(span[mid], key)) {
+      span.swap(hi - 1, mid);
+    }
+    span.swap(lo, mid);
+    uint64_t pivot = load_key(span[lo], key);
+    size_t i = lo, j = hi;
+    while (true) {
+      while (load_key(span[++i], key) < pivot) {
+      }
+      while (pivot < load_key(span[--j], key)) {
+      }
+      if (i >= j) {
+        break;
+      }
+      span.swap(i, j);
+    }
+    span.swap(lo, j);
+    // recurse into the smaller side, loop on the larger one
+    if (j - lo < hi - j - 1) {
+      introsort(span, lo, j, key, depth);
+      lo = j + 1;
+    } else {
+      introsort(span, j + 1, hi, key, depth);
+      hi = j;
+    }
+  }
+  insertion_sort(span, lo, hi, key);
+}
+
+} // namespace mmap_sort_detail
+
+inline void sort_records(const record_span &span, const record_key &key,
+                         mmap_sort_engine engine = mmap_sort_engine::radix) {
+  if (key.width == 0 || key.width > 8 ||
+      key.offset + key.width > span.record_size()) {
+    throw std::invalid_argument("key does not fit in the record");
+  }
+  if (span.size() < 2) {
+    return;
+  }
+  if (engine == mmap_sort_engine::radix) {
+    mmap_sort_detail::radix_sort(span, 0, span.size(), key, key.width - 1);
+  } else {
+    int depth = 0;
+    for (size_t n = span.size(); n > 1; n >>= 1) {
+      depth += 2;
+    }
+    mmap_sort_detail::introsort(span, 0, span.size(), key, depth);
+  }
+}
+
+// sort the records of the file in place and flush it, returns the number of
+// records
+inline size_t mmap_sort(const std::string &path, size_t record_size,
+                        const record_key &key,
+                        mmap_sort_engine engine = mmap_sort_engine::radix) {
+  if (record_size == 0) {
+    throw std::invalid_argument("record size must be positive");
+  }
+  mapped_file file{path};
+  if (file.size() % record_size != 0) {
+    throw std::runtime_error(path + " is not a whole number of records");
+  }
+  // read ahead the whole file, the radix passes scan every bucket front to
+  // back, the quick sort partitions scan from both ends
+  file.advise(MADV_WILLNEED);
+  file.advise(engine == mmap_sort_engine::radix ? MADV_SEQUENTIAL
+                                                : MADV_NORMAL);
+  record_span span{file.data(), record_size, file.size() / record_size};
+  sort_records(span, key, engine);
+  file.sync();
+  return span.size();
+}
+
+#endif
@@ -0,0 +1,261 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// block buffered streams of fixed size binary records (any trivially copyable
+// T is written as is, no header, no framing)
+
+struct file_closer {
+  void operator()(std::FILE *file) const {
+    if (file) {
+      std::fclose(file);
+    }
+  }
+};
+
+using file_ptr = std::unique_ptr<std::FILE, file_closer>;
+
+inline file_ptr open_file(const std::string &path, const char *mode) {
+  file_ptr file{std::fopen(path.c_str(), mode)};
+  if (!file) {
+    throw std::runtime_error("failed to open " + path);
+  }
+  return file;
+}
+
+inline void seek_record(std::FILE *file, uint64_t index, size_t record_size) {
+#ifdef _WIN32
+  int res = _fseeki64(file, static_cast<int64_t>(index * record_size),
+                      SEEK_SET);
+#else
+  int res = fseeko(file, static_cast<off_t>(index * record_size), SEEK_SET);
+#endif
+  if (res != 0) {
+    throw std::runtime_error("failed to seek record file");
+  }
+}
+
+// a file in the temp directory which is removed with the object
+class temp_file {
+public:
+  explicit temp_file(const std::string &dir = {}) {
+    static std::atomic<uint64_t> counter{0};
+    static const uint64_t prefix = std::random_device{}();
+    std::filesystem::path base =
+        dir.empty() ? std::filesystem::temp_directory_path()
+                    : std::filesystem::path(dir);
+    m_path = (base / ("external_sort_" + std::to_string(prefix) + "_" +
+                      std::to_string(counter++) + ".run"))
+                 .string();
+  }
+
+  ~temp_file() { remove(); }
+
+  temp_file(const temp_file &) = delete;
+  temp_file &operator=(const temp_file &) = delete;
+
+  temp_file(temp_file &&f) noexcept : m_path(std::move(f.m_path)) {
+    f.m_path.clear();
+  }
+
+  temp_file &operator=(temp_file &&f) noexcept {
+    if (this != &f) {
+      remove();
+      m_path = std::move(f.m_path);
+      f.m_path.clear();
+    }
+    return *this;
+  }
+
+  const std::string &path() const { return m_path; }
+
+  void remove() {
+    if (!m_path.empty()) {
+      std::error_code ec;
+      std::filesystem::remove(m_path, ec);
+      m_path.clear();
+    }
+  }
+
+private:
+  std::string m_path{};
+};
+
+// cursor over a record file: front() / pop() / empty()
+template <typename T> class record_reader {
+  static_assert(std::is_trivially_copyable_v<T>);
+
+public:
+  record_reader(const std::string &path, size_t block_records)
+      : m_file(open_file(path, "rb")),
+        m_buffer(std::max<size_t>(block_records, 1)) {
+    refill();
+  }
+
+  // only the records [first, last) of the file
+  record_reader(const std::string &path, size_t block_records, uint64_t first,
+                uint64_t last)
+      : m_file(open_file(path, "rb")),
+        m_buffer(std::max<size_t>(std::min<uint64_t>(block_records,
+                                                     last - first),
+                                  1)),
+        m_remaining(last - first) {
+    seek_record(m_file.get(), first, sizeof(T));
+    refill();
+  }
+
+  bool empty() const { return m_pos == m_size; }
+
+  const T &front() const { return m_buffer[m_pos]; }
+
+  T &front() { return m_buffer[m_pos]; }
+
+  void pop() {
+    if (++m_pos == m_size) {
+      refill();
+    }
+  }
+
+  uint64_t bytes_read() const { return m_bytes_read; }
+
+private:
+  void refill() {
+    m_pos = 0;
+    size_t n = static_cast<size_t>(
+        std::min<uint64_t>(m_buffer.size(), m_remaining));
+    m_size = n ? std::fread(m_buffer.data(), sizeof(T), n, m_file.get()) : 0;
+    m_remaining -= m_size;
+    m_bytes_read += m_size * sizeof(T);
+    if (m_size == 0 && std::ferror(m_file.get())) {
+      throw std::runtime_error("failed to read record file");
+    }
+  }
+
+private:
+  file_ptr m_file{};
+  std::vector<T> m_buffer{};
+  size_t m_pos{};
+  size_t m_size{};
+  uint64_t m_remaining{UINT64_MAX};
+  uint64_t m_bytes_read{};
+};
+
+template <typename T> class record_writer {
+  static_assert(std::is_trivially_copyable_v<T>);
+
+public:
+  record_writer(const std::string &path, size_t block_records)
+      : m_file(open_file(path, "wb")) {
+    m_buffer.reserve(std::max<size_t>(block_records, 1));
+  }
+
+  // write into an existing file starting at record `first`, several writers
+  // can fill disjoint parts of the same file
+  record_writer(const std::string &path, size_t block_records, uint64_t first)
+      : m_file(open_file(path, "r+b")) {
+    seek_record(m_file.get(), first, sizeof(T));
+    m_buffer.reserve(std::max<size_t>(block_records, 1));
+  }
+
+  // the buffered records are written when close() was not called, only
+  // close() reports a failed write though
+  ~record_writer() {
+    if (m_file) {
+      try {
+        flush();
+      } catch (...) {
+      }
+    }
+  }
+
+  record_writer(const record_writer &) = delete;
+  record_writer &operator=(const record_writer &) = delete;
+
+  void push(const T &value) {
+    m_buffer.push_back(value);
+    if (m_buffer.size() == m_buffer.capacity()) {
+      flush();
+    }
+  }
+
+  // append n records at once, bypassing the buffer when it is empty
+  void push(const T *data, size_t n) {
+    if (m_buffer.empty() && n >= m_buffer.capacity()) {
+      write(data, n);
+      return;
+    }
+    for (size_t i = 0; i < n; i++) {
+      push(data[i]);
+    }
+  }
+
+  void close() {
+    flush();
+    if (std::fclose(m_file.release()) != 0) {
+      throw std::runtime_error("failed to close record file");
+    }
+  }
+
+  uint64_t records() const { return m_records; }
+
+  uint64_t bytes_written() const { return m_records * sizeof(T); }
+
+private:
+  void flush() {
+    if (m_buffer.empty()) {
+      return;
+    }
+    write(m_buffer.data(), m_buffer.size());
+    m_buffer.clear();
+  }
+
+  void write(const T *data, size_t n) {
+    if (std::fwrite(data, sizeof(T), n, m_file.get()) != n) {
+      throw std::runtime_error("failed to write record file");
+    }
+    m_records += n;
+  }
+
+private:
+  file_ptr m_file{};
+  std::vector<T> m_buffer{};
+  uint64_t m_records{};
+};
+
+// random access to the records of a file, one seek + read per access (for
+// binary searches over runs, not for scans). not thread safe, every thread
+// needs its own view
+template <typename T> class record_file_view {
+  static_assert(std::is_trivially_copyable_v<T>);
+
+public:
+  explicit record_file_view(const std::string &path)
+      : m_file(open_file(path, "rb")) {
+    m_size = std::filesystem::file_size(path) / sizeof(T);
+  }
+
+  size_t size() const { return m_size; }
+
+  T operator[](size_t i) const {
+    T value{};
+    seek_record(m_file.get(), i, sizeof(T));
+    if (std::fread(&value, sizeof(T), 1, m_file.get()) != 1) {
+      throw std::runtime_error("failed to read record file");
+    }
+    return value;
+  }
+
+private:
+  file_ptr m_file{};
+  size_t m_size{};
+};
@@ -0,0 +1,443 @@
+#pragma once
+
+#include "record_io.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// compressed run files for integer keys
+//
+// a run file is a sequence of blocks:
+//   block_header (24 bytes): count, bit width, mode, min, max
+//   payload: ceil(count / 64) groups, a group packs 64 values of `width` bits
+//            into exactly `width` 64 bit words
+// values are first mapped to unsigned (sign bit flipped for signed types),
+// then coded either as frame of reference (value - min) or, for a non
+// decreasing block (any run sorted with std::less), as deltas to the previous
+// value, whichever needs fewer bits. sorted 64 bit timestamps typically need
+// 8-20 bits per value instead of 64
+//
+// decode is one unpack<W> per group (W is a template parameter, so all shifts
+// and masks are constants and the loop vectorizes) and, for delta blocks, a
+// prefix sum
+
+namespace run_codec {
+
+constexpr size_t GROUP = 64;
+
+enum block_mode : uint8_t { FRAME_OF_REFERENCE = 0, DELTA = 1 };
+
+struct block_header {
+  uint32_t count{};
+  uint8_t width{};
+  uint8_t mode{};
+  uint16_t reserved{};
+  uint64_t min{};
+  uint64_t max{};
+};
+
+static_assert(sizeof(block_header) == 24);
+
+inline size_t payload_words(size_t count, unsigned width) {
+  return (count + GROUP - 1) / GROUP * width;
+}
+
+inline unsigned bit_width(uint64_t v) {
+  unsigned w = 0;
+  while (v) {
+    w++;
+    v >>= 1;
+  }
+  return w;
+}
+
+template <typename T> uint64_t to_unsigned(T v) {
+  static_assert(std::is_integral_v<T> && sizeof(T) <= 8);
+  if constexpr (std::is_signed_v<T>) {
+    return static_cast<uint64_t>(static_cast<int64_t>(v)) ^
+           (uint64_t{1} << 63);
+  } else {
+    return static_cast<uint64_t>(v);
+  }
+}
+
+template <typename T> T from_unsigned(uint64_t v) {
+  if constexpr (std::is_signed_v<T>) {
+    return static_cast<T>(static_cast<int64_t>(v ^ (uint64_t{1} << 63)));
+  } else {
+    return static_cast<T>(v);
+  }
+}
+
+template <unsigned W> void pack(const uint64_t *in, uint64_t *out) {
+  if constexpr (W > 0) {
+    constexpr uint64_t mask = W == 64 ? ~uint64_t{0} : (uint64_t{1} << W) - 1;
+    std::fill(out, out + W, 0);
+    for (size_t i = 0; i < GROUP; i++) {
+      size_t bit = i * W;
+      size_t word = bit / 64;
+      size_t offset = bit % 64;
+      uint64_t v = in[i] & mask;
+      out[word] |= v << offset;
+      if (offset + W > 64) {
+        out[word + 1] |= v >> (64 - offset);
+      }
+    }
+  }
+}
+
+template <unsigned W> void unpack(const uint64_t *in, uint64_t *out) {
+  if constexpr (W == 0) {
+    std::fill(out, out + GROUP, 0);
+  } else {
+    constexpr uint64_t mask = W == 64 ? ~uint64_t{0} : (uint64_t{1} << W) - 1;
+    for (size_t i = 0; i < GROUP; i++) {
+      size_t bit = i * W;
+      size_t word = bit / 64;
+      size_t offset = bit % 64;
+      uint64_t v = in[word] >> offset;
+      if (offset + W > 64) {
+        v |= in[word + 1] << (64 - offset);
+      }
+      out[i] = v & mask;
+    }
+  }
+}
+
+using pack_fn = void (*)(const uint64_t *, uint64_t *);
+
+template <size_t... W>
+constexpr std::array<pack_fn, sizeof...(W)>
+make_pack_table(std::index_sequence<W...>) {
+  return {&pack<W>...};
+}
+
+template <size_t... W>
+constexpr std::array<pack_fn, sizeof...(W)>
+make_unpack_table(std::index_sequence<W...>) {
+  return {&unpack<W>...};
+}
+
+// width -> kernel
+inline constexpr auto PACK = make_pack_table(std::make_index_sequence<65>{});
+inline constexpr auto UNPACK =
+    make_unpack_table(std::make_index_sequence<65>{});
+
+// encode count values (already mapped to unsigned) into header + payload
+inline block_header encode(const uint64_t *values, size_t count,
+                           std::vector<uint64_t> &payload) {
+  block_header header{};
+  header.count = static_cast<uint32_t>(count);
+  if (count == 0) {
+    payload.clear();
+    return header;
+  }
+  uint64_t min = values[0], max = values[0];
+  uint64_t max_delta = 0;
+  bool monotone = true;
+  for (size_t i = 1; i < count; i++) {
+    min = std::min(min, values[i]);
+    max = std::max(max, values[i]);
+    monotone &= values[i] >= values[i - 1];
+    max_delta = std::max(max_delta, values[i] - values[i - 1]);
+  }
+  header.min = min;
+  header.max = max;
+  unsigned for_width = bit_width(max - min);
+  unsigned delta_width = monotone ? bit_width(max_delta) : 64;
+  header.mode = delta_width < for_width ? DELTA : FRAME_OF_REFERENCE;
+  header.width = static_cast<uint8_t>(std::min(for_width, delta_width));
+
+  payload.assign(payload_words(count, header.width), 0);
+  uint64_t group[GROUP];
+  for (size_t first = 0, g = 0; first < count; first += GROUP, g++) {
+    size_t n = std::min(GROUP, count - first);
+    for (size_t i = 0; i < n; i++) {
+      size_t k = first + i;
+      group[i] = header.mode == DELTA ? (k ? values[k] - values[k - 1] : 0)
+                                      : values[k] - min;
+    }
+    std::fill(group + n, group + GROUP, 0);
+    PACK[header.width](group, payload.data() + g * header.width);
+  }
+  return header;
+}
+
+// decode a block into out (which must hold header.count values, rounded up
+// to a whole group)
+inline void decode(const block_header &header, const uint64_t *payload,
+                   uint64_t *out) {
+  size_t count = header.count;
+  size_t groups = (count + GROUP - 1) / GROUP;
+  for (size_t g = 0; g < groups; g++) {
+    UNPACK[header.width](payload + g * header.width, out + g * GROUP);
+  }
+  if (header.mode == DELTA) {
+    uint64_t acc = header.min;
+    for (size_t i = 0; i < count; i++) {
+      acc += out[i];
+      out[i] = acc;
+    }
+  } else {
+    for (size_t i = 0; i < count; i++) {
+      out[i] += header.min;
+    }
+  }
+}
+
+inline size_t round_to_group(size_t n) {
+  return (n + GROUP - 1) / GROUP * GROUP;
+}
+
+} // namespace run_codec
+
+template <typename T> class compressed_run_writer {
+  static_assert(std::is_integral_v<T> && sizeof(T) <= 8);
+
+public:
+  compressed_run_writer(const std::string &path, size_t block_records)
+      : m_file(open_file(path, "wb")),
+        m_block_records(std::clamp<size_t>(
+            block_records, run_codec::GROUP,
+            std::numeric_limits<uint32_t>::max() / 2)) {
+    m_values.reserve(m_block_records);
+  }
+
+  // the buffered records are written when close() was not called, only
+  // close() reports a failed write though
+  ~compressed_run_writer() {
+    if (m_file) {
+      try {
+        flush();
+      } catch (...) {
+      }
+    }
+  }
+
+  compressed_run_writer(const compressed_run_writer &) = delete;
+  compressed_run_writer &operator=(const compressed_run_writer &) = delete;
+
+  void push(const T &value) {
+    m_values.push_back(run_codec::to_unsigned(value));
+    if (m_values.size() == m_block_records) {
+      flush();
+    }
+  }
+
+  void push(const T *data, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+      push(data[i]);
+    }
+  }
+
+  void close() {
+    flush();
+    if (std::fclose(m_file.release()) != 0) {
+      throw std::runtime_error("failed to close run file");
+    }
+  }
+
+  uint64_t records() const { return m_records; }
+
+  // compressed size
+  uint64_t bytes_written() const { return m_bytes_written; }
+
+private:
+  void flush() {
+    if (m_values.empty()) {
+      return;
+    }
+    run_codec::block_header header =
+        run_codec::encode(m_values.data(), m_values.size(), m_payload);
+    // a block of equal values has no payload
+    if (std::fwrite(&header, sizeof(header), 1, m_file.get()) != 1 ||
+        (!m_payload.empty() &&
+         std::fwrite(m_payload.data(), sizeof(uint64_t), m_payload.size(),
+                     m_file.get()) != m_payload.size())) {
+      throw std::runtime_error("failed to write run file");
+    }
+    m_records += m_values.size();
+    m_bytes_written += sizeof(header) + m_payload.size() * sizeof(uint64_t);
+    m_values.clear();
+  }
+
+private:
+  file_ptr m_file{};
+  size_t m_block_records{};
+  std::vector<uint64_t> m_values{};
+  std::vector<uint64_t> m_payload{};
+  uint64_t m_records{};
+  uint64_t m_bytes_written{};
+};
+
+// cursor over a compressed run, optionally limited to the records
+// [first, last)
+template <typename T> class compressed_run_reader {
+  static_assert(std::is_integral_v<T> && sizeof(T) <= 8);
+
+public:
+  explicit compressed_run_reader(const std::string &path, size_t = 0)
+      : m_file(open_file(path, "rb")) {
+    refill();
+  }
+
+  compressed_run_reader(const std::string &path, size_t, uint64_t first,
+                        uint64_t last)
+      : m_file(open_file(path, "rb")), m_remaining(last - first) {
+    // skip whole blocks by their header, then the head of the first block
+    run_codec::block_header header{};
+    uint64_t skipped = 0;
+    while (m_remaining > 0 && read_header(header)) {
+      if (skipped + header.count > first) {
+        load(header);
+        m_pos = static_cast<size_t>(first - skipped);
+        m_size = static_cast<size_t>(
+            std::min<uint64_t>(header.count, m_pos + m_remaining));
+        m_remaining -= m_size - m_pos;
+        return;
+      }
+      skipped += header.count;
+      skip_payload(header);
+    }
+  }
+
+  bool empty() const { return m_pos == m_size; }
+
+  const T &front() const { return m_values[m_pos]; }
+
+  T &front() { return m_values[m_pos]; }
+
+  void pop() {
+    if (++m_pos == m_size) {
+      refill();
+    }
+  }
+
+  uint64_t bytes_read() const { return m_bytes_read; }
+
+private:
+  bool read_header(run_codec::block_header &header) {
+    size_t n = std::fread(&header, sizeof(header), 1, m_file.get());
+    if (n != 1) {
+      if (std::ferror(m_file.get())) {
+        throw std::runtime_error("failed to read run file");
+      }
+      return false;
+    }
+    m_bytes_read += sizeof(header);
+    m_offset += sizeof(header);
+    return true;
+  }
+
+  void skip_payload(const run_codec::block_header &header) {
+    size_t words = run_codec::payload_words(header.count, header.width);
+    m_offset += words * sizeof(uint64_t);
+    seek_record(m_file.get(), m_offset, 1);
+  }
+
+  void load(const run_codec::block_header &header) {
+    size_t words = run_codec::payload_words(header.count, header.width);
+    m_payload.resize(words);
+    if (std::fread(m_payload.data(), sizeof(uint64_t), words, m_file.get()) !=
+        words) {
+      throw std::runtime_error("truncated run file");
+    }
+    m_bytes_read += words * sizeof(uint64_t);
+    m_offset += words * sizeof(uint64_t);
+    m_decoded.resize(run_codec::round_to_group(header.count));
+    run_codec::decode(header, m_payload.data(), m_decoded.data());
+    m_values.resize(header.count);
+    for (size_t i = 0; i < header.count; i++) {
+      m_values[i] = run_codec::from_unsigned<T>(m_decoded[i]);
+    }
+  }
+
+  void refill() {
+    m_pos = m_size = 0;
+    run_codec::block_header header{};
+    if (m_remaining == 0 || !read_header(header)) {
+      return;
+    }
+    load(header);
+    m_size = static_cast<size_t>(
+        std::min<uint64_t>(header.count, m_remaining));
+    m_remaining -= m_size;
+  }
+
+private:
+  file_ptr m_file{};
+  std::vector<uint64_t> m_payload{};
+  std::vector<uint64_t> m_decoded{};
+  std::vector<T> m_values{};
+  size_t m_pos{};
+  size_t m_size{};
+  uint64_t m_remaining{UINT64_MAX};
+  // file position
+  uint64_t m_offset{};
+  uint64_t m_bytes_read{};
+};
+
+// random access to a compressed run (block index from the headers, the last
+// decoded block is cached), for binary searches. not thread safe
+template <typename T> class compressed_run_view {
+public:
+  explicit compressed_run_view(const std::string &path)
+      : m_file(open_file(path, "rb")) {
+    run_codec::block_header header{};
+    uint64_t offset = 0;
+    while (std::fread(&header, sizeof(header), 1, m_file.get()) == 1) {
+      size_t words = run_codec::payload_words(header.count, header.width);
+      m_blocks.push_back({offset, m_size, header});
+      m_size += header.count;
+      offset += sizeof(header) + words * sizeof(uint64_t);
+      seek_record(m_file.get(), offset, 1);
+    }
+  }
+
+  size_t size() const { return m_size; }
+
+  T operator[](size_t i) const {
+    auto it = std::upper_bound(
+        m_blocks.begin(), m_blocks.end(), i,
+        [](size_t i, const block_info &b) { return i < b.first; });
+    size_t b = static_cast<size_t>(it - m_blocks.begin()) - 1;
+    if (b != m_cached) {
+      const block_info &info = m_blocks[b];
+      size_t words =
+          run_codec::payload_words(info.header.count, info.header.width);
+      m_payload.resize(words);
+      seek_record(m_file.get(), info.offset + sizeof(run_codec::block_header),
+                  1);
+      if (std::fread(m_payload.data(), sizeof(uint64_t), words,
+                     m_file.get()) != words) {
+        throw std::runtime_error("truncated run file");
+      }
+      m_decoded.resize(run_codec::round_to_group(info.header.count));
+      run_codec::decode(info.header, m_payload.data(), m_decoded.data());
+      m_cached = b;
+    }
+    return run_codec::from_unsigned<T>(m_decoded[i - m_blocks[b].first]);
+  }
+
+private:
+  struct block_info {
+    uint64_t offset{};
+    size_t first{};
+    run_codec::block_header header{};
+  };
+
+  file_ptr m_file{};
+  std::vector<block_info> m_blocks{};
+  size_t m_size{};
+  mutable size_t m_cached{SIZE_MAX};
+  mutable std::vector<uint64_t> m_payload{};
+  mutable std::vector<uint64_t> m_decoded{};
+};
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <utility>
+#include <vector>
+
+// replacement selection: turn a stream into sorted runs using a heap that
+// fits in a byte budget. every record that is not smaller than the last
+// output still joins the current run, so on random input a run is ~2x the heap
+// capacity (and a sorted input becomes a single run)
+//
+// source: cursor with empty() / front() / pop(), front() is moved from
+// sink:   begin_run(run) / push(T &&) / end_run(run, length), called in order,
+//         a run is never materialized in memory
+
+struct run_stats {
+  uint64_t records{};
+  uint64_t runs{};
+  uint64_t min_run_length{};
+  uint64_t max_run_length{};
+  // records held by the selection heap
+  uint64_t capacity{};
+
+  double average_run_length() const {
+    return runs ? static_cast<double>(records) / runs : 0.0;
+  }
+
+  // average run length / heap capacity, ~2 on random input
+  double length_ratio() const {
+    return capacity ? average_run_length() / capacity : 0.0;
+  }
+};
+
+template <typename T, typename Comparator = std::less<T>>
+class run_generator {
+  struct entry {
+    uint64_t run{};
+    T value{};
+  };
+
+public:
+  static constexpr size_t entry_size = sizeof(entry);
+
+  explicit run_generator(size_t memory_budget,
+                         Comparator comparator = Comparator())
+      : m_capacity(std::max<size_t>(memory_budget / entry_size, 1)),
+        m_comparator(comparator) {}
+
+  size_t capacity() const { return m_capacity; }
+
+  template <typename Source, typename Sink>
+  run_stats generate(Source &source, Sink &sink) {
+    run_stats stats{};
+    stats.capacity = m_capacity;
+    stats.min_run_length = std::numeric_limits<uint64_t>::max();
+    m_heap.clear();
+    m_heap.reserve(m_capacity);
+    while (m_heap.size() < m_capacity && !source.empty()) {
+      m_heap.push_back({0, std::move(source.front())});
+      source.pop();
+    }
+    for (size_t i = m_heap.size() / 2; i-- > 0;) {
+      sift_down(i);
+    }
+
+    uint64_t curr_run = 0;
+    uint64_t length = 0;
+    auto finish_run = [&]() {
+      sink.end_run(curr_run, length);
+      stats.records += length;
+      stats.runs++;
+      stats.min_run_length = std::min(stats.min_run_length, length);
+      stats.max_run_length = std::max(stats.max_run_length, length);
+      length = 0;
+    };
+    if (!m_heap.empty()) {
+      sink.begin_run(curr_run);
+    }
+    while (!m_heap.empty()) {
+      entry &top = m_heap.front();
+      if (top.run != curr_run) {
+        finish_run();
+        curr_run = top.run;
+        sink.begin_run(curr_run);
+      }
+      if (source.empty()) {
+        sink.push(std::move(top.value));
+        length++;
+        // shrink: the last leaf takes the root
+        if (m_heap.size() > 1) {
+          top = std::move(m_heap.back());
+        }
+        m_heap.pop_back();
+        if (!m_heap.empty()) {
+          sift_down(0);
+        }
+        continue;
+      }
+      // 比刚输出的值小的记录只能进入下一个 run
+      T next = std::move(source.front());
+      source.pop();
+      uint64_t run = m_comparator(next, top.value) ? curr_run + 1 : curr_run;
+      sink.push(std::move(top.value));
+      length++;
+      top.run = run;
+      top.value = std::move(next);
+      sift_down(0);
+    }
+    if (length > 0) {
+      finish_run();
+    }
+    if (stats.runs == 0) {
+      stats.min_run_length = 0;
+    }
+    return stats;
+  }
+
+private:
+  // min heap on (run, value), one sift per output instead of pop + push
+  bool less(const entry &a, const entry &b) const {
+    return a.run != b.run ? a.run < b.run : m_comparator(a.value, b.value);
+  }
+
+  void sift_down(size_t i) {
+    size_t n = m_heap.size();
+    entry e = std::move(m_heap[i]);
+    while (true) {
+      size_t child = 2 * i + 1;
+      if (child >= n) {
+        break;
+      }
+      if (child + 1 < n && less(m_heap[child + 1], m_heap[child])) {
+        child++;
+      }
+      if (!less(m_heap[child], e)) {
+        break;
+      }
+      m_heap[i] = std::move(m_heap[child]);
+      i = child;
+    }
+    m_heap[i] = std::move(e);
+  }
+
+private:
+  size_t m_capacity{};
+  Comparator m_comparator{};
+  std::vector<entry> m_heap{};
+};
+
+// sink collecting every run into memory (for tests and small inputs)
+template <typename T> struct vector_run_sink {
+  std::vector<std::vector<T>> runs{};
+
+  void begin_run(uint64_t) { runs.emplace_back(); }
+  void push(T &&value) { runs.back().push_back(std::move(value)); }
+  void end_run(uint64_t, uint64_t) {}
+};
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <utility>
+
+#include <fmt/core.h>
+
+// for operation counting, every comparison / copy / move / swap on a
+// CountedInteger is recorded in a thread local counter, so concurrent sorts on
+// different threads never share (or contend on) the same counter
+class CountedInteger {
+public:
+  struct Counters {
+    uint64_t comparisons{};
+    uint64_t default_constructions{};
+    uint64_t copy_constructions{};
+    uint64_t copy_assignments{};
+    uint64_t move_constructions{};
+    uint64_t move_assignments{};
+    uint64_t swaps{};
+
+    uint64_t copies() const { return copy_constructions + copy_assignments; }
+    uint64_t moves() const { return move_constructions + move_assignments; }
+
+    Counters operator-(const Counters &c) const {
+      return {comparisons - c.comparisons,
+              default_constructions - c.default_constructions,
+              copy_constructions - c.copy_constructions,
+              copy_assignments - c.copy_assignments,
+              move_constructions - c.move_constructions,
+              move_assignments - c.move_assignments,
+              swaps - c.swaps};
+    }
+
+    std::string to_string() const {
+      return fmt::format("cmp: {}, default: {}, copy: {} (ctor {}, assign {}), "
+                         "move: {} (ctor {}, assign {}), swap: {}",
+                         comparisons, default_constructions, copies(),
+                         copy_constructions, copy_assignments, moves(),
+                         move_constructions, move_assignments, swaps);
+    }
+  };
+
+  // counters of the calling thread
+  static Counters &counters() {
+    thread_local Counters counters{};
+    return counters;
+  }
+
+  static void reset_counters() { counters() = Counters{}; }
+
+public:
+  CountedInteger() { counters().default_constructions++; }
+  ~CountedInteger() {}
+
+  CountedInteger(int v) : m_value(v) {}
+
+  CountedInteger &operator=(int v) {
+    m_value = v;
+    return *this;
+  }
+
+  CountedInteger(const CountedInteger &v) : m_value(v.m_value) {
+    counters().copy_constructions++;
+  }
+
+  CountedInteger &operator=(const CountedInteger &v) {
+    counters().copy_assignments++;
+    m_value = v.m_value;
+    return *this;
+  }
+
+  CountedInteger(CountedInteger &&v) noexcept : m_value(v.m_value) {
+    counters().move_constructions++;
+  }
+
+  CountedInteger &operator=(CountedInteger &&v) noexcept {
+    counters().move_assignments++;
+    m_value = v.m_value;
+    return *this;
+  }
+
+  operator int() const { return m_value; }
+
+  bool operator<(const CountedInteger &i) const {
+    counters().comparisons++;
+    return m_value < i.m_value;
+  }
+  bool operator<=(const CountedInteger &i) const {
+    counters().comparisons++;
+    return m_value <= i.m_value;
+  }
+  bool operator>(const CountedInteger &i) const {
+    counters().comparisons++;
+    return m_value > i.m_value;
+  }
+  bool operator>=(const CountedInteger &i) const {
+    counters().comparisons++;
+    return m_value >= i.m_value;
+  }
+  bool operator==(const CountedInteger &i) const {
+    counters().comparisons++;
+    return m_value == i.m_value;
+  }
+  bool operator!=(const CountedInteger &i) const {
+    counters().comparisons++;
+    return m_value != i.m_value;
+  }
+
+  // a swap is counted as one swap instead of three moves
+  friend void swap(CountedInteger &a, CountedInteger &b) noexcept {
+    counters().swaps++;
+    std::swap(a.m_value, b.m_value);
+  }
+
+  friend std::ostream &operator<<(std::ostream &os, const CountedInteger &v) {
+    return os << v.m_value;
+  }
+
+private:
+  int m_value{};
+};
+
+// the sort library calls std::swap explicitly, so it has to be specialized as
+// well (ADL only covers `using std::swap; swap(a, b)` callers like std::sort)
+namespace std {
+template <>
+inline void swap<CountedInteger>(CountedInteger &a,
+                                 CountedInteger &b) noexcept {
+  swap(a, b);
+}
+} // namespace std
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include <fmt/core.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// hardware performance counters of the calling thread (perf_event_open),
+// if the kernel refuses an event (no pmu, perf_event_paranoid, container
+// seccomp ...) that event is marked invalid and only the wall time is reported
+class PerfCounter {
+public:
+  enum Event {
+    CYCLES,
+    INSTRUCTIONS,
+    BRANCH_MISSES,
+    L1D_MISSES,
+    LLC_MISSES,
+    DTLB_MISSES,
+    EVENT_COUNT
+  };
+
+  struct Result {
+    std::chrono::steady_clock::duration elapsed{};
+    std::array<uint64_t, EVENT_COUNT> counts{};
+    std::array<bool, EVENT_COUNT> valid{};
+
+    Result &operator+=(const Result &r) {
+      elapsed += r.elapsed;
+      for (int i = 0; i < EVENT_COUNT; i++) {
+        counts[i] += r.counts[i];
+        valid[i] = valid[i] || r.valid[i];
+      }
+      return *this;
+    }
+
+    double milliseconds() const {
+      return std::chrono::duration<double, std::milli>(elapsed).count();
+    }
+
+    // 按照 n 个元素（或者 n 次操作）给出平均值
+    std::string rates(double n, const char *unit = "elem") const {
+      if (n <= 0) {
+        n = 1;
+      }
+      std::string s = fmt::format("{:.2f}ns/{}", milliseconds() * 1e6 / n, unit);
+      for (int i = 0; i < EVENT_COUNT; i++) {
+        if (valid[i]) {
+          s += fmt::format(", {} {:.3f}/{}", event_name(static_cast<Event>(i)),
+                           static_cast<double>(counts[i]) / n, unit);
+        }
+      }
+      if (valid[CYCLES] && valid[INSTRUCTIONS] && counts[CYCLES] != 0) {
+        s += fmt::format(", ipc {:.2f}", static_cast<double>(counts[INSTRUCTIONS]) /
+                                             static_cast<double>(counts[CYCLES]));
+      }
+      return s;
+    }
+  };
+
+  static const char *event_name(Event e) {
+    static const char *names[EVENT_COUNT]{"cycles",   "instructions",
+                                          "br-miss",  "l1d-miss",
+                                          "llc-miss", "dtlb-miss"};
+    return names[e];
+  }
+
+  PerfCounter() {
+    m_fds.fill(-1);
+#if defined(__linux__)
+    constexpr uint64_t cache_read_miss =
+        (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    open(CYCLES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    open(INSTRUCTIONS, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    open(BRANCH_MISSES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    open(L1D_MISSES, PERF_TYPE_HW_CACHE,
+         PERF_COUNT_HW_CACHE_L1D | cache_read_miss);
+    open(LLC_MISSES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    open(DTLB_MISSES, PERF_TYPE_HW_CACHE,
+         PERF_COUNT_HW_CACHE_DTLB | cache_read_miss);
+#endif
+  }
+
+  ~PerfCounter() {
+#if defined(__linux__)
+    for (int fd : m_fds) {
+      if (fd != -1) {
+        close(fd);
+      }
+    }
+#endif
+  }
+
+  PerfCounter(const PerfCounter &) = delete;
+  PerfCounter &operator=(const PerfCounter &) = delete;
+
+  bool available() const {
+    for (int fd : m_fds) {
+      if (fd != -1) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void start() {
+#if defined(__linux__)
+    for (int fd : m_fds) {
+      if (fd != -1) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+      }
+    }
+#endif
+    m_start = std::chrono::steady_clock::now();
+  }
+
+  Result stop() {
+    Result res{};
+    res.elapsed = std::chrono::steady_clock::now() - m_start;
+#if defined(__linux__)
+    for (int i = 0; i < EVENT_COUNT; i++) {
+      if (m_fds[i] == -1) {
+        continue;
+      }
+      ioctl(m_fds[i], PERF_EVENT_IOC_DISABLE, 0);
+      // value, time_enabled, time_running
+      uint64_t buf[3]{};
+      if (read(m_fds[i], buf, sizeof(buf)) != sizeof(buf)) {
+        continue;
+      }
+      // 事件被复用（multiplexing）时按照实际运行时间进行缩放
+      res.counts[i] =
+          buf[2] == 0 ? 0
+                      : static_cast<uint64_t>(static_cast<double>(buf[0]) *
+                                              static_cast<double>(buf[1]) /
+                                              static_cast<double>(buf[2]));
+      res.valid[i] = true;
+    }
+#endif
+    return res;
+  }
+
+private:
+#if defined(__linux__)
+  void open(Event e, uint32_t type, uint64_t config) {
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // pid = 0, cpu = -1: 只统计当前线程
+    long fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    m_fds[e] = fd < 0 ? -1 : static_cast<int>(fd);
+  }
+#endif
+
+private:
+  std::array<int, EVENT_COUNT> m_fds{};
+  std::chrono::steady_clock::time_point m_start{};
+};
+
+// RAII helper, accumulate counters of the enclosed region into `total`
+class PerfScope {
+public:
+  PerfScope(PerfCounter &counter, PerfCounter::Result &total)
+      : m_counter(counter), m_total(total) {
+    m_counter.start();
+  }
+
+  ~PerfScope() { m_total += m_counter.stop(); }
+
+  PerfScope(const PerfScope &) = delete;
+  PerfScope &operator=(const PerfScope &) = delete;
+
+private:
+  PerfCounter &m_counter;
+  PerfCounter::Result &m_total;
+};
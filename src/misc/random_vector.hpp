@@ -1,16 +1,16 @@
 #pragma once
 #include "integer.hpp"
+#include "workload.hpp"
 #include <random>
 #include <vector>
 
+// fill arr (sized by the caller) with uniform values
 template <typename T>
 void random_vector(std::vector<T> &arr, std::seed_seq seq = {133337}) {
-  std::mt19937 random(seq);
-  size_t n = arr.capacity();
+  uint32_t seed[2]{};
+  seq.generate(seed, seed + 2);
+  size_t n = arr.size();
   // limit range to (0,n/2) to make sure we can generate equal numbers (for stablity check)
-  std::uniform_int_distribution<int> uniform_dist(0, n / 2);
-  arr.clear();
-  while (n-- > 0) {
-    arr.emplace_back(uniform_dist(random));
-  }
-}
\ No newline at end of file
+  workload::fill_uniform(arr, 0, static_cast<int64_t>(n / 2),
+                         (static_cast<uint64_t>(seed[0]) << 32) | seed[1]);
+}
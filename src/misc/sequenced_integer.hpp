@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+// for stable check, 8 bytes per element and no global state:
+// m_seq records the position before sort, the sort itself only compares
+// m_value, after sorting equal values must still be ordered by m_seq
+class SequencedInteger {
+public:
+  SequencedInteger() = default;
+
+  SequencedInteger(int v) : m_value(v) {}
+
+  SequencedInteger(int v, uint32_t seq) : m_seq(seq), m_value(v) {}
+
+  SequencedInteger &operator=(int v) {
+    m_value = v;
+    m_seq = 0;
+    return *this;
+  }
+
+  operator int() const { return m_value; }
+
+  uint32_t seq() const { return m_seq; }
+
+  void set_seq(uint32_t seq) { m_seq = seq; }
+
+  bool operator<(const SequencedInteger &i) const { return m_value < i.m_value; }
+  bool operator<=(const SequencedInteger &i) const {
+    return m_value <= i.m_value;
+  }
+  bool operator>(const SequencedInteger &i) const { return m_value > i.m_value; }
+  bool operator>=(const SequencedInteger &i) const {
+    return m_value >= i.m_value;
+  }
+  bool operator==(const SequencedInteger &i) const {
+    return m_value == i.m_value && m_seq == i.m_seq;
+  }
+  bool operator!=(const SequencedInteger &i) const { return !(*this == i); }
+
+  friend std::ostream &operator<<(std::ostream &os, const SequencedInteger &v) {
+    return os << v.m_value << "[" << v.m_seq << "]";
+  }
+
+  // (value, seq) as one unsigned 64 bit key, value in the high half with the
+  // sign bit flipped so that unsigned order equals signed order
+  uint64_t key() const {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(m_value) ^ 0x80000000u)
+            << 32) |
+           m_seq;
+  }
+
+private:
+  // seq first, so on little endian the layout already matches key()
+  // (except for the sign bit)
+  uint32_t m_seq{};
+  int32_t m_value{};
+};
+
+static_assert(sizeof(SequencedInteger) == 8);
+
+// number the elements with their current position
+inline void assign_sequence(SequencedInteger *data, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    data[i].set_seq(static_cast<uint32_t>(i));
+  }
+}
+
+inline void assign_sequence(std::vector<SequencedInteger> &arr) {
+  assign_sequence(arr.data(), arr.size());
+}
+
+// sorted and stable <=> key() strictly increasing (seq are unique), the scan
+// has no early exit and no data dependent branch so it can be vectorized
+inline bool is_stable_sorted(const SequencedInteger *data, size_t n) {
+  uint64_t bad = 0;
+  for (size_t i = 1; i < n; i++) {
+    bad |= static_cast<uint64_t>(data[i - 1].key() >= data[i].key());
+  }
+  return bad == 0;
+}
+
+inline bool is_stable_sorted(const std::vector<SequencedInteger> &arr) {
+  return is_stable_sorted(arr.data(), arr.size());
+}
@@ -0,0 +1,381 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#if defined(_MSC_VER) && !defined(__SIZEOF_INT128__)
+#include <intrin.h>
+#endif
+
+// workload generator for the sort benchmarks
+//
+// the output is split into fixed size chunks, chunk c is generated from a
+// xoshiro256** state derived from (seed, c) with splitmix64, so the result
+// only depends on the seed (never on the thread count) and chunks can be
+// generated in any order / in parallel. Inside a chunk LANES independent
+// xoshiro streams (separated by jump()) are advanced together, that loop has
+// no dependency between lanes and gets vectorized by the compiler.
+namespace workload {
+
+inline uint64_t splitmix64(uint64_t &x) {
+  uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+inline uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+// high 64 bits of a * b
+inline uint64_t mul_high(uint64_t a, uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+  return static_cast<uint64_t>((static_cast<unsigned __int128>(a) * b) >> 64);
+#else
+  return __umulh(a, b);
+#endif
+}
+
+class Xoshiro256 {
+public:
+  using result_type = uint64_t;
+
+  explicit Xoshiro256(uint64_t seed = 133337) {
+    for (auto &s : m_state) {
+      s = splitmix64(seed);
+    }
+  }
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return ~result_type{}; }
+
+  result_type operator()() {
+    uint64_t *s = m_state.data();
+    const uint64_t result = rotl(s[1] * 5, 7) * 9;
+    const uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
+  }
+
+  // equivalent to 2^128 calls of operator()
+  void jump() {
+    static constexpr uint64_t JUMP[] = {0x180ec6d33cfd0aba, 0xd5a61266f0c9392c,
+                                        0xa9582618e03fc9aa, 0x39abdc4529b1661c};
+    apply(JUMP);
+  }
+
+  // equivalent to 2^192 calls of operator()
+  void long_jump() {
+    static constexpr uint64_t LONG_JUMP[] = {
+        0x76e15d3efefdcbbf, 0xc5004e441c522fb3, 0x77710069854ee241,
+        0x39109bb02acbe635};
+    apply(LONG_JUMP);
+  }
+
+  const std::array<uint64_t, 4> &state() const { return m_state; }
+
+private:
+  void apply(const uint64_t (&table)[4]) {
+    std::array<uint64_t, 4> s{};
+    for (uint64_t word : table) {
+      for (int b = 0; b < 64; b++) {
+        if (word & (uint64_t{1} << b)) {
+          for (int i = 0; i < 4; i++) {
+            s[i] ^= m_state[i];
+          }
+        }
+        (*this)();
+      }
+    }
+    m_state = s;
+  }
+
+private:
+  std::array<uint64_t, 4> m_state{};
+};
+
+// LANES xoshiro256** streams stored as structure of arrays
+class XoshiroLanes {
+public:
+  static constexpr int LANES = 8;
+
+  explicit XoshiroLanes(Xoshiro256 base) {
+    for (int l = 0; l < LANES; l++) {
+      for (int i = 0; i < 4; i++) {
+        m_s[i][l] = base.state()[i];
+      }
+      base.jump();
+    }
+  }
+
+  // out[0..LANES)
+  void next(uint64_t *out) {
+    for (int l = 0; l < LANES; l++) {
+      const uint64_t result = rotl(m_s[1][l] * 5, 7) * 9;
+      const uint64_t t = m_s[1][l] << 17;
+      m_s[2][l] ^= m_s[0][l];
+      m_s[3][l] ^= m_s[1][l];
+      m_s[1][l] ^= m_s[2][l];
+      m_s[0][l] ^= m_s[3][l];
+      m_s[2][l] ^= t;
+      m_s[3][l] = rotl(m_s[3][l], 45);
+      out[l] = result;
+    }
+  }
+
+private:
+  alignas(64) uint64_t m_s[4][LANES]{};
+};
+
+static constexpr size_t CHUNK_SIZE = size_t{1} << 16;
+// below this size the generator does not bother starting threads
+static constexpr size_t PARALLEL_THRESHOLD = size_t{1} << 20;
+
+inline Xoshiro256 chunk_generator(uint64_t seed, size_t chunk) {
+  uint64_t x = seed ^ (0xd1b54a32d192ed03ull * (chunk + 1));
+  return Xoshiro256{splitmix64(x)};
+}
+
+// run func(chunk_index, first, count) over all chunks of [0, n)
+template <typename Func>
+void for_each_chunk(size_t n, unsigned threads, const Func &func) {
+  size_t chunks = (n + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  if (threads == 0) {
+    threads = n < PARALLEL_THRESHOLD
+                  ? 1
+                  : std::max(1u, std::thread::hardware_concurrency());
+  }
+  threads = static_cast<unsigned>(
+      std::min<size_t>(threads, std::max<size_t>(chunks, 1)));
+  auto run = [&](unsigned t) {
+    for (size_t c = t; c < chunks; c += threads) {
+      size_t first = c * CHUNK_SIZE;
+      func(c, first, std::min(CHUNK_SIZE, n - first));
+    }
+  };
+  if (threads <= 1) {
+    run(0);
+    return;
+  }
+  std::vector<std::thread> pool;
+  for (unsigned t = 1; t < threads; t++) {
+    pool.emplace_back(run, t);
+  }
+  run(0);
+  for (auto &th : pool) {
+    th.join();
+  }
+}
+
+// fill raw 64 bit words, map(word) is applied per element
+template <typename T, typename Map>
+void fill_raw(T *data, size_t n, uint64_t seed, unsigned threads,
+              const Map &map) {
+  for_each_chunk(n, threads, [&](size_t c, size_t first, size_t count) {
+    XoshiroLanes lanes{chunk_generator(seed, c)};
+    alignas(64) uint64_t block[XoshiroLanes::LANES];
+    T *out = data + first;
+    size_t i = 0;
+    for (; i + XoshiroLanes::LANES <= count; i += XoshiroLanes::LANES) {
+      lanes.next(block);
+      for (int l = 0; l < XoshiroLanes::LANES; l++) {
+        out[i + l] = map(block[l]);
+      }
+    }
+    if (i < count) {
+      lanes.next(block);
+      for (int l = 0; i < count; i++, l++) {
+        out[i] = map(block[l]);
+      }
+    }
+  });
+}
+
+// uniform integer in [lo, hi]
+template <typename T>
+void fill_uniform(T *data, size_t n, int64_t lo, int64_t hi,
+                  uint64_t seed = 133337, unsigned threads = 0) {
+  // subtracted unsigned, hi - lo overflows int64 for wide bounds
+  uint64_t range = static_cast<uint64_t>(hi) - static_cast<uint64_t>(lo) + 1;
+  if (range != 0 && range <= (uint64_t{1} << 32)) {
+    // lemire's multiply shift, fits in 64 bit and vectorizes
+    fill_raw(data, n, seed, threads, [=](uint64_t r) {
+      return static_cast<T>(lo +
+                            static_cast<int64_t>(((r >> 32) * range) >> 32));
+    });
+  } else {
+    fill_raw(data, n, seed, threads, [=](uint64_t r) {
+      uint64_t v = range == 0 ? r : mul_high(r, range);
+      // lo + v wraps to a value in [lo, hi], added unsigned as well
+      return static_cast<T>(
+          static_cast<int64_t>(static_cast<uint64_t>(lo) + v));
+    });
+  }
+}
+
+inline double to_unit(uint64_t r) {
+  // 53 bit mantissa in [0, 1)
+  return static_cast<double>(r >> 11) * 0x1.0p-53;
+}
+
+// normal(mean, stddev) with box-muller, rounded to T
+template <typename T>
+void fill_normal(T *data, size_t n, double mean, double stddev,
+                 uint64_t seed = 133337, unsigned threads = 0) {
+  for_each_chunk(n, threads, [&](size_t c, size_t first, size_t count) {
+    Xoshiro256 rng = chunk_generator(seed, c);
+    T *out = data + first;
+    for (size_t i = 0; i < count; i += 2) {
+      double u1 = 1.0 - to_unit(rng());
+      double u2 = to_unit(rng());
+      double r = std::sqrt(-2.0 * std::log(u1)) * stddev;
+      double theta = 6.283185307179586 * u2;
+      out[i] = static_cast<T>(std::llround(mean + r * std::cos(theta)));
+      if (i + 1 < count) {
+        out[i + 1] = static_cast<T>(std::llround(mean + r * std::sin(theta)));
+      }
+    }
+  });
+}
+
+// zipf distributed rank in [0, items), P(k) ~ 1 / (k + 1)^s, sampled with
+// rejection-inversion (Hormann & Derflinger), O(1) per element and no table
+class ZipfSampler {
+public:
+  ZipfSampler(uint64_t items, double s)
+      : m_items(static_cast<double>(items)), m_s(s) {
+    m_h_x1 = h_integral(1.5) - 1.0;
+    m_h_n = h_integral(m_items + 0.5);
+    m_cut = 2.0 - h_integral_inverse(h_integral(2.5) - h(2.0));
+  }
+
+  template <typename Rng> uint64_t operator()(Rng &rng) const {
+    while (true) {
+      double u = m_h_n + to_unit(rng()) * (m_h_x1 - m_h_n);
+      double x = h_integral_inverse(u);
+      double k = std::floor(x + 0.5);
+      k = std::min(std::max(k, 1.0), m_items);
+      if (k - x <= m_cut || u >= h_integral(k + 0.5) - h(k)) {
+        return static_cast<uint64_t>(k) - 1;
+      }
+    }
+  }
+
+private:
+  // log1p(x) / x
+  static double helper1(double x) {
+    return std::abs(x) > 1e-8 ? std::log1p(x) / x
+                              : 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
+  }
+
+  // expm1(x) / x
+  static double helper2(double x) {
+    return std::abs(x) > 1e-8 ? std::expm1(x) / x
+                              : 1.0 + x * 0.5 * (1.0 + x / 3.0 * (1.0 + 0.25 * x));
+  }
+
+  double h(double x) const { return std::exp(-m_s * std::log(x)); }
+
+  double h_integral(double x) const {
+    double log_x = std::log(x);
+    return helper2((1.0 - m_s) * log_x) * log_x;
+  }
+
+  double h_integral_inverse(double x) const {
+    double t = std::max(x * (1.0 - m_s), -1.0);
+    return std::exp(helper1(t) * x);
+  }
+
+private:
+  double m_items{};
+  double m_s{};
+  double m_h_x1{};
+  double m_h_n{};
+  double m_cut{};
+};
+
+template <typename T>
+void fill_zipf(T *data, size_t n, uint64_t items, double s,
+               uint64_t seed = 133337, unsigned threads = 0) {
+  ZipfSampler sampler{items, s};
+  for_each_chunk(n, threads, [&](size_t c, size_t first, size_t count) {
+    Xoshiro256 rng = chunk_generator(seed, c);
+    T *out = data + first;
+    for (size_t i = 0; i < count; i++) {
+      out[i] = static_cast<T>(sampler(rng));
+    }
+  });
+}
+
+// only `unique` distinct values, spread evenly over [0, unique * stride)
+template <typename T>
+void fill_few_unique(T *data, size_t n, uint64_t unique, int64_t stride = 1,
+                     uint64_t seed = 133337, unsigned threads = 0) {
+  fill_raw(data, n, seed, threads, [=](uint64_t r) {
+    return static_cast<T>(
+        static_cast<int64_t>(((r >> 32) * unique) >> 32) * stride);
+  });
+}
+
+// 0, 1, ..., n - 1 followed by `swaps` random transpositions
+template <typename T>
+void fill_sorted_swaps(T *data, size_t n, size_t swaps,
+                       uint64_t seed = 133337, unsigned threads = 0) {
+  for_each_chunk(n, threads, [&](size_t, size_t first, size_t count) {
+    for (size_t i = first; i < first + count; i++) {
+      data[i] = static_cast<T>(i);
+    }
+  });
+  if (n < 2) {
+    return;
+  }
+  // swaps are applied in order, so they stay sequential
+  Xoshiro256 rng{seed};
+  for (size_t k = 0; k < swaps; k++) {
+    size_t a = static_cast<size_t>(mul_high(rng(), n));
+    size_t b = static_cast<size_t>(mul_high(rng(), n));
+    std::swap(data[a], data[b]);
+  }
+}
+
+// std::vector helpers, the vector must already have its final size()
+template <typename T>
+void fill_uniform(std::vector<T> &arr, int64_t lo, int64_t hi,
+                  uint64_t seed = 133337, unsigned threads = 0) {
+  fill_uniform(arr.data(), arr.size(), lo, hi, seed, threads);
+}
+
+template <typename T>
+void fill_normal(std::vector<T> &arr, double mean, double stddev,
+                 uint64_t seed = 133337, unsigned threads = 0) {
+  fill_normal(arr.data(), arr.size(), mean, stddev, seed, threads);
+}
+
+template <typename T>
+void fill_zipf(std::vector<T> &arr, uint64_t items, double s,
+               uint64_t seed = 133337, unsigned threads = 0) {
+  fill_zipf(arr.data(), arr.size(), items, s, seed, threads);
+}
+
+template <typename T>
+void fill_few_unique(std::vector<T> &arr, uint64_t unique, int64_t stride = 1,
+                     uint64_t seed = 133337, unsigned threads = 0) {
+  fill_few_unique(arr.data(), arr.size(), unique, stride, seed, threads);
+}
+
+template <typename T>
+void fill_sorted_swaps(std::vector<T> &arr, size_t swaps,
+                       uint64_t seed = 133337, unsigned threads = 0) {
+  fill_sorted_swaps(arr.data(), arr.size(), swaps, seed, threads);
+}
+
+} // namespace workload
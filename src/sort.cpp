@@ -11,130 +11,11 @@
 #include <sstream>
 #include <stack>
 #include <type_traits>
-#include <unordered_map>
 
-// customize int (for stable sort demostration)
-class Integer {
-public:
-  Integer(){
-      // fmt::println("called default constructer of Integer");
-  };
-
-  Integer(int v) {
-    // fmt::println("called int constructer of Integer");
-    increase_refcount(v);
-    m_value = v;
-    m_id = s_count[v];
-  }
-  Integer(const Integer &v) {
-    // fmt::println("called copy constructer of Integer");
-    increase_refcount(v);
-    m_value = v;
-    m_id = v.m_id;
-  }
-
-  Integer(Integer &&v) {
-    // fmt::println("called move constructer of Integer");
-    m_value = v.m_value;
-    m_id = v.m_id;
-    v.m_value = 0;
-    v.m_id = INVALID_ID;
-  }
-
-  ~Integer() {
-    // fmt::println("called destructer of Integer");
-    if (m_id != INVALID_ID) {
-      decrease_refcount(m_value);
-    }
-  }
-
-  Integer &operator=(const Integer &v) {
-    // fmt::println("called copy assignment of Integer, curr: {}, target: {}",
-    //              *this, v);
-    increase_refcount(v);
-    if (m_id != INVALID_ID) {
-      decrease_refcount(m_value);
-    }
-    m_value = v.m_value;
-    m_id = v.m_id;
-    return *this;
-  }
-
-  Integer &operator=(Integer &&v) {
-    // fmt::println("called move assignment of Integer");
-    if (this == &v) {
-      // self assignment case, otherwise there will be problems
-      return *this;
-    }
-    if (m_id != INVALID_ID) {
-      decrease_refcount(m_value);
-    }
-    m_value = std::move(v.m_value);
-    m_id = std::move(v.m_id);
-    v.m_value = 0;
-    v.m_id = INVALID_ID;
-    return *this;
-  }
-
-  Integer &operator=(int v) {
-    // fmt::println("called int assignment of Integer");
-    increase_refcount(v);
-    if (m_id != INVALID_ID) {
-      decrease_refcount(m_value);
-    }
-    m_value = v;
-    m_id = s_count[m_value];
-    return *this;
-  }
+#include "misc/sequenced_integer.hpp"
 
-  operator int() const { return m_value; }
-
-  bool operator<(const Integer &i) const { return m_value < i.m_value; }
-
-  bool operator<=(const Integer &i) const { return m_value <= i.m_value; }
-
-  bool operator>(const Integer &i) const { return m_value > i.m_value; }
-
-  bool operator>=(const Integer &i) const { return m_value >= i.m_value; }
-
-  bool operator==(const Integer &i) const {
-    return m_value == i.m_value && m_id == i.m_id;
-  }
-
-  friend std::ostream &operator<<(std::ostream &os, const Integer &v) {
-    if (v.m_id != 1) {
-      os << fmt::format("{}[{}]", v.m_value, v.m_id - 1);
-    } else if (v.m_id == INVALID_ID) {
-      os << fmt::format("null", v.m_value);
-    } else {
-      os << v.m_value;
-    }
-    return os;
-  }
-
-  static void print_reference_count() { fmt::println("s_count: {}", s_count); }
-
-private:
-  static void decrease_refcount(int v) {
-    s_count[v]--;
-    if (s_count[v] == 0) {
-      s_count.erase(v);
-    }
-  }
-
-  static void increase_refcount(int v) {
-    if (s_count.find(v) == s_count.end()) {
-      s_count[v] = 0;
-    }
-    s_count[v]++;
-  }
-
-private:
-  static constexpr int INVALID_ID = 0;
-  int m_value{};
-  int m_id{INVALID_ID};
-  inline static std::unordered_map<int, int> s_count{};
-};
+// customize int (for stable sort demostration)
+using Integer = SequencedInteger;
 
 template <> struct fmt::formatter<Integer> : ostream_formatter {};
 
@@ -658,6 +539,7 @@ void random_vector(std::vector<Integer> &arr) {
   while (n-- > 0) {
     arr.emplace_back(uniform_dist(random));
   }
+  assign_sequence(arr);
 }
 
 // 将数组划分成两部分
@@ -686,7 +568,6 @@ int main() {
   //   fmt::println("after sort:\n{}", v);
   // }
   // v.clear();
-  // Integer::print_reference_count();
   // random_vector(v, arr_size);
   // Integer res = nth_element_nonrecursive(v, arr_size / 2);
   // fmt::println("{} th element: {}", arr_size / 2, res);
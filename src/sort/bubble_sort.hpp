@@ -1,7 +1,11 @@
 #pragma once
-#include <vector>
+#include "scratch_arena.hpp"
+
+#include <cassert>
+#include <cstddef>
 #include <functional>
-#include <stack>
+#include <utility>
+#include <vector>
 
 template <typename T, typename Comparator = std::less<T>>
 void bubble_sort(std::vector<T> &arr) {
@@ -79,11 +83,26 @@ void quick_sort(std::vector<T> &arr) {
   sort(0, arr.size() - 1);
 }
 
+// the smaller side is sorted first, so the stack holds at most one frame per
+// halving of the range
+inline size_t quick_sort_stack_frames(size_t n) {
+  size_t depth = 0;
+  while ((size_t{1} << depth) <= n) {
+    depth++;
+  }
+  return depth + 2;
+}
+
+inline size_t quick_sort_nonrecursive_scratch(size_t n) {
+  return scratch_arena::bytes<std::pair<int, int>>(
+      quick_sort_stack_frames(n));
+}
+
 template <typename T, typename Comparator = std::less<T>>
 void quick_sort_nonrecursive(std::vector<T> &arr) {
   auto comparator = Comparator();
 
-  std::function<int(int, int)> partition = [&](int l, int r) {
+  auto partition = [&](int l, int r) {
     T pivot = arr[l];
     while (l < r) {
       // find first value strictly smaller than pivot
@@ -100,16 +119,21 @@ void quick_sort_nonrecursive(std::vector<T> &arr) {
     return l;
   };
 
-  std::stack<std::pair<int, int>> s;
-  s.emplace(0, arr.size() - 1);
-  while (!s.empty()) {
-    auto [l, r] = s.top();
-    s.pop();
+  scratch_array<std::pair<int, int>> s(quick_sort_stack_frames(arr.size()));
+  size_t top = 0;
+  s[top++] = {0, int(arr.size()) - 1};
+  while (top > 0) {
+    auto [l, r] = s[--top];
     if (l >= r) {
       continue;
     }
     int pivot = partition(l, r);
-    s.emplace(l, pivot - 1);
-    s.emplace(pivot + 1, r);
+    std::pair<int, int> left{l, pivot - 1}, right{pivot + 1, r};
+    if (pivot - l < r - pivot) {
+      std::swap(left, right);
+    }
+    assert(top + 2 <= s.size());
+    s[top++] = left;
+    s[top++] = right;
   }
-}
\ No newline at end of file
+}
@@ -0,0 +1,266 @@
+#pragma once
+#include "scratch_arena.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+// lazy funnelsort (brodal & fagerberg), a cache oblivious merge sort
+//
+// the input is cut into k = n^(1/3) segments which are sorted recursively,
+// then merged by one k-funnel: a complete binary tree of 2-way mergers where
+// every edge has a buffer. a k-funnel is a top sqrt(k)-funnel over sqrt(k)
+// bottom sqrt(k)-funnels, the buffers between them hold k^(3/2) elements,
+// and both the nodes and the buffers are laid out in that recursive (van emde
+// boas) order, so whatever the cache size, some level of the recursion fits
+// and is merged without misses. a merger only fills its output buffer when
+// its parent found it empty (lazy), so every element moves O(log_M n) times
+// through the memory hierarchy instead of log2(n) times for a binary merge
+// sort. stable, uses one temporary buffer of n elements besides the buffers
+// of the funnels
+
+namespace funnel_sort_detail {
+
+// sorted directly, fits in any cache worth caring about
+constexpr size_t BASE_CASE = 512;
+// the small buffers near the leaves would make the fill recursion dominate
+constexpr size_t MIN_BUFFER = 64;
+
+template <typename T> struct stream {
+  T *data{};
+  size_t head{};
+  size_t tail{};
+  size_t capacity{};
+  // no more elements will arrive
+  bool exhausted{};
+
+  bool empty() const { return head == tail; }
+};
+
+// the number of leaves and the height of the funnel over k segments
+inline std::pair<size_t, size_t> shape(size_t k) {
+  size_t leaves = 1, height = 0;
+  while (leaves < k) {
+    leaves <<= 1;
+    height++;
+  }
+  return {leaves, height};
+}
+
+inline size_t buffer_size(size_t height) {
+  double k = static_cast<double>(size_t{1} << height);
+  return std::max(MIN_BUFFER,
+                  static_cast<size_t>(std::ceil(std::pow(k, 1.5))));
+}
+
+// van emde boas order of the internal subtree of the given height under
+// root, and the buffer size of every edge between a top and a bottom tree
+inline void layout(size_t root, size_t height, const size_t *below,
+                   size_t *capacity, size_t *order, size_t &ordered) {
+  if (height == 0) {
+    return;
+  }
+  if (height == 1) {
+    order[ordered++] = root;
+    return;
+  }
+  size_t top = height / 2;
+  size_t bottom = height - top;
+  layout(root, top, below, capacity, order, ordered);
+  size_t size = buffer_size(height);
+  for (size_t j = 0; j < (size_t{1} << top); j++) {
+    size_t child = (root << top) + j;
+    capacity[child] = std::min(size, below[child]);
+    layout(child, bottom, below, capacity, order, ordered);
+  }
+}
+
+// the buffer elements of a funnel of the given height, at most
+inline size_t buffer_bound(size_t height) {
+  if (height <= 1) {
+    return 0;
+  }
+  size_t top = height / 2;
+  size_t bottom = height - top;
+  return buffer_bound(top) +
+         (size_t{1} << top) * (buffer_size(height) + buffer_bound(bottom));
+}
+
+// refill the (empty) output buffer of v from its children
+template <typename T, typename Comparator>
+void fill(stream<T> *streams, size_t v, Comparator &comparator) {
+  stream<T> &out = streams[v];
+  stream<T> &l = streams[2 * v];
+  stream<T> &r = streams[2 * v + 1];
+  out.head = 0;
+  size_t t = 0;
+  while (t < out.capacity) {
+    if (l.empty() && !l.exhausted) {
+      fill(streams, 2 * v, comparator);
+    }
+    if (r.empty() && !r.exhausted) {
+      fill(streams, 2 * v + 1, comparator);
+    }
+    if (l.empty() || r.empty()) {
+      stream<T> &s = l.empty() ? r : l;
+      if (s.empty()) {
+        out.exhausted = true;
+        break;
+      }
+      size_t n = std::min(s.tail - s.head, out.capacity - t);
+      std::move(s.data + s.head, s.data + s.head + n, out.data + t);
+      s.head += n;
+      t += n;
+      continue;
+    }
+    // ties go to the left child, which holds the earlier segments
+    while (t < out.capacity && l.head < l.tail && r.head < r.tail) {
+      if (comparator(r.data[r.head], l.data[l.head])) {
+        out.data[t++] = std::move(r.data[r.head++]);
+      } else {
+        out.data[t++] = std::move(l.data[l.head++]);
+      }
+    }
+  }
+  out.tail = t;
+}
+
+// merge the k sorted segments into out with one k-funnel
+template <typename T, typename Comparator>
+void funnel_merge(const std::pair<T *, size_t> *segments, size_t k, T *out,
+                  Comparator &comparator) {
+  auto [leaves, height] = shape(k);
+  if (leaves == 1) {
+    std::move(segments[0].first, segments[0].first + segments[0].second, out);
+    return;
+  }
+  // heap order, internal nodes [1, leaves), leaves [leaves, 2 leaves)
+  scratch_array<size_t> below(2 * leaves);
+  for (size_t i = 0; i < 2 * leaves; i++) {
+    below[i] = i >= leaves && i - leaves < k ? segments[i - leaves].second : 0;
+  }
+  for (size_t i = leaves; i-- > 1;) {
+    below[i] = below[2 * i] + below[2 * i + 1];
+  }
+  // the root writes to out, it has no buffer
+  scratch_array<size_t> capacity(leaves);
+  std::fill(capacity.data(), capacity.data() + leaves, 0);
+  scratch_array<size_t> order(leaves);
+  size_t ordered = 0;
+  layout(1, height, below.data(), capacity.data(), order.data(), ordered);
+  size_t total = 0;
+  for (size_t i = 0; i < ordered; i++) {
+    total += capacity[order[i]];
+  }
+  scratch_array<stream<T>> streams(2 * leaves);
+  scratch_array<T> buffers(total);
+  T *next = buffers.data();
+  for (size_t i = 0; i < ordered; i++) {
+    size_t v = order[i];
+    streams[v] = {next, 0, 0, capacity[v], false};
+    next += capacity[v];
+  }
+  for (size_t i = 0; i < leaves; i++) {
+    size_t n = i < k ? segments[i].second : 0;
+    streams[leaves + i] = {i < k ? segments[i].first : nullptr, 0, n, n,
+                           true};
+  }
+  streams[1] = {out, 0, 0, below[1], false};
+  fill(streams.data(), 1, comparator);
+}
+
+// stable base case, ping pong merge sort of runs of 16 through tmp
+template <typename T, typename Comparator>
+void small_sort(T *data, size_t n, T *tmp, Comparator &comparator) {
+  constexpr size_t RUN = 16;
+  for (size_t first = 0; first < n; first += RUN) {
+    T *run = data + first;
+    size_t len = std::min(RUN, n - first);
+    for (size_t i = 1; i < len; i++) {
+      T key = std::move(run[i]);
+      size_t j = i;
+      for (; j > 0 && comparator(key, run[j - 1]); j--) {
+        run[j] = std::move(run[j - 1]);
+      }
+      run[j] = std::move(key);
+    }
+  }
+  T *from = data, *to = tmp;
+  for (size_t width = RUN; width < n; width *= 2) {
+    for (size_t first = 0; first < n; first += 2 * width) {
+      T *mid = from + std::min(first + width, n);
+      T *last = from + std::min(first + 2 * width, n);
+      std::merge(std::make_move_iterator(from + first),
+                 std::make_move_iterator(mid), std::make_move_iterator(mid),
+                 std::make_move_iterator(last), to + first, comparator);
+    }
+    std::swap(from, to);
+  }
+  if (from != data) {
+    std::move(from, from + n, data);
+  }
+}
+
+inline size_t segment_count(size_t n) {
+  return static_cast<size_t>(std::ceil(std::cbrt(static_cast<double>(n))));
+}
+
+template <typename T, typename Comparator>
+void funnel_sort(T *data, size_t n, T *tmp, Comparator &comparator) {
+  if (n <= BASE_CASE) {
+    small_sort(data, n, tmp, comparator);
+    return;
+  }
+  size_t k = segment_count(n);
+  size_t segment = (n + k - 1) / k;
+  scratch_array<std::pair<T *, size_t>> segments(k);
+  size_t count = 0;
+  for (size_t first = 0; first < n; first += segment) {
+    size_t len = std::min(segment, n - first);
+    // the segment borrows the same part of tmp
+    funnel_sort(data + first, len, tmp + first, comparator);
+    segments[count++] = {data + first, len};
+  }
+  funnel_merge(segments.data(), count, tmp, comparator);
+  std::move(tmp, tmp + n, data);
+}
+
+// arena bytes funnel_sort takes past tmp
+template <typename T> size_t scratch(size_t n) {
+  if (n <= BASE_CASE) {
+    return 0;
+  }
+  size_t k = segment_count(n);
+  size_t segment = (n + k - 1) / k;
+  auto [leaves, height] = shape((n + segment - 1) / segment);
+  size_t merge = scratch_arena::bytes<size_t>(2 * leaves) +
+                 2 * scratch_arena::bytes<size_t>(leaves) +
+                 scratch_arena::bytes<stream<T>>(2 * leaves) +
+                 scratch_arena::bytes<T>(buffer_bound(height));
+  // the last segment may be shorter
+  size_t last = n - (n - 1) / segment * segment;
+  return scratch_arena::bytes<std::pair<T *, size_t>>(k) +
+         std::max({scratch<T>(segment), scratch<T>(last), merge});
+}
+
+} // namespace funnel_sort_detail
+
+template <typename T> size_t funnel_sort_scratch(size_t n) {
+  return scratch_arena::bytes<T>(n) + funnel_sort_detail::scratch<T>(n);
+}
+
+template <typename T, typename Comparator = std::less<T>>
+void funnel_sort_range(T *first, T *last,
+                       Comparator comparator = Comparator()) {
+  scratch_array<T> tmp(last - first);
+  funnel_sort_detail::funnel_sort(first, tmp.size(), tmp.data(), comparator);
+}
+
+template <typename T, typename Comparator = std::less<T>>
+void funnel_sort(std::vector<T> &arr) {
+  funnel_sort_range(arr.data(), arr.data() + arr.size(), Comparator());
+}
@@ -1,86 +1,116 @@
 #pragma once
-#include <vector>
+#include "scratch_arena.hpp"
+
+#include <cassert>
+#include <cstddef>
 #include <functional>
-#include <stack>
+#include <vector>
 
-template <typename T, typename Comparator = std::less_equal<T>>
-void merge_sort(std::vector<T> &arr) {
-  auto comparator = Comparator();
-  // 存储的是当前 heap 的大小
-  std::vector<T> temp(arr.size());
+namespace merge_sort_detail {
 
-  std::function<void(int, int)> merge_sort = [&](int l, int r) {
-    if (l == r) {
-      return;
-    }
-    int m = (l + r) / 2;
-    merge_sort(l, m);
-    merge_sort(m + 1, r);
-    // merge two list
-    int t0 = l;
-    int t1 = m + 1;
-    int i = l;
-    while (t0 <= m && t1 <= r) {
-      if (comparator(arr[t0], arr[t1])) {
-        temp[i++] = arr[t0++];
-      } else {
-        temp[i++] = arr[t1++];
-      }
-    }
-    while (t0 <= m) {
+template <typename T, typename Comparator>
+void merge(std::vector<T> &arr, T *temp, int l, int m, int r,
+           Comparator &comparator) {
+  // merge two list
+  int t0 = l;
+  int t1 = m + 1;
+  int i = l;
+  while (t0 <= m && t1 <= r) {
+    if (comparator(arr[t0], arr[t1])) {
       temp[i++] = arr[t0++];
-    }
-    while (t1 <= r) {
+    } else {
       temp[i++] = arr[t1++];
     }
-    for (int i = l; i <= r; i++) {
-      arr[i] = temp[i];
-    }
-  };
-  merge_sort(0, arr.size() - 1);
+  }
+  while (t0 <= m) {
+    temp[i++] = arr[t0++];
+  }
+  while (t1 <= r) {
+    temp[i++] = arr[t1++];
+  }
+  for (int i = l; i <= r; i++) {
+    arr[i] = temp[i];
+  }
+}
+
+template <typename T, typename Comparator>
+void merge_sort(std::vector<T> &arr, T *temp, int l, int r,
+                Comparator &comparator) {
+  if (l == r) {
+    return;
+  }
+  int m = (l + r) / 2;
+  merge_sort(arr, temp, l, m, comparator);
+  merge_sort(arr, temp, m + 1, r, comparator);
+  merge(arr, temp, l, m, r, comparator);
+}
+
+struct frame {
+  int l, r;
+  bool visited;
+};
+
+// the explicit stack never holds more than 2 frames per level plus the root
+inline size_t stack_frames(size_t n) {
+  size_t depth = 0;
+  while ((size_t{1} << depth) < n) {
+    depth++;
+  }
+  return 2 * depth + 3;
+}
+
+} // namespace merge_sort_detail
+
+// scratch bytes the sorts below take for n elements
+template <typename T> size_t merge_sort_scratch(size_t n) {
+  return scratch_arena::bytes<T>(n);
+}
+
+template <typename T> size_t merge_sort_nonrecursive_scratch(size_t n) {
+  return scratch_arena::bytes<T>(n) +
+         scratch_arena::bytes<merge_sort_detail::frame>(
+             merge_sort_detail::stack_frames(n));
+}
+
+template <typename T, typename Comparator = std::less_equal<T>>
+void merge_sort(std::vector<T> &arr) {
+  if (arr.empty()) {
+    return;
+  }
+  auto comparator = Comparator();
+  // 存储的是当前 heap 的大小
+  scratch_array<T> temp(arr.size());
+  merge_sort_detail::merge_sort(arr, temp.data(), 0, int(arr.size()) - 1,
+                                comparator);
 }
 
 template <typename T, typename Comparator = std::less_equal<T>>
 void merge_sort_nonrecursive(std::vector<T> &arr) {
+  if (arr.empty()) {
+    return;
+  }
+  using merge_sort_detail::frame;
   auto comparator = Comparator();
   // 存储的是当前 heap 的大小
-  std::vector<T> temp(arr.size());
+  scratch_array<T> temp(arr.size());
 
-  std::stack<std::tuple<int, int, bool>> s;
-  s.emplace(0, arr.size() - 1, false);
-  while (!s.empty()) {
-    auto [l, r, visited] = s.top();
-    s.pop();
+  scratch_array<frame> s(merge_sort_detail::stack_frames(arr.size()));
+  size_t top = 0;
+  s[top++] = {0, int(arr.size()) - 1, false};
+  while (top > 0) {
+    auto [l, r, visited] = s[--top];
     if (l == r) {
       continue;
     }
     int m = (l + r) / 2;
     if (!visited) {
+      assert(top + 3 <= s.size());
       // here controls the recursive order
-      s.emplace(l, r, true);
-      s.emplace(m + 1, r, false);
-      s.emplace(l, m, false);
+      s[top++] = {l, r, true};
+      s[top++] = {m + 1, r, false};
+      s[top++] = {l, m, false};
       continue;
     }
-    // merge two list
-    int t0 = l;
-    int t1 = m + 1;
-    int i = l;
-    while (t0 <= m && t1 <= r) {
-      if (comparator(arr[t0], arr[t1])) {
-        temp[i++] = arr[t0++];
-      } else {
-        temp[i++] = arr[t1++];
-      }
-    }
-    while (t0 <= m) {
-      temp[i++] = arr[t0++];
-    }
-    while (t1 <= r) {
-      temp[i++] = arr[t1++];
-    }
-    for (int i = l; i <= r; i++) {
-      arr[i] = temp[i];
-    }
+    merge_sort_detail::merge(arr, temp.data(), l, m, r, comparator);
   }
-}
\ No newline at end of file
+}
@@ -1,33 +1,49 @@
 #pragma once
-#include <array>
+#include "scratch_arena.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
 #include <vector>
 
+template <typename Integer> size_t radix_sort_scratch(size_t n) {
+  return scratch_arena::bytes<Integer>(n);
+}
+
 // only support unsigned int
+//
+// lsd over the 4 bytes, the digits of all passes are counted in one read of
+// the input, then every pass scatters into one temporary array and the two
+// arrays swap roles. a pass where all elements share the digit moves nothing
+// and is skipped
 template <typename Integer> void radix_sort(std::vector<Integer> &arr) {
-  thread_local std::array<std::vector<Integer>, 16> radices;
-  for (int i = 0; i < 8; i++) {
-    int prev = -1;
-    int bits = i << 2;
-    bool same_radix = true;
-    for (Integer v : arr) {
-      int radix = (v >> bits) & 0xf;
-      radices[radix].emplace_back(v);
-      if (prev != -1 && radix != prev) {
-        same_radix = false;
-      }
-      prev = radix;
+  size_t n = arr.size();
+  if (n < 2) {
+    return;
+  }
+  size_t count[4][257] = {};
+  for (Integer v : arr) {
+    for (int i = 0; i < 4; i++) {
+      count[i][((v >> (i << 3)) & 0xff) + 1]++;
     }
-    // fmt::println("split phase: {}", radices);
-    int k = 0;
-    for (auto &r : radices) {
-      for (Integer v : r) {
-        arr[k++] = v;
-      }
-      r.clear();
+  }
+  scratch_array<Integer> temp(n);
+  Integer *from = arr.data();
+  Integer *to = temp.data();
+  for (int i = 0; i < 4; i++) {
+    int bits = i << 3;
+    if (count[i][((from[0] >> bits) & 0xff) + 1] == n) {
+      continue;
+    }
+    for (int radix = 0; radix < 256; radix++) {
+      count[i][radix + 1] += count[i][radix];
     }
-    // fmt::println("collect phase: {}", arr);
-    if (same_radix) {
-      break;
+    for (size_t k = 0; k < n; k++) {
+      to[count[i][(from[k] >> bits) & 0xff]++] = from[k];
     }
+    std::swap(from, to);
+  }
+  if (from != arr.data()) {
+    std::copy(from, from + n, arr.data());
   }
-}
\ No newline at end of file
+}
@@ -0,0 +1,171 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+
+// scratch memory of the sorts
+//
+// every sort that needs temporary memory takes it through scratch_array,
+// which allocates from the arena bound to the calling thread by a
+// scratch_scope, or from the heap (one allocation per array) when there is
+// none. <sort>_scratch<T>(n) tells how many arena bytes a sort of n elements
+// needs at most, so request path code can do
+//
+//   thread_local scratch_buffer<> buffer;
+//   scratch_scope scope{buffer.reserve(merge_sort_scratch<T>(n))};
+//   merge_sort(v);
+//
+// and never touch the global heap once the buffer is large enough
+
+// bump allocator over a caller provided buffer, memory is only given back
+// by rewinding to an earlier mark (scratch_array does that in lifo order)
+class scratch_arena {
+public:
+  scratch_arena() = default;
+
+  scratch_arena(void *buffer, size_t bytes)
+      : m_data(static_cast<std::byte *>(buffer)), m_capacity(bytes) {}
+
+  // uninitialized room for n T, std::bad_alloc if the buffer is too small
+  template <typename T> T *allocate(size_t n) {
+    auto base = reinterpret_cast<uintptr_t>(m_data);
+    size_t offset =
+        (base + m_used + alignof(T) - 1) / alignof(T) * alignof(T) - base;
+    if (offset + n * sizeof(T) > m_capacity) {
+      throw std::bad_alloc();
+    }
+    m_used = offset + n * sizeof(T);
+    m_peak = std::max(m_peak, m_used);
+    return reinterpret_cast<T *>(m_data + offset);
+  }
+
+  size_t mark() const { return m_used; }
+
+  void rewind(size_t mark) { m_used = mark; }
+
+  size_t used() const { return m_used; }
+
+  size_t capacity() const { return m_capacity; }
+
+  // the most bytes in use at once
+  size_t peak() const { return m_peak; }
+
+  // bytes allocate<T>(n) takes at most, alignment included
+  template <typename T> static constexpr size_t bytes(size_t n) {
+    return n * sizeof(T) + alignof(T) - 1;
+  }
+
+private:
+  std::byte *m_data{};
+  size_t m_capacity{};
+  size_t m_used{};
+  size_t m_peak{};
+};
+
+// the arena of the calling thread, nullptr for the heap
+inline scratch_arena *&current_scratch() {
+  thread_local scratch_arena *arena = nullptr;
+  return arena;
+}
+
+// bind an arena to the calling thread for the lifetime of the scope
+class scratch_scope {
+public:
+  explicit scratch_scope(scratch_arena &arena)
+      : m_previous(current_scratch()) {
+    current_scratch() = &arena;
+  }
+
+  ~scratch_scope() { current_scratch() = m_previous; }
+
+  scratch_scope(const scratch_scope &) = delete;
+  scratch_scope &operator=(const scratch_scope &) = delete;
+
+private:
+  scratch_arena *m_previous{};
+};
+
+// n default initialized T from the current arena (or the heap), destroyed
+// and given back at the end of the scope
+template <typename T> class scratch_array {
+public:
+  explicit scratch_array(size_t n) : m_size(n) {
+    m_arena = current_scratch();
+    if (m_arena) {
+      m_mark = m_arena->mark();
+      m_data = m_arena->template allocate<T>(n);
+    } else {
+      m_data = std::allocator<T>().allocate(n);
+    }
+    std::uninitialized_default_construct_n(m_data, n);
+  }
+
+  ~scratch_array() {
+    std::destroy_n(m_data, m_size);
+    if (m_arena) {
+      m_arena->rewind(m_mark);
+    } else {
+      std::allocator<T>().deallocate(m_data, m_size);
+    }
+  }
+
+  scratch_array(const scratch_array &) = delete;
+  scratch_array &operator=(const scratch_array &) = delete;
+
+  T *data() const { return m_data; }
+
+  size_t size() const { return m_size; }
+
+  T &operator[](size_t i) const { return m_data[i]; }
+
+private:
+  T *m_data{};
+  size_t m_size{};
+  scratch_arena *m_arena{};
+  size_t m_mark{};
+};
+
+// memory for an arena from an allocator, kept between sorts: it only grows
+// (to the largest reserve) until release()
+template <typename Allocator = std::allocator<std::byte>>
+class scratch_buffer {
+public:
+  explicit scratch_buffer(const Allocator &allocator = Allocator())
+      : m_allocator(allocator) {}
+
+  ~scratch_buffer() { release(); }
+
+  scratch_buffer(const scratch_buffer &) = delete;
+  scratch_buffer &operator=(const scratch_buffer &) = delete;
+
+  // an empty arena over at least `bytes` bytes
+  scratch_arena &reserve(size_t bytes) {
+    if (bytes > m_capacity) {
+      release();
+      m_data = std::allocator_traits<Allocator>::allocate(m_allocator, bytes);
+      m_capacity = bytes;
+    }
+    m_arena = scratch_arena{m_data, m_capacity};
+    return m_arena;
+  }
+
+  void release() {
+    if (m_data) {
+      std::allocator_traits<Allocator>::deallocate(m_allocator, m_data,
+                                                   m_capacity);
+      m_data = nullptr;
+      m_capacity = 0;
+    }
+    m_arena = {};
+  }
+
+  size_t capacity() const { return m_capacity; }
+
+private:
+  Allocator m_allocator;
+  std::byte *m_data{};
+  size_t m_capacity{};
+  scratch_arena m_arena{};
+};
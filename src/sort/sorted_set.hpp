@@ -0,0 +1,561 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// set operations on sorted arrays of uint32_t / uint64_t
+//
+//  - unique:           drop repeated values (out may be the input itself)
+//  - set_intersection: block against block, every element of an a block is
+//                      compared to all rotations of a b block at once. when
+//                      one side is GALLOP_RATIO times longer, its elements
+//                      are skipped by galloping (exponential search) instead
+//  - set_union:        bitonic merge network on two registers, equal
+//                      neighbours of the merged stream are dropped
+//  - set_difference:   like set_intersection, keeps the a elements which
+//                      matched nothing
+//  - merge:            like set_union, keeps every element
+//
+// set_intersection / set_union / set_difference expect sets (strictly
+// increasing, e.g. the output of unique), merge takes any sorted arrays.
+// every function returns the size of the result, with out == nullptr it only
+// counts and writes nothing. out must not overlap the inputs (except for
+// unique) and must hold the largest possible result (n, min(na, nb), na + nb,
+// na and na + nb)
+//
+// the kernels use avx2 on x86 when the cpu has it (checked at run time, no
+// compiler flag needed), the scalar loops otherwise
+
+#if (defined(__x86_64__) || defined(__i386__)) &&                              \
+    (defined(__GNUC__) || defined(__clang__))
+#define SORTED_SET_AVX2 1
+#include <immintrin.h>
+#define SORTED_SET_TARGET __attribute__((target("avx2,popcnt")))
+#endif
+
+namespace sorted_set {
+
+// size ratio from which set_intersection gallops through the longer input
+constexpr size_t GALLOP_RATIO = 32;
+
+namespace detail {
+
+template <typename T>
+constexpr bool supported_v =
+    std::is_same_v<T, uint32_t> || std::is_same_v<T, uint64_t>;
+
+// ---------------------------------------------------------------- scalar
+
+template <typename T>
+size_t unique_scalar(const T *in, size_t n, T *out, size_t i, size_t k,
+                     T last) {
+  for (; i < n; i++) {
+    if (in[i] != last) {
+      last = in[i];
+      if (out) {
+        out[k] = last;
+      }
+      k++;
+    }
+  }
+  return k;
+}
+
+// first position in [lo, n) with b[pos] >= v, probing lo + 1, lo + 3, ...
+template <typename T>
+size_t gallop(const T *b, size_t lo, size_t n, T v) {
+  size_t step = 1;
+  size_t hi = lo;
+  while (hi < n && b[hi] < v) {
+    lo = hi + 1;
+    hi += step;
+    step <<= 1;
+  }
+  return std::lower_bound(b + lo, b + std::min(hi, n), v) - b;
+}
+
+// a is the (much) shorter one
+template <typename T>
+size_t intersection_gallop(const T *a, size_t na, const T *b, size_t nb,
+                           T *out) {
+  size_t k = 0;
+  for (size_t i = 0, j = 0; i < na && j < nb; i++) {
+    j = gallop(b, j, nb, a[i]);
+    if (j < nb && b[j] == a[i]) {
+      if (out) {
+        out[k] = a[i];
+      }
+      k++;
+      j++;
+    }
+  }
+  return k;
+}
+
+template <typename T>
+size_t intersection_scalar(const T *a, size_t na, const T *b, size_t nb,
+                           T *out, size_t i, size_t j, size_t k) {
+  while (i < na && j < nb) {
+    if (a[i] < b[j]) {
+      i++;
+    } else if (b[j] < a[i]) {
+      j++;
+    } else {
+      if (out) {
+        out[k] = a[i];
+      }
+      k++;
+      i++;
+      j++;
+    }
+  }
+  return k;
+}
+
+// an element of a among the first 32 from i is skipped when its bit in skip
+// is set (it already matched an earlier b element)
+template <typename T>
+size_t difference_scalar(const T *a, size_t na, const T *b, size_t nb,
+                         T *out, size_t i, size_t j, size_t k,
+                         unsigned skip = 0) {
+  for (size_t first = i; i < na; i++) {
+    if (i - first < 32 && (skip >> (i - first) & 1)) {
+      continue;
+    }
+    while (j < nb && b[j] < a[i]) {
+      j++;
+    }
+    if (j < nb && b[j] == a[i]) {
+      j++;
+      continue;
+    }
+    if (out) {
+      out[k] = a[i];
+    }
+    k++;
+  }
+  return k;
+}
+
+// merge of up to three sorted inputs, Dedupe drops a value equal to the last
+// one written (has_last tells whether there is one)
+template <bool Dedupe, typename T>
+size_t merge_scalar(const T *h, size_t nh, const T *a, size_t na, const T *b,
+                    size_t nb, T *out, size_t k, bool has_last = false,
+                    T last = 0) {
+  size_t x = 0, i = 0, j = 0;
+  while (x < nh || i < na || j < nb) {
+    T v;
+    if (x < nh && (i == na || h[x] <= a[i]) && (j == nb || h[x] <= b[j])) {
+      v = h[x++];
+    } else if (i < na && (j == nb || a[i] <= b[j])) {
+      v = a[i++];
+    } else {
+      v = b[j++];
+    }
+    if constexpr (Dedupe) {
+      if (has_last && v == last) {
+        continue;
+      }
+      has_last = true;
+      last = v;
+    }
+    if (out) {
+      out[k] = v;
+    }
+    k++;
+  }
+  return k;
+}
+
+#ifdef SORTED_SET_AVX2
+
+// ------------------------------------------------------------------ avx2
+
+inline bool has_avx2() {
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+  return avx2;
+}
+
+// permutevar8x32 indices which move the lanes selected by a mask to the front
+struct compress_table {
+  alignas(32) uint32_t lanes32[256][8]{};
+  alignas(32) uint32_t lanes64[16][8]{};
+};
+
+constexpr compress_table make_compress_table() {
+  compress_table t{};
+  for (unsigned m = 0; m < 256; m++) {
+    unsigned k = 0;
+    for (unsigned l = 0; l < 8; l++) {
+      if (m >> l & 1) {
+        t.lanes32[m][k++] = l;
+      }
+    }
+  }
+  for (unsigned m = 0; m < 16; m++) {
+    unsigned k = 0;
+    for (unsigned l = 0; l < 4; l++) {
+      if (m >> l & 1) {
+        t.lanes64[m][k++] = 2 * l;
+        t.lanes64[m][k++] = 2 * l + 1;
+      }
+    }
+  }
+  return t;
+}
+
+inline constexpr compress_table COMPRESS = make_compress_table();
+
+template <typename T> struct lanes;
+
+template <> struct lanes<uint32_t> {
+  static constexpr size_t N = 8;
+  static constexpr unsigned FULL = 0xff;
+
+  SORTED_SET_TARGET static __m256i load(const uint32_t *p) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+  }
+  SORTED_SET_TARGET static void store(uint32_t *p, __m256i v) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), v);
+  }
+  SORTED_SET_TARGET static unsigned eq(__m256i a, __m256i b) {
+    return static_cast<unsigned>(
+        _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(a, b))));
+  }
+  SORTED_SET_TARGET static __m256i rotate(__m256i v) {
+    return _mm256_permutevar8x32_epi32(
+        v, _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0));
+  }
+  SORTED_SET_TARGET static __m256i compress(__m256i v, unsigned mask) {
+    return _mm256_permutevar8x32_epi32(
+        v, _mm256_load_si256(
+               reinterpret_cast<const __m256i *>(COMPRESS.lanes32[mask])));
+  }
+  // [last, v0, .., v6]
+  SORTED_SET_TARGET static __m256i shift_in(__m256i v, uint32_t last) {
+    __m256i r = _mm256_permutevar8x32_epi32(
+        v, _mm256_setr_epi32(7, 0, 1, 2, 3, 4, 5, 6));
+    return _mm256_blend_epi32(r, _mm256_set1_epi32(static_cast<int>(last)),
+                              0x01);
+  }
+  SORTED_SET_TARGET static uint32_t back(__m256i v) {
+    return static_cast<uint32_t>(_mm256_extract_epi32(v, 7));
+  }
+  SORTED_SET_TARGET static __m256i min(__m256i a, __m256i b) {
+    return _mm256_min_epu32(a, b);
+  }
+  SORTED_SET_TARGET static __m256i max(__m256i a, __m256i b) {
+    return _mm256_max_epu32(a, b);
+  }
+  SORTED_SET_TARGET static __m256i reverse(__m256i v) {
+    return _mm256_permutevar8x32_epi32(
+        v, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+  }
+  // sort a bitonic register: compare exchange lanes 4, 2 and 1 apart
+  SORTED_SET_TARGET static __m256i clean(__m256i v) {
+    __m256i p = _mm256_permutevar8x32_epi32(
+        v, _mm256_setr_epi32(4, 5, 6, 7, 0, 1, 2, 3));
+    v = _mm256_blend_epi32(min(v, p), max(v, p), 0xf0);
+    p = _mm256_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+    v = _mm256_blend_epi32(min(v, p), max(v, p), 0xcc);
+    p = _mm256_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1));
+    return _mm256_blend_epi32(min(v, p), max(v, p), 0xaa);
+  }
+};
+
+template <> struct lanes<uint64_t> {
+  static constexpr size_t N = 4;
+  static constexpr unsigned FULL = 0xf;
+
+  SORTED_SET_TARGET static __m256i load(const uint64_t *p) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+  }
+  SORTED_SET_TARGET static void store(uint64_t *p, __m256i v) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), v);
+  }
+  SORTED_SET_TARGET static unsigned eq(__m256i a, __m256i b) {
+    return static_cast<unsigned>(
+        _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(a, b))));
+  }
+  SORTED_SET_TARGET static __m256i rotate(__m256i v) {
+    return _mm256_permute4x64_epi64(v, _MM_SHUFFLE(0, 3, 2, 1));
+  }
+  SORTED_SET_TARGET static __m256i compress(__m256i v, unsigned mask) {
+    return _mm256_permutevar8x32_epi32(
+        v, _mm256_load_si256(
+               reinterpret_cast<const __m256i *>(COMPRESS.lanes64[mask])));
+  }
+  SORTED_SET_TARGET static __m256i shift_in(__m256i v, uint64_t last) {
+    __m256i r = _mm256_permute4x64_epi64(v, _MM_SHUFFLE(2, 1, 0, 3));
+    return _mm256_blend_epi32(
+        r, _mm256_set1_epi64x(static_cast<long long>(last)), 0x03);
+  }
+  SORTED_SET_TARGET static uint64_t back(__m256i v) {
+    return static_cast<uint64_t>(_mm256_extract_epi64(v, 3));
+  }
+  // no unsigned 64 bit min / max in avx2, compare with the sign bit flipped
+  SORTED_SET_TARGET static __m256i greater(__m256i a, __m256i b) {
+    __m256i sign = _mm256_set1_epi64x(INT64_MIN);
+    return _mm256_cmpgt_epi64(_mm256_xor_si256(a, sign),
+                              _mm256_xor_si256(b, sign));
+  }
+  SORTED_SET_TARGET static __m256i min(__m256i a, __m256i b) {
+    return _mm256_blendv_epi8(a, b, greater(a, b));
+  }
+  SORTED_SET_TARGET static __m256i max(__m256i a, __m256i b) {
+    return _mm256_blendv_epi8(b, a, greater(a, b));
+  }
+  SORTED_SET_TARGET static __m256i reverse(__m256i v) {
+    return _mm256_permute4x64_epi64(v, _MM_SHUFFLE(0, 1, 2, 3));
+  }
+  SORTED_SET_TARGET static __m256i clean(__m256i v) {
+    __m256i p = _mm256_permute4x64_epi64(v, _MM_SHUFFLE(1, 0, 3, 2));
+    v = _mm256_blend_epi32(min(v, p), max(v, p), 0xf0);
+    p = _mm256_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+    return _mm256_blend_epi32(min(v, p), max(v, p), 0xcc);
+  }
+};
+
+// write the masked lanes of v at out + k, a full store when the N lanes fit
+// below limit, returns the new k
+template <typename T>
+SORTED_SET_TARGET size_t store_compressed(T *out, size_t k, size_t limit,
+                                          __m256i v, unsigned mask) {
+  using L = lanes<T>;
+  size_t n = static_cast<size_t>(__builtin_popcount(mask));
+  if (!out || n == 0) {
+    return k + n;
+  }
+  v = L::compress(v, mask);
+  if (k + L::N <= limit) {
+    L::store(out + k, v);
+  } else {
+    alignas(32) T tmp[L::N];
+    L::store(tmp, v);
+    std::copy(tmp, tmp + n, out + k);
+  }
+  return k + n;
+}
+
+template <typename T>
+SORTED_SET_TARGET size_t unique_avx2(const T *in, size_t n, T *out) {
+  using L = lanes<T>;
+  if (n == 0) {
+    return 0;
+  }
+  T last = in[0];
+  if (out) {
+    out[0] = last;
+  }
+  size_t i = 1, k = 1;
+  for (; i + L::N <= n; i += L::N) {
+    __m256i v = L::load(in + i);
+    unsigned mask = ~L::eq(v, L::shift_in(v, last)) & L::FULL;
+    // read before the store, which may overwrite it when in == out
+    last = in[i + L::N - 1];
+    // k <= i, so the full store stays inside the current block
+    k = store_compressed(out, k, n, v, mask);
+  }
+  return unique_scalar(in, n, out, i, k, last);
+}
+
+// mask of the lanes of va equal to any lane of vb
+template <typename T>
+SORTED_SET_TARGET unsigned match(__m256i va, __m256i vb) {
+  using L = lanes<T>;
+  unsigned mask = L::eq(va, vb);
+  for (size_t r = 1; r < L::N; r++) {
+    vb = L::rotate(vb);
+    mask |= L::eq(va, vb);
+  }
+  return mask;
+}
+
+template <typename T>
+SORTED_SET_TARGET size_t intersection_avx2(const T *a, size_t na, const T *b,
+                                           size_t nb, T *out) {
+  using L = lanes<T>;
+  size_t limit = std::min(na, nb);
+  size_t i = 0, j = 0, k = 0;
+  while (i + L::N <= na && j + L::N <= nb) {
+    __m256i va = L::load(a + i);
+    unsigned mask = match<T>(va, L::load(b + j));
+    k = store_compressed(out, k, limit, va, mask);
+    T a_max = a[i + L::N - 1];
+    T b_max = b[j + L::N - 1];
+    if (a_max <= b_max) {
+      i += L::N;
+    }
+    if (b_max <= a_max) {
+      j += L::N;
+    }
+  }
+  return intersection_scalar(a, na, b, nb, out, i, j, k);
+}
+
+template <typename T>
+SORTED_SET_TARGET size_t difference_avx2(const T *a, size_t na, const T *b,
+                                         size_t nb, T *out) {
+  using L = lanes<T>;
+  size_t i = 0, j = 0, k = 0;
+  // lanes of the current a block which matched so far
+  unsigned matched = 0;
+  while (i + L::N <= na && j + L::N <= nb) {
+    __m256i va = L::load(a + i);
+    matched |= match<T>(va, L::load(b + j));
+    T a_max = a[i + L::N - 1];
+    T b_max = b[j + L::N - 1];
+    if (a_max <= b_max) {
+      // no later b block can match this a block any more
+      k = store_compressed(out, k, na, va, ~matched & L::FULL);
+      matched = 0;
+      i += L::N;
+    }
+    if (b_max <= a_max) {
+      j += L::N;
+    }
+  }
+  return difference_scalar(a, na, b, nb, out, i, j, k, matched);
+}
+
+// lo gets the N smallest of both sorted registers, hi the N largest
+template <typename T>
+SORTED_SET_TARGET void merge2(__m256i x, __m256i y, __m256i &lo,
+                              __m256i &hi) {
+  using L = lanes<T>;
+  y = L::reverse(y);
+  lo = L::clean(L::min(x, y));
+  hi = L::clean(L::max(x, y));
+}
+
+// Dedupe selects set_union over merge
+template <bool Dedupe, typename T>
+SORTED_SET_TARGET size_t merge_avx2(const T *a, size_t na, const T *b,
+                                    size_t nb, T *out) {
+  using L = lanes<T>;
+  if (na < L::N || nb < L::N) {
+    return merge_scalar<Dedupe>(a, na, b, nb, static_cast<const T *>(nullptr),
+                                0, out, 0);
+  }
+  size_t k = 0;
+  bool has_last = false;
+  T last = 0;
+  __m256i lo, hi;
+  merge2<T>(L::load(a), L::load(b), lo, hi);
+  size_t i = L::N, j = L::N;
+  while (true) {
+    if constexpr (Dedupe) {
+      unsigned mask = ~L::eq(lo, L::shift_in(lo, last)) & L::FULL;
+      if (!has_last) {
+        mask |= 1;
+        has_last = true;
+      }
+      last = L::back(lo);
+      // k never passes the consumed input, so the full store always fits
+      k = store_compressed(out, k, na + nb, lo, mask);
+    } else {
+      if (out) {
+        L::store(out + k, lo);
+      }
+      k += L::N;
+    }
+    if (i + L::N > na || j + L::N > nb) {
+      break;
+    }
+    // the next block comes from the input whose next element is smaller
+    __m256i next;
+    if (a[i] <= b[j]) {
+      next = L::load(a + i);
+      i += L::N;
+    } else {
+      next = L::load(b + j);
+      j += L::N;
+    }
+    merge2<T>(hi, next, lo, hi);
+  }
+  alignas(32) T rest[L::N];
+  L::store(rest, hi);
+  return merge_scalar<Dedupe>(rest, L::N, a + i, na - i, b + j, nb - j, out,
+                              k, has_last, last);
+}
+
+#endif
+
+} // namespace detail
+
+template <typename T> size_t unique(const T *in, size_t n, T *out) {
+  static_assert(detail::supported_v<T>);
+  if (n == 0) {
+    return 0;
+  }
+#ifdef SORTED_SET_AVX2
+  if (detail::has_avx2()) {
+    return detail::unique_avx2(in, n, out);
+  }
+#endif
+  if (out) {
+    out[0] = in[0];
+  }
+  return detail::unique_scalar(in, n, out, 1, 1, in[0]);
+}
+
+template <typename T>
+size_t set_intersection(const T *a, size_t na, const T *b, size_t nb,
+                        T *out) {
+  static_assert(detail::supported_v<T>);
+  if (na > nb) {
+    // the result is the same either way, keep a the shorter one
+    std::swap(a, b);
+    std::swap(na, nb);
+  }
+  if (na * GALLOP_RATIO < nb) {
+    return detail::intersection_gallop(a, na, b, nb, out);
+  }
+#ifdef SORTED_SET_AVX2
+  if (detail::has_avx2()) {
+    return detail::intersection_avx2(a, na, b, nb, out);
+  }
+#endif
+  return detail::intersection_scalar(a, na, b, nb, out, 0, 0, 0);
+}
+
+template <typename T>
+size_t set_union(const T *a, size_t na, const T *b, size_t nb, T *out) {
+  static_assert(detail::supported_v<T>);
+#ifdef SORTED_SET_AVX2
+  if (detail::has_avx2()) {
+    return detail::merge_avx2<true>(a, na, b, nb, out);
+  }
+#endif
+  return detail::merge_scalar<true>(a, na, b, nb,
+                                    static_cast<const T *>(nullptr), 0, out,
+                                    0);
+}
+
+template <typename T>
+size_t set_difference(const T *a, size_t na, const T *b, size_t nb, T *out) {
+  static_assert(detail::supported_v<T>);
+#ifdef SORTED_SET_AVX2
+  if (detail::has_avx2()) {
+    return detail::difference_avx2(a, na, b, nb, out);
+  }
+#endif
+  return detail::difference_scalar(a, na, b, nb, out, 0, 0, 0);
+}
+
+template <typename T>
+size_t merge(const T *a, size_t na, const T *b, size_t nb, T *out) {
+  static_assert(detail::supported_v<T>);
+#ifdef SORTED_SET_AVX2
+  if (detail::has_avx2()) {
+    return detail::merge_avx2<false>(a, na, b, nb, out);
+  }
+#endif
+  return detail::merge_scalar<false>(a, na, b, nb,
+                                     static_cast<const T *>(nullptr), 0, out,
+                                     0);
+}
+
+} // namespace sorted_set
@@ -0,0 +1,304 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+// sorting networks for small fixed sizes: a fixed sequence of compare
+// exchanges, every one compiles to a min / max (cmov) pair, so there is no
+// data dependent branch and no allocation. the sequence is a template
+// constant, network_sort<N> is fully unrolled and constexpr
+//
+//  - N <= 16: the smallest known networks (knuth, green, dobbelaere's list),
+//    proven optimal in size up to N = 12, 14 and 15 are the 16 network
+//    without its top wires
+//  - N > 16: batcher's odd-even merge sort, generated at compile time
+//
+// not stable
+
+namespace sorting_network_detail {
+
+struct comparator {
+  uint16_t i;
+  uint16_t j;
+};
+
+template <size_t N> struct optimal;
+
+template <> struct optimal<0> {
+  static constexpr std::array<comparator, 0> pairs{};
+};
+
+template <> struct optimal<1> {
+  static constexpr std::array<comparator, 0> pairs{};
+};
+
+template <> struct optimal<2> {
+  // 1 comparator, depth 1
+  static constexpr std::array<comparator, 1> pairs{{
+      {0, 1},
+  }};
+};
+
+template <> struct optimal<3> {
+  // 3 comparators, depth 3
+  static constexpr std::array<comparator, 3> pairs{{
+      {0, 2},
+      {0, 1},
+      {1, 2},
+  }};
+};
+
+template <> struct optimal<4> {
+  // 5 comparators, depth 3
+  static constexpr std::array<comparator, 5> pairs{{
+      {0, 2}, {1, 3},
+      {0, 1}, {2, 3},
+      {1, 2},
+  }};
+};
+
+template <> struct optimal<5> {
+  // 9 comparators, depth 5
+  static constexpr std::array<comparator, 9> pairs{{
+      {0, 3}, {1, 4},
+      {0, 2}, {1, 3},
+      {0, 1}, {2, 4},
+      {1, 2}, {3, 4},
+      {2, 3},
+  }};
+};
+
+template <> struct optimal<6> {
+  // 12 comparators, depth 5
+  static constexpr std::array<comparator, 12> pairs{{
+      {0, 5}, {1, 3}, {2, 4},
+      {1, 2}, {3, 4},
+      {0, 3}, {2, 5},
+      {0, 1}, {2, 3}, {4, 5},
+      {1, 2}, {3, 4},
+  }};
+};
+
+template <> struct optimal<7> {
+  // 16 comparators, depth 6
+  static constexpr std::array<comparator, 16> pairs{{
+      {0, 6}, {2, 3}, {4, 5},
+      {0, 2}, {1, 4}, {3, 6},
+      {0, 1}, {2, 5}, {3, 4},
+      {1, 2}, {4, 6},
+      {2, 3}, {4, 5},
+      {1, 2}, {3, 4}, {5, 6},
+  }};
+};
+
+template <> struct optimal<8> {
+  // 19 comparators, depth 6
+  static constexpr std::array<comparator, 19> pairs{{
+      {0, 2}, {1, 3}, {4, 6}, {5, 7},
+      {0, 4}, {1, 5}, {2, 6}, {3, 7},
+      {0, 1}, {2, 3}, {4, 5}, {6, 7},
+      {2, 4}, {3, 5},
+      {1, 4}, {3, 6},
+      {1, 2}, {3, 4}, {5, 6},
+  }};
+};
+
+template <> struct optimal<9> {
+  // 25 comparators, depth 7
+  static constexpr std::array<comparator, 25> pairs{{
+      {0, 3}, {1, 7}, {2, 5}, {4, 8},
+      {0, 7}, {2, 4}, {3, 8}, {5, 6},
+      {0, 2}, {1, 3}, {4, 5}, {7, 8},
+      {1, 4}, {3, 6}, {5, 7},
+      {0, 1}, {2, 4}, {3, 5}, {6, 8},
+      {2, 3}, {4, 5}, {6, 7},
+      {1, 2}, {3, 4}, {5, 6},
+  }};
+};
+
+template <> struct optimal<10> {
+  // 29 comparators, depth 8
+  static constexpr std::array<comparator, 29> pairs{{
+      {0, 8}, {1, 9}, {2, 7}, {3, 5}, {4, 6},
+      {0, 2}, {1, 4}, {5, 8}, {7, 9},
+      {0, 3}, {2, 4}, {5, 7}, {6, 9},
+      {0, 1}, {3, 6}, {8, 9},
+      {1, 5}, {2, 3}, {4, 8}, {6, 7},
+      {1, 2}, {3, 5}, {4, 6}, {7, 8},
+      {2, 3}, {4, 5}, {6, 7},
+      {3, 4}, {5, 6},
+  }};
+};
+
+template <> struct optimal<11> {
+  // 35 comparators, depth 8
+  static constexpr std::array<comparator, 35> pairs{{
+      {0, 9}, {1, 6}, {2, 4}, {3, 7}, {5, 8},
+      {0, 1}, {3, 5}, {4, 10}, {6, 9}, {7, 8},
+      {1, 3}, {2, 5}, {4, 7}, {8, 10},
+      {0, 4}, {1, 2}, {3, 7}, {5, 9}, {6, 8},
+      {0, 1}, {2, 6}, {4, 5}, {7, 8}, {9, 10},
+      {2, 4}, {3, 6}, {5, 7}, {8, 9},
+      {1, 2}, {3, 4}, {5, 6}, {7, 8},
+      {2, 3}, {4, 5}, {6, 7},
+  }};
+};
+
+template <> struct optimal<12> {
+  // 39 comparators, depth 9
+  static constexpr std::array<comparator, 39> pairs{{
+      {0, 8}, {1, 7}, {2, 6}, {3, 11}, {4, 10}, {5, 9},
+      {0, 1}, {2, 5}, {3, 4}, {6, 9}, {7, 8}, {10, 11},
+      {0, 2}, {1, 6}, {5, 10}, {9, 11},
+      {0, 3}, {1, 2}, {4, 6}, {5, 7}, {8, 11}, {9, 10},
+      {1, 4}, {3, 5}, {6, 8}, {7, 10},
+      {1, 3}, {2, 5}, {6, 9}, {8, 10},
+      {2, 3}, {4, 5}, {6, 7}, {8, 9},
+      {4, 6}, {5, 7},
+      {3, 4}, {5, 6}, {7, 8},
+  }};
+};
+
+template <> struct optimal<13> {
+  // 45 comparators, depth 10
+  static constexpr std::array<comparator, 45> pairs{{
+      {0, 12}, {1, 10}, {2, 9}, {3, 7}, {5, 11}, {6, 8},
+      {1, 6}, {2, 3}, {4, 11}, {7, 9}, {8, 10},
+      {0, 4}, {1, 2}, {3, 6}, {7, 8}, {9, 10}, {11, 12},
+      {4, 6}, {5, 9}, {8, 11}, {10, 12},
+      {0, 5}, {3, 8}, {4, 7}, {6, 11}, {9, 10},
+      {0, 1}, {2, 5}, {6, 9}, {7, 8}, {10, 11},
+      {1, 3}, {2, 4}, {5, 6}, {9, 10},
+      {1, 2}, {3, 4}, {5, 7}, {6, 8},
+      {2, 3}, {4, 5}, {6, 7}, {8, 9},
+      {3, 4}, {5, 6},
+  }};
+};
+
+template <> struct optimal<14> {
+  // 51 comparators, depth 10
+  static constexpr std::array<comparator, 51> pairs{{
+      {0, 13}, {1, 12}, {4, 8}, {5, 6}, {7, 11}, {9, 10},
+      {0, 5}, {1, 7}, {2, 9}, {3, 4}, {6, 13}, {11, 12},
+      {0, 1}, {2, 3}, {4, 5}, {6, 8}, {7, 9}, {10, 11}, {12, 13},
+      {0, 2}, {1, 3}, {4, 10}, {5, 11}, {6, 7}, {8, 9},
+      {1, 2}, {3, 12}, {4, 6}, {5, 7}, {8, 10}, {9, 11},
+      {1, 4}, {2, 6}, {5, 8}, {7, 10}, {9, 13},
+      {2, 4}, {3, 6}, {9, 12}, {11, 13},
+      {3, 5}, {6, 8}, {7, 9}, {10, 12},
+      {3, 4}, {5, 6}, {7, 8}, {9, 10}, {11, 12},
+      {6, 7}, {8, 9},
+  }};
+};
+
+template <> struct optimal<15> {
+  // 56 comparators, depth 10
+  static constexpr std::array<comparator, 56> pairs{{
+      {0, 13}, {1, 12}, {3, 14}, {4, 8}, {5, 6}, {7, 11}, {9, 10},
+      {0, 5}, {1, 7}, {2, 9}, {3, 4}, {6, 13}, {8, 14}, {11, 12},
+      {0, 1}, {2, 3}, {4, 5}, {6, 8}, {7, 9}, {10, 11}, {12, 13},
+      {0, 2}, {1, 3}, {4, 10}, {5, 11}, {6, 7}, {8, 9}, {12, 14},
+      {1, 2}, {3, 12}, {4, 6}, {5, 7}, {8, 10}, {9, 11}, {13, 14},
+      {1, 4}, {2, 6}, {5, 8}, {7, 10}, {9, 13}, {11, 14},
+      {2, 4}, {3, 6}, {9, 12}, {11, 13},
+      {3, 5}, {6, 8}, {7, 9}, {10, 12},
+      {3, 4}, {5, 6}, {7, 8}, {9, 10}, {11, 12},
+      {6, 7}, {8, 9},
+  }};
+};
+
+template <> struct optimal<16> {
+  // 60 comparators, depth 10
+  static constexpr std::array<comparator, 60> pairs{{
+      {0, 13}, {1, 12}, {2, 15}, {3, 14}, {4, 8}, {5, 6}, {7, 11}, {9, 10},
+      {0, 5}, {1, 7}, {2, 9}, {3, 4}, {6, 13}, {8, 14}, {10, 15}, {11, 12},
+      {0, 1}, {2, 3}, {4, 5}, {6, 8}, {7, 9}, {10, 11}, {12, 13}, {14, 15},
+      {0, 2}, {1, 3}, {4, 10}, {5, 11}, {6, 7}, {8, 9}, {12, 14}, {13, 15},
+      {1, 2}, {3, 12}, {4, 6}, {5, 7}, {8, 10}, {9, 11}, {13, 14},
+      {1, 4}, {2, 6}, {5, 8}, {7, 10}, {9, 13}, {11, 14},
+      {2, 4}, {3, 6}, {9, 12}, {11, 13},
+      {3, 5}, {6, 8}, {7, 9}, {10, 12},
+      {3, 4}, {5, 6}, {7, 8}, {9, 10}, {11, 12},
+      {6, 7}, {8, 9},
+  }};
+};
+// batcher's odd-even merge sort for any n (knuth 5.3.4, algorithm m), once
+// to count the comparators and once to write them
+template <typename Emit> constexpr void batcher_pairs(size_t n, Emit emit) {
+  for (size_t p = 1; p < n; p <<= 1) {
+    for (size_t k = p; k >= 1; k >>= 1) {
+      for (size_t j = k % p; j + k < n; j += 2 * k) {
+        for (size_t i = 0; i < k && i < n - j - k; i++) {
+          if ((i + j) / (2 * p) == (i + j + k) / (2 * p)) {
+            emit(i + j, i + j + k);
+          }
+        }
+      }
+    }
+  }
+}
+
+constexpr size_t batcher_size(size_t n) {
+  size_t count = 0;
+  batcher_pairs(n, [&](size_t, size_t) { count++; });
+  return count;
+}
+
+template <size_t N> struct batcher {
+  static_assert(N <= UINT16_MAX);
+
+  static constexpr std::array<comparator, batcher_size(N)> make() {
+    std::array<comparator, batcher_size(N)> res{};
+    size_t k = 0;
+    batcher_pairs(N, [&](size_t i, size_t j) {
+      res[k++] = {static_cast<uint16_t>(i), static_cast<uint16_t>(j)};
+    });
+    return res;
+  }
+
+  static constexpr std::array<comparator, batcher_size(N)> pairs = make();
+};
+
+template <size_t N>
+using network = std::conditional_t<(N <= 16), optimal<N>, batcher<N>>;
+
+template <typename T, typename Comparator>
+constexpr void compare_exchange(T &a, T &b, Comparator &comparator) {
+  bool swap = comparator(b, a);
+  T lo = swap ? b : a;
+  T hi = swap ? a : b;
+  a = std::move(lo);
+  b = std::move(hi);
+}
+
+// data is unused for N < 2, the pair list is empty
+template <typename Net, typename T, typename Comparator, size_t... I>
+constexpr void apply([[maybe_unused]] T *data, Comparator &comparator,
+                     std::index_sequence<I...>) {
+  (compare_exchange(data[Net::pairs[I].i], data[Net::pairs[I].j],
+                    comparator),
+   ...);
+}
+
+} // namespace sorting_network_detail
+
+// number of compare exchanges of network_sort<N>
+template <size_t N>
+constexpr size_t network_size =
+    sorting_network_detail::network<N>::pairs.size();
+
+template <size_t N, typename T, typename Comparator = std::less<T>>
+constexpr void network_sort(T *data, Comparator comparator = Comparator()) {
+  using net = sorting_network_detail::network<N>;
+  sorting_network_detail::apply<net>(
+      data, comparator, std::make_index_sequence<net::pairs.size()>{});
+}
+
+template <typename T, size_t N, typename Comparator = std::less<T>>
+constexpr void network_sort(std::array<T, N> &arr,
+                            Comparator comparator = Comparator()) {
+  network_sort<N>(arr.data(), comparator);
+}
@@ -0,0 +1,231 @@
+#pragma once
+#include "scratch_arena.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// sort std::string_view keys (byte strings, compared like memcmp), the views
+// are moved around but never the characters, so they can point into one
+// arena
+//
+//  - multikey_quicksort: three-way radix quick sort (bentley & sedgewick), it
+//    partitions on the characters at the current depth and never looks at a
+//    shared prefix again. the current characters of every string are cached
+//    in a side array (7 at a time plus their count, filled once per depth and
+//    swapped together with the views), so the partition loop does not chase
+//    the string pointers and a long shared prefix costs one pass per 7
+//    characters. small ranges are finished by insertion sort comparing from
+//    the current depth. not stable
+//  - lcp_merge_sort: stable merge sort which carries the longest common
+//    prefix of neighbours, the lcp merge (ng & kakehi) decides most steps by
+//    comparing two lcp values and only compares characters past them. it
+//    also returns the lcp array, which e.g. merging sorted parts again needs
+
+namespace string_sort_detail {
+
+constexpr size_t INSERTION_THRESHOLD = 16;
+
+constexpr size_t CHUNK = 7;
+
+// the CHUNK characters from depth (zero padded) in the high bytes, their
+// count in the low byte, so "ab" < "ab\0" < "ab\1" and a count below CHUNK
+// means the string ends in this chunk
+inline uint64_t chunk_at(std::string_view s, size_t depth) {
+  size_t n = depth < s.size() ? std::min(s.size() - depth, CHUNK) : 0;
+  uint64_t key = 0;
+  for (size_t i = 0; i < CHUNK; i++) {
+    key = key << 8 | (i < n ? static_cast<uint8_t>(s[depth + i]) : 0);
+  }
+  return key << 8 | n;
+}
+
+// lcp of a and b, knowing the first h characters are equal
+inline size_t lcp_from(std::string_view a, std::string_view b, size_t h) {
+  size_t n = std::min(a.size(), b.size());
+  while (h < n && a[h] == b[h]) {
+    h++;
+  }
+  return h;
+}
+
+// all strings share their first `depth` characters
+inline void insertion_sort(std::string_view *s, size_t n, size_t depth) {
+  for (size_t i = 1; i < n; i++) {
+    std::string_view key = s[i];
+    std::string_view suffix = key.substr(depth);
+    size_t j = i;
+    while (j > 0 && suffix < s[j - 1].substr(depth)) {
+      s[j] = s[j - 1];
+      j--;
+    }
+    s[j] = key;
+  }
+}
+
+inline uint64_t median_of_3(uint64_t a, uint64_t b, uint64_t c) {
+  return std::max(std::min(a, b), std::min(std::max(a, b), c));
+}
+
+// cache[i] holds chunk_at(s[i], depth) when cached is true
+inline void multikey_quicksort(std::string_view *s, uint64_t *cache, size_t n,
+                               size_t depth, bool cached) {
+  while (n > INSERTION_THRESHOLD) {
+    if (!cached) {
+      for (size_t i = 0; i < n; i++) {
+        cache[i] = chunk_at(s[i], depth);
+      }
+    }
+    uint64_t pivot = median_of_3(cache[0], cache[n / 2], cache[n - 1]);
+    // [0, lt) < pivot, [lt, i) == pivot, [gt, n) > pivot
+    size_t lt = 0, i = 0, gt = n;
+    while (i < gt) {
+      if (cache[i] < pivot) {
+        std::swap(s[lt], s[i]);
+        std::swap(cache[lt++], cache[i++]);
+      } else if (cache[i] > pivot) {
+        gt--;
+        std::swap(s[i], s[gt]);
+        std::swap(cache[i], cache[gt]);
+      } else {
+        i++;
+      }
+    }
+    // the outer parts stay on this character, their cache is still valid
+    multikey_quicksort(s, cache, lt, depth, true);
+    multikey_quicksort(s + gt, cache + gt, n - gt, depth, true);
+    if ((pivot & 0xff) < CHUNK) {
+      // the middle part are equal strings which all ended here
+      return;
+    }
+    s += lt;
+    cache += lt;
+    n = gt - lt;
+    depth += CHUNK;
+    cached = false;
+  }
+  insertion_sort(s, n, depth);
+}
+
+// merge a and b (lcp[i] is the lcp of element i with element i - 1) into out
+// and out_lcp, ties go to a
+inline void lcp_merge(const std::string_view *a, const size_t *a_lcp,
+                      size_t na, const std::string_view *b,
+                      const size_t *b_lcp, size_t nb, std::string_view *out,
+                      size_t *out_lcp) {
+  size_t i = 0, j = 0, k = 0;
+  // lcp of the next element of a / b with the last output
+  size_t ha = 0, hb = 0;
+  while (i < na && j < nb) {
+    if (ha > hb) {
+      // a shares more with the last output, so a < b and lcp(a, b) == hb
+      out[k] = a[i];
+      out_lcp[k++] = ha;
+      ha = ++i < na ? a_lcp[i] : 0;
+    } else if (ha < hb) {
+      out[k] = b[j];
+      out_lcp[k++] = hb;
+      hb = ++j < nb ? b_lcp[j] : 0;
+    } else {
+      size_t h = lcp_from(a[i], b[j], ha);
+      bool a_first = h == a[i].size() ||
+                     (h < b[j].size() && static_cast<uint8_t>(a[i][h]) <
+                                             static_cast<uint8_t>(b[j][h]));
+      if (a_first) {
+        out[k] = a[i];
+        out_lcp[k++] = ha;
+        ha = ++i < na ? a_lcp[i] : 0;
+        hb = h;
+      } else {
+        out[k] = b[j];
+        out_lcp[k++] = hb;
+        hb = ++j < nb ? b_lcp[j] : 0;
+        ha = h;
+      }
+    }
+  }
+  if (i < na) {
+    out[k] = a[i];
+    out_lcp[k++] = ha;
+    std::copy(a + i + 1, a + na, out + k);
+    std::copy(a_lcp + i + 1, a_lcp + na, out_lcp + k);
+  } else if (j < nb) {
+    out[k] = b[j];
+    out_lcp[k++] = hb;
+    std::copy(b + j + 1, b + nb, out + k);
+    std::copy(b_lcp + j + 1, b_lcp + nb, out_lcp + k);
+  }
+}
+
+inline void lcp_merge_sort(std::string_view *s, size_t *lcp, size_t n,
+                           std::string_view *tmp, size_t *tmp_lcp) {
+  if (n <= INSERTION_THRESHOLD) {
+    insertion_sort(s, n, 0);
+    for (size_t i = 1; i < n; i++) {
+      lcp[i] = lcp_from(s[i - 1], s[i], 0);
+    }
+    if (n > 0) {
+      lcp[0] = 0;
+    }
+    return;
+  }
+  size_t m = n / 2;
+  lcp_merge_sort(s, lcp, m, tmp, tmp_lcp);
+  lcp_merge_sort(s + m, lcp + m, n - m, tmp, tmp_lcp);
+  lcp_merge(s, lcp, m, s + m, lcp + m, n - m, tmp, tmp_lcp);
+  std::copy(tmp, tmp + n, s);
+  std::copy(tmp_lcp, tmp_lcp + n, lcp);
+}
+
+} // namespace string_sort_detail
+
+// scratch bytes of the sorts below for n strings
+inline size_t multikey_quicksort_scratch(size_t n) {
+  return scratch_arena::bytes<uint64_t>(n);
+}
+
+// caller_lcp: the lcp array is passed in, not allocated
+inline size_t lcp_merge_sort_scratch(size_t n, bool caller_lcp = false) {
+  return scratch_arena::bytes<size_t>(caller_lcp ? 0 : n) +
+         scratch_arena::bytes<std::string_view>(n) +
+         scratch_arena::bytes<size_t>(n);
+}
+
+inline void multikey_quicksort(std::string_view *strings, size_t n) {
+  scratch_array<uint64_t> cache(n);
+  string_sort_detail::multikey_quicksort(strings, cache.data(), n, 0, false);
+}
+
+// stable, lcp (if not null) receives the lcp of every string with its
+// predecessor (0 for the first one)
+inline void lcp_merge_sort(std::string_view *strings, size_t n,
+                           size_t *lcp = nullptr) {
+  scratch_array<size_t> own_lcp(lcp ? 0 : n);
+  scratch_array<std::string_view> tmp(n);
+  scratch_array<size_t> tmp_lcp(n);
+  string_sort_detail::lcp_merge_sort(strings, lcp ? lcp : own_lcp.data(), n,
+                                     tmp.data(), tmp_lcp.data());
+}
+
+// merge two sorted parts with their lcp arrays (as produced by
+// lcp_merge_sort), out and out_lcp must hold na + nb elements
+inline void lcp_merge(const std::string_view *a, const size_t *a_lcp,
+                      size_t na, const std::string_view *b,
+                      const size_t *b_lcp, size_t nb, std::string_view *out,
+                      size_t *out_lcp) {
+  string_sort_detail::lcp_merge(a, a_lcp, na, b, b_lcp, nb, out, out_lcp);
+}
+
+// same signature as the other sorts, T is std::string_view
+template <typename T> void multikey_quicksort(std::vector<T> &arr) {
+  static_assert(std::is_same_v<T, std::string_view>);
+  multikey_quicksort(arr.data(), arr.size());
+}
+
+template <typename T> void lcp_merge_sort(std::vector<T> &arr) {
+  static_assert(std::is_same_v<T, std::string_view>);
+  lcp_merge_sort(arr.data(), arr.size());
+}
@@ -1,3 +1,6 @@
+#include "external/run_generator.hpp"
+#include "tree/loser_tree.hpp"
+
 #include <fmt/core.h>
 #include <fmt/ostream.h>
 #include <fmt/ranges.h>
@@ -125,113 +128,21 @@ TreeHandle build_winner_tree(const std::vector<int> &arr) {
 void replacement_substitute_sort(const std::vector<int> &source,
                                  std::vector<std::vector<int>> &output,
                                  int capacity = 3) {
-  struct PlayerRec {
-    int value{};
-    int seq_id{};
-  };
-  int n = capacity;
-  int minimax = std::numeric_limits<int>::max();
-  int curr = 0;
-  int curr_seq_id = 0;
-  std::vector<int> curr_output;
-  std::vector<int> loser_tree(n);
-  std::vector<PlayerRec> player(n);
-
-  std::function<int(int)> parent = [&](int node) -> int { return node / 2; };
-
-  std::function<void(int)> compete = [&](int player_id) {
-    // 如果当前值比父节点记录的败者值大，说明当前值是胜者，可以参加下一轮竞赛
-    int next_loser = parent(player_id + n);
-    while (next_loser > 0) {
-      // update loser
-      int next_player_id = loser_tree[next_loser];
-      const PlayerRec &player_rec = player[player_id];
-      const PlayerRec &next_player_rec = player[next_player_id];
-      if (player_rec.seq_id > next_player_rec.seq_id ||
-          (player_rec.seq_id == next_player_rec.seq_id &&
-           player_rec.value > next_player_rec.value)) {
-        std::swap(loser_tree[next_loser], player_id);
-      }
-      next_loser = parent(next_loser);
-    }
-    // set final winner
-    loser_tree[0] = player_id;
-  };
-
-  std::function<void(int)> load = [&](int player_id) {
-    if (curr == source.size()) {
-      player[player_id] = {std::numeric_limits<int>::max(), curr_seq_id};
-      return;
-    }
-    int v = source[curr++];
-    player[player_id] = {v, v > minimax ? curr_seq_id : curr_seq_id + 1};
-  };
-
-  // 遍历所有的叶子节点，更新比赛情况
-  for (int i = n - 1; i >= 0; i--) {
-    load(i);
-    compete(i);
-  }
-
-  curr_seq_id++;
-  while (player[loser_tree[0]].value != std::numeric_limits<int>::max()) {
-    const PlayerRec &minimax_rec = player[loser_tree[0]];
-    minimax = minimax_rec.value;
-    if (minimax_rec.seq_id > curr_seq_id) {
-      output.emplace_back(curr_output);
-      curr_output.clear();
-      curr_seq_id++;
-    }
-    curr_output.emplace_back(minimax_rec.value);
-    load(loser_tree[0]);
-    compete(loser_tree[0]);
+  range_cursor<std::vector<int>::const_iterator> cursor{source};
+  run_generator<int> generator{capacity * run_generator<int>::entry_size};
+  vector_run_sink<int> sink{};
+  run_stats stats = generator.generate(cursor, sink);
+  fmt::println("{} runs, average length {:.2f} ({:.2f}x capacity)", stats.runs,
+               stats.average_run_length(), stats.length_ratio());
+  for (auto &run : sink.runs) {
+    output.emplace_back(std::move(run));
   }
-  output.emplace_back(curr_output);
 }
 
 void multi_way_merge_sort(const std::vector<std::vector<int>> &sources,
                           std::vector<int> &output) {
-  int n = sources.size();
-  // n for internal node, n for external node (leaf node) and 1 for judge
-  std::vector<int> loser_tree(n);
-  std::vector<int> player(n, std::numeric_limits<int>::min());
-  std::vector<int> pos(sources.size(), 0);
-
-  std::function<int(int)> parent = [&](int node) -> int { return node / 2; };
-
-  std::function<void(int)> compete = [&](int player_id) {
-    // 如果当前值比父节点记录的败者值大，说明当前值是胜者，可以参加下一轮竞赛
-    int next_loser = parent(player_id + n);
-    while (next_loser > 0) {
-      // update loser
-      if (player[player_id] > player[loser_tree[next_loser]]) {
-        std::swap(loser_tree[next_loser], player_id);
-      }
-      next_loser = parent(next_loser);
-    }
-    // set final winner
-    loser_tree[0] = player_id;
-  };
-
-  std::function<void(int)> load = [&](int player_id) {
-    if (pos[player_id] == sources[player_id].size()) {
-      player[player_id] = std::numeric_limits<int>::max();
-      return;
-    }
-    player[player_id] = sources[player_id][pos[player_id]++];
-  };
-
-  // 遍历所有的叶子节点，更新比赛情况
-  for (int i = n - 1; i >= 0; i--) {
-    load(i);
-    compete(i);
-  }
-
-  while (player[loser_tree[0]] != std::numeric_limits<int>::max()) {
-    output.emplace_back(player[loser_tree[0]]);
-    load(loser_tree[0]);
-    compete(loser_tree[0]);
-  }
+  // no sentinel any more, INT_MAX is a valid value
+  loser_tree_merge(sources, std::back_inserter(output));
 }
 
 int main() {
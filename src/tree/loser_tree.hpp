@@ -1 +1,199 @@
-#pragma once
\ No newline at end of file
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// loser tree (tournament tree) for k-way merging of sorted streams
+//
+// a cursor is anything with
+//   bool empty() const;  const T &front() const;  void pop();
+// (record_reader in external/ and range_cursor below both qualify)
+//
+// layout: m_nodes[1, k) are the internal nodes holding the loser of the match
+// played there, m_nodes[0] holds the overall winner, leaf i sits (virtually) at
+// position k + i, so the parent of node p is p / 2. every node stores a copy of
+// the key together with the cursor index and the exhausted flag, a replay
+// walks one root path and only touches these packed nodes, never the cursors.
+// exhausted cursors lose against everything (no sentinel value needed), equal
+// keys are won by the lower cursor index, so the merge is stable.
+template <typename Cursor,
+          typename Comparator = std::less<std::decay_t<
+              decltype(std::declval<const Cursor &>().front())>>>
+class loser_tree {
+public:
+  using value_type =
+      std::decay_t<decltype(std::declval<const Cursor &>().front())>;
+
+  explicit loser_tree(std::vector<Cursor> cursors,
+                      Comparator comparator = Comparator())
+      : m_cursors(std::move(cursors)), m_comparator(comparator) {
+    build();
+  }
+
+  loser_tree(const loser_tree &) = delete;
+  loser_tree &operator=(const loser_tree &) = delete;
+  loser_tree(loser_tree &&) = default;
+  loser_tree &operator=(loser_tree &&) = default;
+
+  // all cursors exhausted
+  bool empty() const { return m_nodes[0].exhausted; }
+
+  const value_type &top() const {
+    assert(!empty());
+    return m_nodes[0].key;
+  }
+
+  // which cursor the current top comes from
+  size_t top_index() const {
+    assert(!empty());
+    return m_nodes[0].index;
+  }
+
+  void pop() {
+    assert(!empty());
+    uint32_t i = m_nodes[0].index;
+    node winner = load(i);
+    replay(i, std::move(winner));
+  }
+
+  // move up to n smallest values to out, returns how many were written
+  size_t pop_n(value_type *out, size_t n) {
+    size_t count = 0;
+    for (; count < n && !m_nodes[0].exhausted; count++) {
+      out[count] = std::move(m_nodes[0].key);
+      uint32_t i = m_nodes[0].index;
+      replay(i, load(i));
+    }
+    return count;
+  }
+
+  size_t size() const { return m_cursors.size(); }
+
+  const Cursor &cursor(size_t i) const { return m_cursors[i]; }
+
+  const std::vector<Cursor> &cursors() const { return m_cursors; }
+
+private:
+  struct node {
+    value_type key{};
+    uint32_t index{};
+    bool exhausted{true};
+  };
+
+  // take the next key of cursor i (the cursor is advanced right away, the key
+  // lives in the tree until it wins)
+  node load(uint32_t i) {
+    Cursor &c = m_cursors[i];
+    if (c.empty()) {
+      return node{value_type{}, i, true};
+    }
+    node res{c.front(), i, false};
+    c.pop();
+    return res;
+  }
+
+  // a wins against b
+  bool beats(const node &a, const node &b) const {
+    if (a.exhausted || b.exhausted) {
+      return !a.exhausted;
+    }
+    if (m_comparator(a.key, b.key)) {
+      return true;
+    }
+    if (m_comparator(b.key, a.key)) {
+      return false;
+    }
+    return a.index < b.index;
+  }
+
+  // the new key of leaf i climbs to the root, swapping with every loser it
+  // loses against
+  void replay(uint32_t i, node curr) {
+    size_t k = m_cursors.size();
+    for (size_t p = (k + i) / 2; p > 0; p /= 2) {
+      if (beats(m_nodes[p], curr)) {
+        std::swap(m_nodes[p], curr);
+      }
+    }
+    m_nodes[0] = std::move(curr);
+  }
+
+  // play all matches bottom up in O(k)
+  void build() {
+    size_t k = m_cursors.size();
+    assert(k <= UINT32_MAX);
+    m_nodes.assign(std::max<size_t>(k, 1), node{});
+    if (k == 0) {
+      return;
+    }
+    // winners[p] is the winner of the subtree rooted at p
+    std::vector<node> winners(2 * k);
+    for (size_t i = 0; i < k; i++) {
+      winners[k + i] = load(static_cast<uint32_t>(i));
+    }
+    for (size_t p = k - 1; p > 0; p--) {
+      node &l = winners[2 * p];
+      node &r = winners[2 * p + 1];
+      if (beats(r, l)) {
+        m_nodes[p] = std::move(l);
+        winners[p] = std::move(r);
+      } else {
+        m_nodes[p] = std::move(r);
+        winners[p] = std::move(l);
+      }
+    }
+    m_nodes[0] = std::move(winners[1]);
+  }
+
+private:
+  std::vector<Cursor> m_cursors{};
+  std::vector<node> m_nodes{};
+  Comparator m_comparator{};
+};
+
+// cursor over an iterator range
+template <typename Iterator> class range_cursor {
+public:
+  using value_type = typename std::iterator_traits<Iterator>::value_type;
+
+  range_cursor(Iterator first, Iterator last) : m_curr(first), m_last(last) {}
+
+  template <typename Container>
+  explicit range_cursor(const Container &c)
+      : m_curr(std::begin(c)), m_last(std::end(c)) {}
+
+  bool empty() const { return m_curr == m_last; }
+
+  const value_type &front() const { return *m_curr; }
+
+  void pop() { ++m_curr; }
+
+private:
+  Iterator m_curr{};
+  Iterator m_last{};
+};
+
+// merge sorted containers into out
+template <typename Container, typename OutputIt,
+          typename Comparator = std::less<typename Container::value_type>>
+OutputIt loser_tree_merge(const std::vector<Container> &sources, OutputIt out,
+                          Comparator comparator = Comparator()) {
+  using cursor_type = range_cursor<typename Container::const_iterator>;
+  std::vector<cursor_type> cursors;
+  cursors.reserve(sources.size());
+  for (auto &s : sources) {
+    cursors.emplace_back(s.begin(), s.end());
+  }
+  loser_tree<cursor_type, Comparator> tree{std::move(cursors), comparator};
+  while (!tree.empty()) {
+    *out++ = tree.top();
+    tree.pop();
+  }
+  return out;
+}
@@ -0,0 +1,208 @@
+#pragma once
+
+#include "loser_tree.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// parallel k-way merge: the output is cut into P slices of equal size, the
+// cut points in every input are found by multiway_split (no data moves), then
+// every slice is merged by its own loser tree on its own thread
+//
+// the order is (value, input index, position), i.e. exactly the order of the
+// sequential stable loser tree merge, so equal keys never straddle a cut in
+// the wrong order and the parallel result is identical to the sequential one
+
+// random access view of a sorted array
+template <typename T> struct sorted_view {
+  const T *data{};
+  size_t length{};
+
+  size_t size() const { return length; }
+  const T &operator[](size_t i) const { return data[i]; }
+};
+
+// positions pos[i] such that the first pos[i] elements of every input are
+// exactly the `rank` smallest elements overall
+//
+// each round takes the median of every remaining window, picks their weighted
+// median as the pivot and counts (binary search per input) how many elements
+// are ordered before it, which removes at least a quarter of the candidates,
+// so O(log n) rounds of O(k log n) comparisons
+//
+// Seq needs size() and operator[], so it also works on files (see
+// record_file_view)
+template <typename Seq, typename Comparator>
+std::vector<size_t> multiway_split(const std::vector<Seq> &seqs, uint64_t rank,
+                                   Comparator comparator) {
+  size_t k = seqs.size();
+  std::vector<size_t> lo(k, 0), hi(k), count(k);
+  uint64_t total = 0;
+  for (size_t i = 0; i < k; i++) {
+    hi[i] = seqs[i].size();
+    total += hi[i];
+  }
+  assert(rank <= total);
+  if (rank == 0) {
+    return lo;
+  }
+  if (rank == total) {
+    return hi;
+  }
+
+  using value_type = std::decay_t<decltype(seqs[0][0])>;
+  struct candidate {
+    value_type value;
+    size_t seq;
+    size_t pos;
+    size_t weight;
+  };
+  std::vector<candidate> medians;
+  medians.reserve(k);
+  while (true) {
+    medians.clear();
+    uint64_t remaining = 0;
+    for (size_t i = 0; i < k; i++) {
+      if (lo[i] < hi[i]) {
+        size_t m = lo[i] + (hi[i] - lo[i]) / 2;
+        medians.push_back({seqs[i][m], i, m, hi[i] - lo[i]});
+        remaining += hi[i] - lo[i];
+      }
+    }
+    if (medians.empty()) {
+      // every window is closed, the bounds met at the cut
+      return lo;
+    }
+    // weighted median of the window medians in (value, seq) order
+    std::sort(medians.begin(), medians.end(),
+              [&](const candidate &a, const candidate &b) {
+                if (comparator(a.value, b.value)) {
+                  return true;
+                }
+                if (comparator(b.value, a.value)) {
+                  return false;
+                }
+                return a.seq < b.seq;
+              });
+    size_t pivot = 0;
+    for (uint64_t acc = 0; pivot < medians.size(); pivot++) {
+      acc += medians[pivot].weight;
+      if (2 * acc >= remaining) {
+        break;
+      }
+    }
+    const candidate &p = medians[pivot];
+
+    // number of elements ordered before the pivot, per input
+    uint64_t before = 0;
+    for (size_t i = 0; i < k; i++) {
+      if (i == p.seq) {
+        count[i] = p.pos;
+      } else {
+        // equal values of earlier inputs come first, of later inputs after
+        size_t l = lo[i], h = hi[i];
+        while (l < h) {
+          size_t mid = l + (h - l) / 2;
+          bool is_before = i < p.seq ? !comparator(p.value, seqs[i][mid])
+                                     : comparator(seqs[i][mid], p.value);
+          if (is_before) {
+            l = mid + 1;
+          } else {
+            h = mid;
+          }
+        }
+        count[i] = l;
+      }
+      before += count[i];
+    }
+    if (before == rank) {
+      return count;
+    }
+    if (before < rank) {
+      // the pivot and everything before it belongs to the left part
+      lo = count;
+      lo[p.seq] = p.pos + 1;
+    } else {
+      hi = count;
+    }
+  }
+}
+
+// merge sorted inputs into out (which must hold the total size) with up to
+// `threads` threads, 0 for the hardware concurrency
+template <typename T, typename Comparator = std::less<T>>
+void parallel_merge(const std::vector<sorted_view<T>> &inputs, T *out,
+                    unsigned threads = 0,
+                    Comparator comparator = Comparator()) {
+  uint64_t total = 0;
+  for (auto &in : inputs) {
+    total += in.size();
+  }
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  // tiny slices are not worth a thread
+  constexpr uint64_t MIN_SLICE = 1 << 14;
+  size_t slices = static_cast<size_t>(
+      std::max<uint64_t>(1, std::min<uint64_t>(threads, total / MIN_SLICE)));
+
+  // cut points of slice s are splits[s] .. splits[s + 1]
+  std::vector<std::vector<size_t>> splits(slices + 1);
+  auto split = [&](size_t s) {
+    splits[s] = multiway_split(inputs, total * s / slices, comparator);
+  };
+  // the splits are independent searches, run them on the workers as well
+  std::vector<std::thread> workers;
+  for (size_t s = 1; s < slices; s++) {
+    workers.emplace_back(split, s);
+  }
+  split(0);
+  split(slices);
+  for (auto &w : workers) {
+    w.join();
+  }
+  workers.clear();
+
+  auto merge = [&](size_t s) {
+    using cursor_type = range_cursor<const T *>;
+    std::vector<cursor_type> cursors;
+    cursors.reserve(inputs.size());
+    for (size_t i = 0; i < inputs.size(); i++) {
+      cursors.emplace_back(inputs[i].data + splits[s][i],
+                           inputs[i].data + splits[s + 1][i]);
+    }
+    loser_tree<cursor_type, Comparator> tree{std::move(cursors), comparator};
+    uint64_t first = total * s / slices;
+    size_t n = static_cast<size_t>(total * (s + 1) / slices - first);
+    size_t written = tree.pop_n(out + first, n);
+    assert(written == n && tree.empty());
+    (void)written;
+  };
+  for (size_t s = 1; s < slices; s++) {
+    workers.emplace_back(merge, s);
+  }
+  merge(0);
+  for (auto &w : workers) {
+    w.join();
+  }
+}
+
+template <typename T, typename Comparator = std::less<T>>
+void parallel_merge(const std::vector<std::vector<T>> &sources,
+                    std::vector<T> &output, unsigned threads = 0,
+                    Comparator comparator = Comparator()) {
+  std::vector<sorted_view<T>> inputs;
+  size_t total = 0;
+  for (auto &s : sources) {
+    inputs.push_back({s.data(), s.size()});
+    total += s.size();
+  }
+  output.resize(total);
+  parallel_merge(inputs, output.data(), threads, comparator);
+}
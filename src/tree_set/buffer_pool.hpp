@@ -0,0 +1,359 @@
+#pragma once
+
+// fixed size pages of a single file cached in a buffer pool
+//
+// page_file reads and writes whole pages by page id (the byte offset is
+// id * page_size). buffer_pool keeps a fixed number of frames, a page is
+// pinned while in use and may only be evicted once its pins are gone, the
+// victim is chosen by CLOCK (second chance, an approximation of LRU that
+// needs no list update on a hit) and written back first when dirty.
+// page_guard pins a page for the lifetime of a scope
+//
+// with no steal a dirty page is never evicted, the file then only changes
+// through flush() or through the copies of snapshot(), which is what a log
+// on top needs to decide when and how pages reach the file
+//
+// posix only, TREE_SET_PAGED is defined when available
+
+#if defined(__unix__) || defined(__APPLE__)
+#define TREE_SET_PAGED 1
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using page_id = uint32_t;
+
+class page_file {
+public:
+  // opens path or creates it empty
+  page_file(const std::string &path, size_t page_size)
+      : m_page_size(page_size) {
+    m_fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (m_fd < 0) {
+      throw std::runtime_error("failed to open " + path);
+    }
+    struct stat st {};
+    if (::fstat(m_fd, &st) != 0) {
+      ::close(m_fd);
+      throw std::runtime_error("failed to stat " + path);
+    }
+    m_page_count = static_cast<page_id>(st.st_size / page_size);
+  }
+
+  ~page_file() { ::close(m_fd); }
+
+  page_file(const page_file &) = delete;
+  page_file &operator=(const page_file &) = delete;
+
+  size_t page_size() const { return m_page_size; }
+
+  // whole pages in the file
+  page_id page_count() const { return m_page_count; }
+
+  void read(page_id id, void *buf) const { transfer(false, id, buf); }
+
+  void write(page_id id, const void *buf) {
+    transfer(true, id, const_cast<void *>(buf));
+    m_page_count = std::max<page_id>(m_page_count, id + 1);
+  }
+
+  // waits until the written pages are on the device
+  void sync() {
+    if (sync_fd(m_fd) != 0) {
+      throw std::runtime_error("failed to sync page file");
+    }
+  }
+
+  static int sync_fd(int fd) {
+#ifdef __linux__
+    return ::fdatasync(fd);
+#else
+    return ::fsync(fd);
+#endif
+  }
+
+private:
+  void transfer(bool write, page_id id, void *buf) const {
+    char *data = static_cast<char *>(buf);
+    uint64_t offset = uint64_t{id} * m_page_size;
+    size_t done = 0;
+    while (done < m_page_size) {
+      ssize_t res =
+          write ? ::pwrite(m_fd, data + done, m_page_size - done,
+                           static_cast<off_t>(offset + done))
+                : ::pread(m_fd, data + done, m_page_size - done,
+                          static_cast<off_t>(offset + done));
+      if (res < 0 && errno == EINTR) {
+        continue;
+      }
+      if (res <= 0) {
+        throw std::runtime_error(write ? "failed to write page"
+                                       : "failed to read page");
+      }
+      done += static_cast<size_t>(res);
+    }
+  }
+
+private:
+  int m_fd{-1};
+  size_t m_page_size{};
+  page_id m_page_count{};
+};
+
+class buffer_pool {
+public:
+  // page lookups and page transfers since the last reset
+  struct stats {
+    uint64_t hits{};
+    uint64_t misses{};
+    uint64_t reads{};
+    uint64_t writes{};
+
+    double hit_rate() const {
+      uint64_t lookups = hits + misses;
+      return lookups ? static_cast<double>(hits) / lookups : 1.0;
+    }
+  };
+
+  static constexpr size_t FRAME_ALIGN = 64;
+
+  buffer_pool(page_file &file, size_t frames)
+      : m_file(&file), m_frames(std::max<size_t>(frames, 1)) {
+    m_data = static_cast<char *>(
+        ::operator new(m_frames.size() * page_size(),
+                       std::align_val_t{FRAME_ALIGN}));
+    m_table.reserve(m_frames.size());
+  }
+
+  // dirty pages left in the pool are lost, flush() first
+  ~buffer_pool() {
+    ::operator delete(m_data, m_frames.size() * page_size(),
+                      std::align_val_t{FRAME_ALIGN});
+  }
+
+  buffer_pool(const buffer_pool &) = delete;
+  buffer_pool &operator=(const buffer_pool &) = delete;
+
+  size_t page_size() const { return m_file->page_size(); }
+
+  size_t frames() const { return m_frames.size(); }
+
+  // the page in memory with one more pin. a fresh page is one whose content
+  // on disk does not matter (just allocated or overwritten as a whole): it
+  // is not read, a frame of zeros is handed out instead
+  char *pin(page_id id, bool fresh = false) {
+    if (auto iter = m_table.find(id); iter != m_table.end()) {
+      frame &f = m_frames[iter->second];
+      m_pinned += f.pins++ == 0;
+      f.referenced = true;
+      m_stats.hits += !fresh;
+      if (fresh) {
+        // a cached copy of a page freed and allocated again is stale too
+        std::memset(data(iter->second), 0, page_size());
+      }
+      return data(iter->second);
+    }
+    size_t index = victim();
+    frame &f = m_frames[index];
+    if (f.used) {
+      if (f.dirty) {
+        m_file->write(f.id, data(index));
+        m_stats.writes++;
+        m_dirty--;
+      }
+      m_table.erase(f.id);
+    }
+    f = frame{id, 1, false, true, true};
+    m_pinned++;
+    m_table.emplace(id, index);
+    if (fresh) {
+      std::memset(data(index), 0, page_size());
+    } else {
+      m_stats.misses++;
+      try {
+        m_file->read(id, data(index));
+      } catch (...) {
+        m_table.erase(id);
+        f = frame{};
+        m_pinned--;
+        throw;
+      }
+      m_stats.reads++;
+    }
+    return data(index);
+  }
+
+  // drops a pin, dirty when the page was changed under it
+  void unpin(page_id id, bool dirty) {
+    auto iter = m_table.find(id);
+    assert(iter != m_table.end() && "unpin of a page not in the pool");
+    frame &f = m_frames[iter->second];
+    assert(f.pins > 0 && "unpin of a page without a pin");
+    m_pinned -= --f.pins == 0;
+    m_dirty += dirty && !f.dirty;
+    f.dirty |= dirty;
+  }
+
+  // writes the dirty pages back in page order, they stay cached
+  void flush() {
+    std::vector<std::pair<page_id, size_t>> dirty{};
+    for (size_t i = 0; i < m_frames.size(); i++) {
+      if (m_frames[i].used && m_frames[i].dirty) {
+        dirty.emplace_back(m_frames[i].id, i);
+      }
+    }
+    std::sort(dirty.begin(), dirty.end());
+    for (auto [id, index] : dirty) {
+      m_file->write(id, data(index));
+      m_frames[index].dirty = false;
+      m_stats.writes++;
+      m_dirty--;
+    }
+  }
+
+  // copies the dirty pages into pages (page_size bytes each, in page id
+  // order) and marks them clean. each keeps a pin until unpinned by the
+  // caller, so none is read back from the file before its copy reached it
+  std::vector<page_id> snapshot(std::vector<char> &pages) {
+    std::vector<std::pair<page_id, size_t>> dirty{};
+    for (size_t i = 0; i < m_frames.size(); i++) {
+      if (m_frames[i].used && m_frames[i].dirty) {
+        dirty.emplace_back(m_frames[i].id, i);
+      }
+    }
+    std::sort(dirty.begin(), dirty.end());
+    std::vector<page_id> ids{};
+    pages.resize(dirty.size() * page_size());
+    for (size_t i = 0; i < dirty.size(); i++) {
+      auto [id, index] = dirty[i];
+      std::memcpy(pages.data() + i * page_size(), data(index), page_size());
+      frame &f = m_frames[index];
+      f.dirty = false;
+      m_pinned += f.pins++ == 0;
+      ids.push_back(id);
+    }
+    m_dirty -= dirty.size();
+    return ids;
+  }
+
+  void set_no_steal(bool no_steal) { m_no_steal = no_steal; }
+
+  bool no_steal() const { return m_no_steal; }
+
+  size_t pinned() const { return m_pinned; }
+
+  size_t dirty() const { return m_dirty; }
+
+  const stats &io_stats() const { return m_stats; }
+
+  void reset_stats() { m_stats = {}; }
+
+private:
+  struct frame {
+    page_id id{};
+    int pins{};
+    bool dirty{};
+    bool referenced{};
+    bool used{};
+  };
+
+  char *data(size_t index) const { return m_data + index * page_size(); }
+
+  // CLOCK: the hand passes over the frames, a referenced one loses its bit
+  // and is skipped once, the first unpinned one without it is the victim
+  size_t victim() {
+    for (size_t step = 0; step < 2 * m_frames.size(); step++) {
+      size_t index = m_hand;
+      m_hand = (m_hand + 1) % m_frames.size();
+      frame &f = m_frames[index];
+      if (!f.used) {
+        return index;
+      }
+      if (f.pins > 0 || (m_no_steal && f.dirty)) {
+        continue;
+      }
+      if (f.referenced) {
+        f.referenced = false;
+        continue;
+      }
+      return index;
+    }
+    throw std::runtime_error("every frame of the buffer pool is pinned" +
+                             std::string(m_no_steal ? " or dirty" : ""));
+  }
+
+private:
+  page_file *m_file{};
+  std::vector<frame> m_frames{};
+  char *m_data{};
+  std::unordered_map<page_id, size_t> m_table{};
+  size_t m_hand{};
+  size_t m_pinned{};
+  size_t m_dirty{};
+  bool m_no_steal{};
+  stats m_stats{};
+};
+
+// a pin on a page for the lifetime of the guard
+class page_guard {
+public:
+  page_guard() = default;
+
+  page_guard(buffer_pool &pool, page_id id, bool fresh = false)
+      : m_pool(&pool), m_id(id), m_data(pool.pin(id, fresh)) {}
+
+  ~page_guard() { release(); }
+
+  page_guard(page_guard &&g) noexcept
+      : m_pool(std::exchange(g.m_pool, nullptr)), m_id(g.m_id),
+        m_data(g.m_data), m_dirty(g.m_dirty) {}
+
+  page_guard &operator=(page_guard &&g) noexcept {
+    if (this != &g) {
+      release();
+      m_pool = std::exchange(g.m_pool, nullptr);
+      m_id = g.m_id;
+      m_data = g.m_data;
+      m_dirty = g.m_dirty;
+    }
+    return *this;
+  }
+
+  page_id id() const { return m_id; }
+
+  char *data() const { return m_data; }
+
+  template <typename T> T *as() const { return reinterpret_cast<T *>(m_data); }
+
+  // the page is written back before it leaves the pool
+  void mark_dirty() { m_dirty = true; }
+
+  void release() {
+    if (m_pool) {
+      m_pool->unpin(m_id, m_dirty);
+      m_pool = nullptr;
+    }
+  }
+
+private:
+  buffer_pool *m_pool{};
+  page_id m_id{};
+  char *m_data{};
+  bool m_dirty{};
+};
+
+#endif
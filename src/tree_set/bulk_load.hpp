@@ -0,0 +1,101 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// helpers of the bulk loads of b_set / b_plus_set
+//
+// a bulk load reads a sorted stream once through a cursor
+//   bool empty() const;  const Key &front() const;  void pop();
+// (record_reader over the output of the external sort qualifies), fills the
+// leaves left to right and then builds every parent level from the one below
+namespace bulk_load_detail {
+
+// cursor over [first, last), for input iterators too
+template <typename Iterator> class iterator_cursor {
+public:
+  iterator_cursor(Iterator first, Iterator last)
+      : m_first(first), m_last(last) {}
+
+  bool empty() const { return m_first == m_last; }
+
+  decltype(auto) front() const { return *m_first; }
+
+  void pop() { ++m_first; }
+
+private:
+  Iterator m_first;
+  Iterator m_last;
+};
+
+// entries (keys of a leaf or children of an inner node) per node at
+// fill_factor, kept in [low, high]
+inline int node_fill(double fill_factor, int low, int high) {
+  assert(fill_factor > 0 && fill_factor <= 1);
+  int count = static_cast<int>(std::lround(fill_factor * high));
+  return std::clamp(count, low, high);
+}
+
+// how a bulk load cuts a level of total entries into nodes of per entries:
+// all full but the last one or two, as balance_last leaves them. low / high
+// are the entries a node needs / takes, left(two) how many of the entries of
+// the last two nodes stay left when they are shared
+struct level_layout {
+  size_t nodes{};
+  size_t per{};
+  // first entry of the last node
+  size_t tail{};
+  size_t total{};
+
+  template <typename Left>
+  static level_layout make(size_t total, size_t per, size_t low, size_t high,
+                           Left left) {
+    size_t m = (total + per - 1) / per;
+    level_layout layout{m, per, m ? (m - 1) * per : 0, total};
+    if (m < 2 || total - layout.tail >= low) {
+      return layout;
+    }
+    size_t two = per + total - layout.tail;
+    if (two <= high) {
+      layout.nodes = m - 1;
+      layout.tail = (m - 2) * per;
+    } else {
+      layout.tail = (m - 2) * per + left(two);
+    }
+    return layout;
+  }
+
+  // first entry of node, total for nodes
+  size_t first(size_t node) const {
+    return node + 1 < nodes ? node * per : node < nodes ? tail : total;
+  }
+
+  size_t node_of(size_t entry) const {
+    return entry >= tail ? nodes - 1 : entry / per;
+  }
+};
+
+// func(first, last) on [0, n) cut into slices of at least min_slice, one
+// thread per slice, threads 0 for the hardware concurrency
+template <typename Func>
+void parallel_for(size_t n, unsigned threads, size_t min_slice,
+                  const Func &func) {
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  size_t slices = std::clamp<size_t>(n / std::max<size_t>(min_slice, 1), 1,
+                                     threads);
+  std::vector<std::thread> workers;
+  for (size_t s = 1; s < slices; s++) {
+    workers.emplace_back(func, n * s / slices, n * (s + 1) / slices);
+  }
+  func(0, n / slices);
+  for (auto &w : workers) {
+    w.join();
+  }
+}
+
+} // namespace bulk_load_detail
@@ -1,3 +1,7 @@
+#pragma once
+#include <cassert>
+#include <optional>
+
 #ifdef DEBUG
 #define LOG(...)                                                               \
   do {                                                                         \
@@ -34,4 +38,4 @@
     if (b) {                                                                   \
       (b)->parent = (a);                                                       \
     }                                                                          \
-  } while (false)
\ No newline at end of file
+  } while (false)
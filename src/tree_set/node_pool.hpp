@@ -0,0 +1,146 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// allocator of single tree nodes: nodes are carved from contiguous chunks
+// (doubling up to MAX_CHUNK nodes), a freed node goes on an intrusive free
+// list and is handed out again before the chunk is touched, and the chunks
+// are only given back when the pool dies, in O(chunks)
+//
+// every set owns its pool, a pool can only free what it allocated itself
+template <typename T> class node_pool {
+public:
+  using value_type = T;
+
+  static constexpr size_t MIN_CHUNK = 64;
+  static constexpr size_t MAX_CHUNK = 4096;
+
+  node_pool() = default;
+
+  // a pool for another node type starts empty
+  template <typename U> node_pool(const node_pool<U> &) {}
+
+  node_pool(const node_pool &) = delete;
+  node_pool &operator=(const node_pool &) = delete;
+
+  ~node_pool() { release(); }
+
+  T *allocate([[maybe_unused]] size_t n = 1) {
+    assert(n == 1);
+    if (m_free) {
+      slot *s = m_free;
+      m_free = s->next;
+      return reinterpret_cast<T *>(s);
+    }
+    if (m_next == m_end) {
+      grow();
+    }
+    return reinterpret_cast<T *>(m_next++);
+  }
+
+  void deallocate(T *p, [[maybe_unused]] size_t n = 1) {
+    assert(n == 1);
+    slot *s = reinterpret_cast<slot *>(p);
+    s->next = m_free;
+    m_free = s;
+  }
+
+  // give every chunk back, the nodes in them must be dead already
+  void release() {
+    for (auto [chunk, count] : m_chunks) {
+      ::operator delete(chunk, count * sizeof(slot),
+                        std::align_val_t{alignof(slot)});
+    }
+    m_chunks.clear();
+    m_free = m_next = m_end = nullptr;
+  }
+
+  // nodes the chunks can hold
+  size_t capacity() const {
+    size_t n = 0;
+    for (auto [chunk, count] : m_chunks) {
+      n += count;
+    }
+    return n;
+  }
+
+private:
+  union slot {
+    slot *next;
+    alignas(T) std::byte node[sizeof(T)];
+  };
+
+  void grow() {
+    size_t count = m_chunks.empty()
+                       ? MIN_CHUNK
+                       : std::min(2 * m_chunks.back().second, MAX_CHUNK);
+    auto *chunk = static_cast<slot *>(::operator new(
+        count * sizeof(slot), std::align_val_t{alignof(slot)}));
+    m_chunks.emplace_back(chunk, count);
+    m_next = chunk;
+    m_end = chunk + count;
+  }
+
+private:
+  slot *m_free{};
+  slot *m_next{};
+  slot *m_end{};
+  std::vector<std::pair<slot *, size_t>> m_chunks{};
+};
+
+// a set may drop all its nodes by releasing the pool instead of visiting
+// them, when nothing has to be destroyed
+template <typename Allocator> struct is_node_pool : std::false_type {};
+
+template <typename T> struct is_node_pool<node_pool<T>> : std::true_type {};
+
+// nodes of the binary search trees (bst, avl, rb) are made and freed through
+// their node allocator with these
+template <typename NodeAllocator, typename... Args>
+auto new_node(NodeAllocator &alloc, Args &&...args) {
+  using traits = std::allocator_traits<NodeAllocator>;
+  using node_type = typename traits::value_type;
+  node_type *node = traits::allocate(alloc, 1);
+  return new (node) node_type{std::forward<Args>(args)...};
+}
+
+template <typename NodeAllocator>
+void delete_node(NodeAllocator &alloc,
+                 typename std::allocator_traits<NodeAllocator>::pointer node) {
+  using traits = std::allocator_traits<NodeAllocator>;
+  traits::destroy(alloc, node);
+  traits::deallocate(alloc, node, 1);
+}
+
+// free every node below root (which needs left / right children)
+template <typename NodeAllocator>
+void delete_tree(NodeAllocator &alloc,
+                 typename std::allocator_traits<NodeAllocator>::pointer root) {
+  using node_type = typename std::allocator_traits<NodeAllocator>::value_type;
+  if constexpr (is_node_pool<NodeAllocator>::value &&
+                std::is_trivially_destructible_v<node_type>) {
+    // nothing to run per node, the pool drops its chunks
+    alloc.release();
+    return;
+  }
+  // rotate left children up until the node has none, then free it and go
+  // right, so no queue is needed
+  while (root) {
+    if (root->left) {
+      node_type *left = root->left;
+      root->left = left->right;
+      left->right = root;
+      root = left;
+    } else {
+      node_type *right = root->right;
+      delete_node(alloc, root);
+      root = right;
+    }
+  }
+}
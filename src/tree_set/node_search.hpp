@@ -0,0 +1,142 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// layout and in-node search of the b-tree / b+ tree nodes
+//
+// the node order follows from a byte budget instead of a fixed fan out: the
+// keys sit first in the node, aligned to a cache line, followed by the child
+// pointers, so a node of node_order<Key>(256) spans four lines of which the
+// search touches only the key part
+//
+// the in-node search counts the keys below the probe. for 4 and 8 byte
+// integer keys it compares a whole avx2 register of keys at once and
+// popcounts the mask (checked at run time, no compiler flag needed), above
+// LINEAR_WINDOW keys a binary search first narrows the range down
+
+#if (defined(__x86_64__) || defined(__i386__)) &&                              \
+    (defined(__GNUC__) || defined(__clang__))
+#define NODE_SEARCH_AVX2 1
+#include <immintrin.h>
+#define NODE_SEARCH_TARGET __attribute__((target("avx2,popcnt")))
+#endif
+
+constexpr size_t CACHE_LINE = 64;
+
+// bytes of a node besides keys and children: counts, parent, parent_pos
+constexpr size_t NODE_HEADER = 32;
+
+// node size the sets use when no order is given
+constexpr size_t DEFAULT_NODE_BYTES = 256;
+
+// the largest order (children per node, keys + 1) whose node fits in bytes,
+// at least 3
+template <typename Key> constexpr int node_order(size_t bytes) {
+  size_t room = bytes > NODE_HEADER ? bytes - NODE_HEADER : 0;
+  // order - 1 keys and order children
+  size_t order = (room + sizeof(Key)) / (sizeof(Key) + sizeof(void *));
+  return order < 3 ? 3 : static_cast<int>(order);
+}
+
+namespace node_search {
+
+constexpr int LINEAR_WINDOW = 64;
+
+namespace detail {
+
+template <typename Key>
+constexpr bool simd_v = std::is_integral_v<Key> &&
+                        (sizeof(Key) == 4 || sizeof(Key) == 8) &&
+                        !std::is_same_v<Key, bool>;
+
+template <typename Key> int count_less_scalar(const Key *keys, int n,
+                                              const Key &key) {
+  int count = 0;
+  while (count < n && keys[count] < key) {
+    count++;
+  }
+  return count;
+}
+
+#ifdef NODE_SEARCH_AVX2
+
+inline bool has_avx2() {
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+  return avx2;
+}
+
+// keys[0, n) are sorted, the count of the ones below key
+template <typename Key>
+NODE_SEARCH_TARGET int count_less_avx2(const Key *keys, int n,
+                                       const Key &key) {
+  constexpr int lanes = static_cast<int>(32 / sizeof(Key));
+  // signed compares only, unsigned keys are flipped into signed order
+  constexpr bool flip = std::is_unsigned_v<Key>;
+  int count = 0;
+  int i = 0;
+  if constexpr (sizeof(Key) == 4) {
+    const __m256i bias = _mm256_set1_epi32(flip ? INT32_MIN : 0);
+    const __m256i probe = _mm256_xor_si256(
+        _mm256_set1_epi32(static_cast<int32_t>(key)), bias);
+    for (; i + lanes <= n; i += lanes) {
+      __m256i v = _mm256_xor_si256(
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys + i)),
+          bias);
+      int mask = _mm256_movemask_ps(
+          _mm256_castsi256_ps(_mm256_cmpgt_epi32(probe, v)));
+      count += __builtin_popcount(mask);
+      if (mask != 0xff) {
+        // sorted, the keys from here on are not below key
+        return count;
+      }
+    }
+  } else {
+    const __m256i bias = _mm256_set1_epi64x(flip ? INT64_MIN : 0);
+    const __m256i probe = _mm256_xor_si256(
+        _mm256_set1_epi64x(static_cast<int64_t>(key)), bias);
+    for (; i + lanes <= n; i += lanes) {
+      __m256i v = _mm256_xor_si256(
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys + i)),
+          bias);
+      int mask = _mm256_movemask_pd(
+          _mm256_castsi256_pd(_mm256_cmpgt_epi64(probe, v)));
+      count += __builtin_popcount(mask);
+      if (mask != 0xf) {
+        return count;
+      }
+    }
+  }
+  return count + count_less_scalar(keys + i, n - i, key);
+}
+
+#endif
+
+} // namespace detail
+
+// index of the first of the sorted keys[0, n) not below key
+template <typename Key>
+int lower_bound(const Key *keys, int n, const Key &key) {
+  if constexpr (detail::simd_v<Key>) {
+    int lo = 0, hi = n;
+    while (hi - lo > LINEAR_WINDOW) {
+      int mid = lo + (hi - lo) / 2;
+      if (keys[mid] < key) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+#ifdef NODE_SEARCH_AVX2
+    if (detail::has_avx2()) {
+      return lo + detail::count_less_avx2(keys + lo, hi - lo, key);
+    }
+#endif
+    return lo + detail::count_less_scalar(keys + lo, hi - lo, key);
+  } else {
+    return static_cast<int>(std::lower_bound(keys, keys + n, key) - keys);
+  }
+}
+
+} // namespace node_search
@@ -0,0 +1,327 @@
+#pragma once
+
+// redo log of the logical operations on a set (insert / remove of a key)
+//
+// a record is its log sequence number, the operation, the key bytes and a
+// checksum. the records go to segment files named by the lsn of their first
+// record, prefix.00000000000000000001 and so on, so a checkpoint can drop
+// the segments it covers as whole files. a torn or corrupt record ends the
+// readable part of its segment
+//
+// append() only buffers, commit(lsn) returns once the record is on the
+// device. the committers share the syncs (group commit): the first one to
+// find the buffer not yet durable writes and syncs everything appended so
+// far, the ones arriving meanwhile wait and are then either covered by it
+// or the next one to go
+//
+// a failed write or sync leaves the log failed: the records it held may be
+// torn on the device, so every later append, commit and rotate throws
+// instead of writing behind them
+//
+// posix only, built with buffer_pool.hpp under TREE_SET_PAGED
+
+#include "buffer_pool.hpp"
+
+#ifdef TREE_SET_PAGED
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+enum class log_op : uint8_t { insert = 1, remove = 2 };
+
+namespace redo_log_detail {
+
+// fnv-1a, enough to tell a torn record from a whole one
+inline uint32_t checksum(const char *data, size_t n) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < n; i++) {
+    hash = (hash ^ static_cast<unsigned char>(data[i])) * 16777619u;
+  }
+  return hash;
+}
+
+inline void write_all(int fd, const char *data, size_t n) {
+  while (n > 0) {
+    ssize_t res = ::write(fd, data, n);
+    if (res < 0 && errno == EINTR) {
+      continue;
+    }
+    if (res <= 0) {
+      throw std::runtime_error("failed to write log");
+    }
+    data += res;
+    n -= static_cast<size_t>(res);
+  }
+}
+
+// makes the creation / removal of the files in dir durable
+inline void sync_directory(const std::string &dir) {
+  int fd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY);
+  if (fd >= 0) {
+    ::fsync(fd);
+    ::close(fd);
+  }
+}
+
+} // namespace redo_log_detail
+
+template <typename Key> class redo_log {
+  static_assert(std::is_trivially_copyable_v<Key>,
+                "the keys are logged as their bytes");
+
+public:
+  struct record {
+    uint64_t lsn{};
+    log_op op{};
+    Key key{};
+  };
+
+  // records appended, syncs and bytes written
+  struct stats {
+    uint64_t records{};
+    uint64_t syncs{};
+    uint64_t bytes{};
+  };
+
+  // lsn, op, key, checksum
+  static constexpr size_t RECORD_BYTES = 8 + 1 + sizeof(Key) + 4;
+
+  // the segments of prefix as (first lsn, path) in lsn order
+  static std::vector<std::pair<uint64_t, std::string>>
+  segments(const std::string &prefix) {
+    namespace fs = std::filesystem;
+    fs::path base{prefix};
+    fs::path dir = base.parent_path().empty() ? fs::path{"."}
+                                              : base.parent_path();
+    std::string name = base.filename().string() + ".";
+    std::vector<std::pair<uint64_t, std::string>> res{};
+    for (const auto &entry : fs::directory_iterator{dir}) {
+      std::string file = entry.path().filename().string();
+      if (file.size() != name.size() + LSN_DIGITS ||
+          file.compare(0, name.size(), name) != 0 ||
+          file.find_first_not_of("0123456789", name.size()) !=
+              std::string::npos) {
+        continue;
+      }
+      res.emplace_back(std::stoull(file.substr(name.size())),
+                       entry.path().string());
+    }
+    std::sort(res.begin(), res.end());
+    return res;
+  }
+
+  // the records of a segment up to the first torn or corrupt one
+  static std::vector<record> read_segment(const std::string &path) {
+    std::vector<record> res{};
+    std::FILE *file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+      throw std::runtime_error("failed to open " + path);
+    }
+    char buf[RECORD_BYTES];
+    while (std::fread(buf, 1, RECORD_BYTES, file) == RECORD_BYTES) {
+      uint32_t check{};
+      std::memcpy(&check, buf + RECORD_BYTES - 4, 4);
+      if (check != redo_log_detail::checksum(buf, RECORD_BYTES - 4)) {
+        break;
+      }
+      record r{};
+      std::memcpy(&r.lsn, buf, 8);
+      std::memcpy(&r.op, buf + 8, 1);
+      std::memcpy(&r.key, buf + 9, sizeof(Key));
+      if (!res.empty() && r.lsn != res.back().lsn + 1) {
+        break;
+      }
+      res.push_back(r);
+    }
+    std::fclose(file);
+    return res;
+  }
+
+  // logs into a new segment whose first record gets next_lsn
+  redo_log(std::string prefix, uint64_t next_lsn)
+      : m_prefix(std::move(prefix)), m_last(next_lsn - 1),
+        m_durable(next_lsn - 1) {
+    open_segment();
+  }
+
+  // the records not committed yet are lost
+  ~redo_log() {
+    if (m_fd >= 0) {
+      ::close(m_fd);
+    }
+  }
+
+  redo_log(const redo_log &) = delete;
+  redo_log &operator=(const redo_log &) = delete;
+
+  // buffers a record and returns its lsn, the caller orders the appends the
+  // way the operations are applied
+  uint64_t append(log_op op, const Key &key) {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    throw_if_failed();
+    uint64_t lsn = ++m_last;
+    size_t at = m_buffer.size();
+    m_buffer.resize(at + RECORD_BYTES);
+    char *buf = m_buffer.data() + at;
+    std::memcpy(buf, &lsn, 8);
+    std::memcpy(buf + 8, &op, 1);
+    std::memcpy(buf + 9, &key, sizeof(Key));
+    uint32_t check = redo_log_detail::checksum(buf, RECORD_BYTES - 4);
+    std::memcpy(buf + RECORD_BYTES - 4, &check, 4);
+    m_segment_records++;
+    m_stats.records++;
+    return lsn;
+  }
+
+  uint64_t last_lsn() const {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_last;
+  }
+
+  // returns once the record lsn is on the device
+  void commit(uint64_t lsn) {
+    std::unique_lock<std::mutex> lock{m_mutex};
+    while (m_durable < lsn) {
+      throw_if_failed();
+      if (m_flushing) {
+        m_cv.wait(lock);
+        continue;
+      }
+      // this one writes for everybody appended so far
+      m_flushing = true;
+      std::vector<char> out{};
+      out.swap(m_buffer);
+      m_buffer.swap(m_spare);
+      uint64_t target = m_last;
+      int fd = m_fd;
+      lock.unlock();
+      try {
+        redo_log_detail::write_all(fd, out.data(), out.size());
+        if (page_file::sync_fd(fd) != 0) {
+          throw std::runtime_error("failed to sync log");
+        }
+      } catch (...) {
+        lock.lock();
+        m_failed = true;
+        m_flushing = false;
+        m_cv.notify_all();
+        throw;
+      }
+      lock.lock();
+      m_stats.syncs++;
+      m_stats.bytes += out.size();
+      m_durable = target;
+      m_flushing = false;
+      out.clear();
+      m_spare.swap(out);
+      m_cv.notify_all();
+    }
+  }
+
+  // makes the current segment durable and starts the next one, a checkpoint
+  // through last_lsn() then covers whole segments. nothing to do while the
+  // current segment is empty
+  void rotate() {
+    std::unique_lock<std::mutex> lock{m_mutex};
+    m_cv.wait(lock, [&]() { return !m_flushing; });
+    throw_if_failed();
+    if (m_segment_records == 0) {
+      return;
+    }
+    try {
+      redo_log_detail::write_all(m_fd, m_buffer.data(), m_buffer.size());
+      if (page_file::sync_fd(m_fd) != 0) {
+        throw std::runtime_error("failed to sync log");
+      }
+      m_stats.syncs++;
+      m_stats.bytes += m_buffer.size();
+      m_buffer.clear();
+      m_durable = m_last;
+      ::close(m_fd);
+      m_fd = -1;
+      open_segment();
+    } catch (...) {
+      m_failed = true;
+      m_cv.notify_all();
+      throw;
+    }
+    m_cv.notify_all();
+  }
+
+  // removes the segments whose records are all at most lsn, never the
+  // current one
+  void drop_through(uint64_t lsn) {
+    auto all = segments(m_prefix);
+    bool dropped = false;
+    for (size_t i = 0; i + 1 < all.size() && all[i + 1].first <= lsn + 1;
+         i++) {
+      std::remove(all[i].second.c_str());
+      dropped = true;
+    }
+    if (dropped) {
+      redo_log_detail::sync_directory(directory());
+    }
+  }
+
+  stats io_stats() const {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_stats;
+  }
+
+private:
+  static constexpr size_t LSN_DIGITS = 20;
+
+  void throw_if_failed() const {
+    if (m_failed) {
+      throw std::runtime_error("log failed on an earlier write");
+    }
+  }
+
+  std::string directory() const {
+    return std::filesystem::path{m_prefix}.parent_path().string();
+  }
+
+  void open_segment() {
+    std::string lsn = std::to_string(m_last + 1);
+    std::string path =
+        m_prefix + "." + std::string(LSN_DIGITS - lsn.size(), '0') + lsn;
+    m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (m_fd < 0) {
+      throw std::runtime_error("failed to open " + path);
+    }
+    redo_log_detail::sync_directory(directory());
+    m_segment_records = 0;
+  }
+
+private:
+  std::string m_prefix{};
+  int m_fd{-1};
+  mutable std::mutex m_mutex{};
+  std::condition_variable m_cv{};
+  // appended, not yet written
+  std::vector<char> m_buffer{};
+  std::vector<char> m_spare{};
+  uint64_t m_last{};
+  uint64_t m_durable{};
+  uint64_t m_segment_records{};
+  bool m_flushing{};
+  // a write or sync failed, see above
+  bool m_failed{};
+  stats m_stats{};
+};
+
+#endif
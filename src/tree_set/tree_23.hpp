@@ -1,6 +1,7 @@
 #pragma once
 
 #include "config.hpp"
+#include "tree_iterator.hpp"
 
 #include <array>
 #include <iostream>
@@ -87,7 +88,123 @@ public:
 
   void remove(const Key &key) { root = remove_tree(root, key); }
 
+  using iterator = tree_iterator<tree_23_set>;
+  using const_iterator = iterator;
+
+  iterator begin() const { return {this, leftmost(root)}; }
+
+  iterator end() const { return {this, nullptr}; }
+
+  // the first key not below key
+  iterator lower_bound(const Key &key) const {
+    tree_node *node = root;
+    tree_node *bound{};
+    int bound_pos{};
+    while (node) {
+      if (!(node->key0.value() < key)) {
+        if (!(key < node->key0.value())) {
+          return {this, node, 0};
+        }
+        bound = node;
+        bound_pos = 0;
+        node = node->left;
+      } else if (node->is_3_node() && !(node->key1.value() < key)) {
+        if (!(key < node->key1.value())) {
+          return {this, node, 1};
+        }
+        bound = node;
+        bound_pos = 1;
+        node = node->middle;
+      } else {
+        node = node->right;
+      }
+    }
+    return {this, bound, bound_pos};
+  }
+
+  // the first key above key
+  iterator upper_bound(const Key &key) const {
+    iterator iter = lower_bound(key);
+    if (iter != end() && !(key < *iter)) {
+      ++iter;
+    }
+    return iter;
+  }
+
+  // the keys in [lo, hi)
+  tree_range<iterator> range(const Key &lo, const Key &hi) const {
+    if (hi < lo) {
+      return {end(), end()};
+    }
+    return {lower_bound(lo), lower_bound(hi)};
+  }
+
 private:
+  friend class tree_iterator<tree_23_set>;
+
+  // pos 0 is key0, pos 1 is key1 of a 3 node
+  static const Key &iter_key(const tree_node *node, int pos) {
+    return pos == 0 ? node->key0.value() : node->key1.value();
+  }
+
+  static tree_node *leftmost(tree_node *node) {
+    while (node && node->left) {
+      node = node->left;
+    }
+    return node;
+  }
+
+  static void iter_next(tree_node *&node, int &pos) {
+    if (!node->is_leaf()) {
+      // the smallest key of the subtree right of the key
+      node = leftmost(pos == 0 && node->is_3_node() ? node->middle
+                                                    : node->right);
+      pos = 0;
+      return;
+    }
+    if (pos == 0 && node->is_3_node()) {
+      pos = 1;
+      return;
+    }
+    // climb until we come up from a child that has a key on its right
+    while (node->parent && node->parent->right == node) {
+      node = node->parent;
+    }
+    tree_node *parent = node->parent;
+    pos = parent && parent->left != node ? 1 : 0;
+    node = parent;
+  }
+
+  static void iter_prev(tree_node *&node, int &pos) {
+    if (!node->is_leaf()) {
+      node = pos == 0 ? node->left : node->middle;
+      while (!node->is_leaf()) {
+        node = node->right;
+      }
+      pos = node->is_3_node() ? 1 : 0;
+      return;
+    }
+    if (pos == 1) {
+      pos = 0;
+      return;
+    }
+    while (node->parent && node->parent->left == node) {
+      node = node->parent;
+    }
+    tree_node *parent = node->parent;
+    // from the right child the last key of parent, from the middle key0
+    pos = parent && parent->right == node && parent->is_3_node() ? 1 : 0;
+    node = parent;
+  }
+
+  void iter_last(tree_node *&node, int &pos) const {
+    node = root;
+    while (node && !node->is_leaf()) {
+      node = node->right;
+    }
+    pos = node && node->is_3_node() ? 1 : 0;
+  }
+
   static void destroy_tree(tree_node *root) {
     std::queue<tree_node *> q{};
     q.push(root);
@@ -320,10 +437,13 @@ private:
           to_string(curr).c_str());
 
       // 交换值，然后删除叶子节点
+      // the predecessor is the last key of the leaf, key1 of a 3 node
+      std::optional<Key> &prev_key =
+          curr->is_3_node() ? curr->key1 : curr->key0;
       if (node->is_2_node()) {
-        std::swap(curr->key0, node->key0);
+        std::swap(prev_key, node->key0);
       } else {
-        std::swap(curr->key0,
+        std::swap(prev_key,
                   node->key0.value() == key ? node->key0 : node->key1);
       }
       node = curr;
@@ -1,26 +1,72 @@
 #pragma once
 
 #include "config.hpp"
+#include "node_pool.hpp"
+#include "tree_iterator.hpp"
 
+#include <cstdlib>
+#include <functional>
 #include <iostream>
-#include <queue>
+#include <memory>
+#include <new>
 #include <sstream>
 #include <string>
+#include <type_traits>
+#include <utility>
 
-template <typename Key> class avl_set {
+template <typename Key, typename Allocator = node_pool<Key>> class avl_set {
 public:
   using key_type = Key;
   avl_set() = default;
 
-  ~avl_set() { destory_tree(root); }
+  ~avl_set() { delete_tree(alloc, root); }
 
   bool search(const Key &key) {
     return static_cast<bool>(search_tree(root, key));
   }
 
-  void insert(const Key &key) { root = insert_tree(root, key); }
+  void insert(const Key &key) {
+    root = insert_tree(root, key);
+    root->parent = nullptr;
+  }
+
+  void remove(const Key &key) {
+    root = remove_tree(root, key);
+    if (root) {
+      root->parent = nullptr;
+    }
+  }
+
+  using iterator = tree_iterator<avl_set>;
+  using const_iterator = iterator;
 
-  void remove(const Key &key) { root = remove_tree(root, key); }
+  iterator begin() const {
+    return {this, tree_iterator_detail::leftmost(root)};
+  }
+
+  iterator end() const { return {this, nullptr}; }
+
+  // the first key not below key
+  iterator lower_bound(const Key &key) const {
+    return {this, tree_iterator_detail::lower_bound(root, key)};
+  }
+
+  // the first key above key
+  iterator upper_bound(const Key &key) const {
+    iterator iter = lower_bound(key);
+    if (iter != end() && !(key < *iter)) {
+      ++iter;
+    }
+    return iter;
+  }
+
+  // the keys in [lo, hi)
+  tree_range<iterator> range(const Key &lo, const Key &hi) const {
+    if (hi < lo) {
+      return {end(), end()};
+    }
+    return {lower_bound(lo), lower_bound(hi)};
+  }
 
   std::string to_string() const {
     std::stringstream s;
@@ -36,15 +82,37 @@ public:
     return s.str();
   }
 
+  // the stored heights, the balance factors and the parent links
+  bool check() const { return check(root, nullptr) >= 0; }
+
 private:
   struct tree_node {
     Key key{};
     tree_node *left{};
     tree_node *right{};
     int height{1};
+    tree_node *parent{};
   };
+  using node_allocator = typename std::allocator_traits<
+      Allocator>::template rebind_alloc<tree_node>;
 
 private:
+  friend class tree_iterator<avl_set>;
+
+  static const Key &iter_key(const tree_node *node, int) { return node->key; }
+
+  static void iter_next(tree_node *&node, int &) {
+    node = tree_iterator_detail::successor(node);
+  }
+
+  static void iter_prev(tree_node *&node, int &) {
+    node = tree_iterator_detail::predecessor(node);
+  }
+
+  void iter_last(tree_node *&node, int &) const {
+    node = tree_iterator_detail::rightmost(root);
+  }
+
   static std::string to_string(tree_node *node) {
     std::stringstream s;
     if (node) {
@@ -60,26 +128,12 @@ private:
     node->height = 1 + std::max(height(node->left), height(node->right));
   }
 
-  static void destory_tree(tree_node *root) {
-    std::queue<tree_node *> queue{};
-    queue.push(root);
-    while (!queue.empty()) {
-      tree_node *curr = queue.front();
-      queue.pop();
-      if (curr) {
-        queue.push(curr->left);
-        queue.push(curr->right);
-        // std::cout << "delete " << to_string(curr) << std::endl;
-        delete curr;
-      }
-    }
-  }
-
   static tree_node *left_rotate(tree_node *node) {
     assert(node->right);
     tree_node *right = node->right;
-    node->right = right->left;
-    right->left = node;
+    // the parent of right is linked by the caller
+    R(node, right->left);
+    L(right, node);
     // 需要重新调整高度
     update_height(node);
     update_height(right);
@@ -89,8 +143,8 @@ private:
   static tree_node *right_rotate(tree_node *node) {
     assert(node->left);
     tree_node *left = node->left;
-    node->left = left->right;
-    left->right = node;
+    L(node, left->right);
+    R(left, node);
     update_height(node);
     update_height(left);
     return left;
@@ -98,6 +152,23 @@ private:
 
   static int height(tree_node *node) { return node ? node->height : 0; }
 
+  // the height of the subtree, -1 when it breaks an invariant
+  static int check(tree_node *node, tree_node *parent) {
+    if (!node) {
+      return 0;
+    }
+    if (node->parent != parent) {
+      return -1;
+    }
+    int left = check(node->left, node);
+    int right = check(node->right, node);
+    if (left < 0 || right < 0 || std::abs(left - right) > 1 ||
+        node->height != 1 + std::max(left, right)) {
+      return -1;
+    }
+    return node->height;
+  }
+
   static tree_node *rebalance(tree_node *root) {
     if (!root) {
       return root;
@@ -114,7 +185,8 @@ private:
       tree_node *right = root->right;
       assert(right);
       if (height(right->left) > height(right->right)) {
-        root->right = right_rotate(root->right);
+        right = right_rotate(right);
+        R(root, right);
       }
       root = left_rotate(root);
       // 需要重新调整高度
@@ -122,34 +194,39 @@ private:
       tree_node *left = root->left;
       assert(left);
       if (height(left->right) > height(left->left)) {
-        root->left = left_rotate(root->left);
+        left = left_rotate(left);
+        L(root, left);
       }
       root = right_rotate(root);
     }
     return root;
   }
 
-  static tree_node *insert_tree(tree_node *root, const Key &key) {
+  tree_node *insert_tree(tree_node *root, const Key &key) {
     using std::cout, std::endl;
     if (root == nullptr) {
-      return new tree_node{key};
+      return new_node(alloc, key);
     }
     if (root->key > key) {
-      root->left = insert_tree(root->left, key);
+      tree_node *left = insert_tree(root->left, key);
+      L(root, left);
     } else if (root->key < key) {
-      root->right = insert_tree(root->right, key);
+      tree_node *right = insert_tree(root->right, key);
+      R(root, right);
     }
     return rebalance(root);
   }
 
-  static tree_node *remove_tree(tree_node *root, const Key &key) {
+  tree_node *remove_tree(tree_node *root, const Key &key) {
     if (root == nullptr) {
       return root;
     }
     if (root->key > key) {
-      root->left = remove_tree(root->left, key);
+      tree_node *left = remove_tree(root->left, key);
+      L(root, left);
     } else if (root->key < key) {
-      root->right = remove_tree(root->right, key);
+      tree_node *right = remove_tree(root->right, key);
+      R(root, right);
     } else {
       if (root->left && root->right) {
         tree_node *prev = root->left;
@@ -157,12 +234,14 @@ private:
           prev = prev->right;
         }
         std::swap(prev->key, root->key);
-        root->left = remove_tree(root->left, key);
+        tree_node *left = remove_tree(root->left, key);
+        L(root, left);
       } else if (!root->left && !root->right) {
-        delete root;
+        delete_node(alloc, root);
+        root = nullptr;
       } else if ((root->left && !root->right) || (root->right && !root->left)) {
         tree_node *child = root->left ? root->left : root->right;
-        delete root;
+        delete_node(alloc, root);
         root = child;
       }
     }
@@ -207,4 +286,5 @@ private:
 
 private:
   tree_node *root{};
+  node_allocator alloc{};
 };
\ No newline at end of file
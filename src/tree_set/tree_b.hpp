@@ -1,11 +1,20 @@
+#pragma once
+
+#include "bulk_load.hpp"
 #include "config.hpp"
+#include "node_search.hpp"
+#include "tree_iterator.hpp"
 #include <array>
 #include <functional>
 #include <iostream>
+#include <iterator>
 #include <queue>
 #include <sstream>
+#include <vector>
 
-template <typename Key, int MAX_NODE_COUNT = 5> class b_set {
+template <typename Key,
+          int MAX_NODE_COUNT = node_order<Key>(DEFAULT_NODE_BYTES)>
+class b_set {
 public:
   // follow knuth b-tree definition
   static constexpr int MIN_KEY_COUNT = (MAX_NODE_COUNT + 1) / 2 - 1;
@@ -24,12 +33,13 @@ public:
   }
 
 public:
-  struct tree_node {
-    int key_count{};
-    int node_count{};
+  // keys first and cache line aligned, the in-node search reads only them
+  struct alignas(CACHE_LINE) tree_node {
     // 多一个确保可以进行先插入再删除
     std::array<Key, MAX_KEY_COUNT> keys{};
     std::array<tree_node *, MAX_NODE_COUNT> nodes{};
+    int key_count{};
+    int node_count{};
     // 还需要存储一个当前 node 在 parent 中的位置信息
     tree_node *parent{};
     int parent_pos{};
@@ -64,28 +74,24 @@ public:
       if (!is_leaf()) {
         res &= (node_count == key_count + 1);
       }
+      res &= is_root() || key_count >= MIN_KEY_COUNT;
       return res;
     }
 
     bool contains(const Key &key) const {
-      auto end = keys.begin() + key_count;
-      auto iter = std::lower_bound(keys.begin(), end, key);
-      return iter != end && *iter == key;
+      int pos = range_search(key);
+      return pos != key_count && keys[pos] == key;
     }
 
     int position(const Key &key) const {
-      auto end = keys.begin() + key_count;
-      auto iter = std::lower_bound(keys.begin(), end, key);
-      int pos = iter - keys.begin();
+      int pos = range_search(key);
       assert(pos < key_count);
       return pos;
     }
 
+    // the first key not below key, key_count if there is none
     int range_search(const Key &key) const {
-      auto end = keys.begin() + key_count;
-      auto iter = std::lower_bound(keys.begin(), end, key);
-      return iter == keys.end() ? (key < keys[0] ? 0 : key_count)
-                                : iter - keys.begin();
+      return node_search::lower_bound(keys.data(), key_count, key);
     }
 
     tree_node *front_node() { return is_leaf() ? nullptr : nodes[0]; }
@@ -276,6 +282,140 @@ public:
 
   void remove(const Key &key) { root = remove_tree(root, key); }
 
+  // replaces the keys of the set by the sorted keys in [first, last), equal
+  // neighbours are kept once
+  template <typename Iterator>
+  void bulk_load(Iterator first, Iterator last, double fill_factor = 1.0) {
+    bulk_load_detail::iterator_cursor<Iterator> cursor{first, last};
+    bulk_load_from(cursor, fill_factor);
+  }
+
+  template <typename Range>
+  void bulk_load(const Range &keys, double fill_factor = 1.0) {
+    bulk_load(std::begin(keys), std::end(keys), fill_factor);
+  }
+
+  // same from a cursor, read once. the leaves get fill_factor of
+  // MAX_KEY_COUNT keys and the inner nodes of MAX_NODE_COUNT children (at
+  // least the minimum), built level by level in O(n) without a split
+  template <typename Cursor>
+  void bulk_load_from(Cursor &cursor, double fill_factor = 1.0) {
+    destroy_tree(root);
+    root = nullptr;
+    int leaf_keys = bulk_load_detail::node_fill(
+        fill_factor, std::max(MIN_KEY_COUNT, 1), MAX_KEY_COUNT);
+    // the nodes of one level and the keys between them
+    std::vector<tree_node *> level{};
+    std::vector<Key> seps{};
+    std::optional<Key> prev{};
+    for (; !cursor.empty(); cursor.pop()) {
+      Key key = cursor.front();
+      if (prev) {
+        assert(!(key < *prev) && "bulk_load needs sorted keys");
+        if (!(*prev < key)) {
+          continue;
+        }
+      }
+      prev = key;
+      if (level.empty()) {
+        level.push_back(new tree_node{});
+      } else if (level.back()->key_count == leaf_keys) {
+        // the key after a full leaf goes up, the next leaf starts after it
+        seps.push_back(key);
+        level.push_back(new tree_node{});
+        continue;
+      }
+      level.back()->push_back_key(key);
+    }
+    if (level.empty()) {
+      return;
+    }
+    size_t children = bulk_load_detail::node_fill(
+        fill_factor, MIN_KEY_COUNT + 1, MAX_NODE_COUNT);
+    balance_last(level, seps);
+    while (level.size() > 1) {
+      std::vector<tree_node *> parents{};
+      std::vector<Key> parent_seps{};
+      for (size_t i = 0; i < level.size(); i++) {
+        if (i % children == 0) {
+          if (i > 0) {
+            parent_seps.push_back(seps[i - 1]);
+          }
+          parents.push_back(new tree_node{});
+        } else {
+          parents.back()->push_back_key(seps[i - 1]);
+        }
+        parents.back()->push_back_node(level[i]);
+      }
+      level.swap(parents);
+      seps.swap(parent_seps);
+      balance_last(level, seps);
+    }
+    root = level[0];
+  }
+
+  // the links and the key counts of every node and the depth of the leaves,
+  // it visits the whole tree
+  bool check() const {
+    if (!root) {
+      return true;
+    }
+    int depth = 0;
+    for (tree_node *node = root; !node->is_leaf(); node = node->front_node()) {
+      depth++;
+    }
+    return root->valid() && leaf_depth(root, depth);
+  }
+
+  using iterator = tree_iterator<b_set>;
+  using const_iterator = iterator;
+
+  iterator begin() const {
+    tree_node *node = root;
+    while (node && !node->is_leaf()) {
+      node = node->front_node();
+    }
+    return {this, node};
+  }
+
+  iterator end() const { return {this, nullptr}; }
+
+  // the first key not below key
+  iterator lower_bound(const Key &key) const {
+    tree_node *node = root;
+    tree_node *bound{};
+    int bound_pos{};
+    while (node) {
+      int pos = node->range_search(key);
+      if (pos < node->key_count) {
+        if (!(key < node->keys[pos])) {
+          return {this, node, pos};
+        }
+        bound = node;
+        bound_pos = pos;
+      }
+      node = node->is_leaf() ? nullptr : node->nodes[pos];
+    }
+    return {this, bound, bound_pos};
+  }
+
+  // the first key above key
+  iterator upper_bound(const Key &key) const {
+    iterator iter = lower_bound(key);
+    if (iter != end() && !(key < *iter)) {
+      ++iter;
+    }
+    return iter;
+  }
+
+  // the keys in [lo, hi)
+  tree_range<iterator> range(const Key &lo, const Key &hi) const {
+    if (hi < lo) {
+      return {end(), end()};
+    }
+    return {lower_bound(lo), lower_bound(hi)};
+  }
+
   std::string to_string() const {
     std::stringstream os;
     os << "{ ";
@@ -292,6 +432,60 @@ public:
   }
 
 private:
+  friend class tree_iterator<b_set>;
+
+  static const Key &iter_key(const tree_node *node, int pos) {
+    return node->keys[pos];
+  }
+
+  static void iter_next(tree_node *&node, int &pos) {
+    if (!node->is_leaf()) {
+      // the first key of the subtree right of the key
+      node = node->nodes[pos + 1];
+      while (!node->is_leaf()) {
+        node = node->front_node();
+      }
+      pos = 0;
+      return;
+    }
+    if (++pos < node->key_count) {
+      return;
+    }
+    // climb out of last children, the key right of the child is next
+    while (node->parent && node->parent_pos == node->parent->key_count) {
+      node = node->parent;
+    }
+    pos = node->parent ? node->parent_pos : 0;
+    node = node->parent;
+  }
+
+  static void iter_prev(tree_node *&node, int &pos) {
+    if (!node->is_leaf()) {
+      node = node->nodes[pos];
+      while (!node->is_leaf()) {
+        node = node->back_node();
+      }
+      pos = node->key_count - 1;
+      return;
+    }
+    if (--pos >= 0) {
+      return;
+    }
+    while (node->parent && node->parent_pos == 0) {
+      node = node->parent;
+    }
+    pos = node->parent_pos - 1;
+    node = node->parent;
+  }
+
+  void iter_last(tree_node *&node, int &pos) const {
+    node = root;
+    while (node && !node->is_leaf()) {
+      node = node->back_node();
+    }
+    pos = node ? node->key_count - 1 : 0;
+  }
+
   static std::string to_string(tree_node *node) {
     if (!node) {
       return "tree_node{null}";
@@ -333,6 +527,67 @@ private:
     }
   }
 
+  static bool leaf_depth(tree_node *node, int depth) {
+    if (node->is_leaf()) {
+      return depth == 0;
+    }
+    for (int i = 0; i < node->node_count; i++) {
+      if (!leaf_depth(node->nodes[i], depth - 1)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // the last node of a level may be short (even empty): share the keys with
+  // its left neighbour, the middle one going between them, or merge the two
+  // with the key between them when they fit in one node
+  static void balance_last(std::vector<tree_node *> &level,
+                           std::vector<Key> &seps) {
+    tree_node *right = level.back();
+    if (level.size() < 2 || right->key_count >= std::max(MIN_KEY_COUNT, 1)) {
+      return;
+    }
+    tree_node *left = level[level.size() - 2];
+    std::vector<Key> keys(left->keys.begin(),
+                          left->keys.begin() + left->key_count);
+    keys.push_back(seps.back());
+    keys.insert(keys.end(), right->keys.begin(),
+                right->keys.begin() + right->key_count);
+    std::vector<tree_node *> nodes(left->nodes.begin(),
+                                   left->nodes.begin() + left->node_count);
+    nodes.insert(nodes.end(), right->nodes.begin(),
+                 right->nodes.begin() + right->node_count);
+    seps.pop_back();
+    left->key_count = left->node_count = 0;
+    right->key_count = right->node_count = 0;
+    int count = static_cast<int>(keys.size());
+    if (count <= MAX_KEY_COUNT) {
+      for (const Key &key : keys) {
+        left->push_back_key(key);
+      }
+      for (tree_node *node : nodes) {
+        left->push_back_node(node);
+      }
+      delete right;
+      level.pop_back();
+      return;
+    }
+    int half = count / 2;
+    for (int i = 0; i < count; i++) {
+      if (i < half) {
+        left->push_back_key(keys[i]);
+      } else if (i == half) {
+        seps.push_back(keys[i]);
+      } else {
+        right->push_back_key(keys[i]);
+      }
+    }
+    for (int i = 0; i < static_cast<int>(nodes.size()); i++) {
+      (i <= half ? left : right)->push_back_node(nodes[i]);
+    }
+  }
+
   static void destroy_tree(tree_node *root) {
     std::queue<tree_node *> q{};
     q.push(root);
@@ -529,19 +784,17 @@ private:
       LOG("merged node: %s\n", to_string(merge_node).c_str());
       delete delete_node;
       node = merge_node;
-      if (parent->key_count == 0) {
+      // only an empty root goes away, an empty inner node (MIN_KEY_COUNT
+      // of 1) is short like any other and the loop fixes it, dropping it
+      // would leave its leaves one level up
+      if (parent->key_count == 0 && parent->is_root()) {
         LOG("parent is empty!\n");
         LOG("node: %s\n", to_string(node).c_str());
-        node->parent = parent->parent;
-        node->parent_pos = parent->parent_pos;
+        node->parent = nullptr;
+        node->parent_pos = 0;
         delete parent;
-        if (node->parent) {
-          node->parent->nodes[node->parent_pos] = node;
-        } else {
-          root = node;
-          break;
-        }
-        parent = node;
+        root = node;
+        break;
       }
       // 进行下一步的删除
       node = parent;
@@ -1,16 +1,33 @@
+#pragma once
+
+#include "bulk_load.hpp"
 #include "config.hpp"
+#include "node_search.hpp"
+#include "tree_iterator.hpp"
+#include <algorithm>
 #include <array>
 #include <functional>
 #include <iostream>
+#include <iterator>
+#include <optional>
 #include <queue>
 #include <sstream>
+#include <thread>
+#include <utility>
+#include <vector>
 
-template <typename Key, int N = 5> class b_plus_set {
+template <typename Key,
+          int N = node_order<Key>(DEFAULT_NODE_BYTES)>
+class b_plus_set {
 public:
   static constexpr int MAX_NODE_COUNT = N;
   static constexpr int MIN_KEY_COUNT = (MAX_NODE_COUNT + 1) / 2 - 1;
   static constexpr int MAX_KEY_COUNT = MAX_NODE_COUNT - 1;
 
+  // smallest input slice / node slice worth a thread in parallel_bulk_load
+  static constexpr size_t PARALLEL_MIN_KEYS = 1 << 16;
+  static constexpr size_t PARALLEL_MIN_NODES = 1 << 10;
+
 public:
   static inline int new_count = 0;
 
@@ -25,18 +42,23 @@ public:
   }
 
 public:
-  struct tree_node {
-    int key_count{};
-    int node_count{};
+  // keys first and cache line aligned, the in-node search reads only them
+  struct alignas(CACHE_LINE) tree_node {
     // 多一个确保可以进行先插入再删除
     std::array<Key, MAX_KEY_COUNT> keys{};
     std::array<tree_node *, MAX_NODE_COUNT> nodes{};
+    int key_count{};
+    int node_count{};
     // 还需要存储一个当前 node 在 parent 中的位置信息
     tree_node *parent{};
     int parent_pos{};
 
     tree_node() { new_callback(); }
 
+    // made off the main thread, counted in new_count by the caller
+    struct uncounted {};
+    explicit tree_node(uncounted) {}
+
     ~tree_node() { delete_callback(); }
 
     bool is_leaf() const { return node_count == 0; }
@@ -45,57 +67,58 @@ public:
 
     bool full() const { return key_count > MAX_KEY_COUNT; }
 
-    void check() {
-      fflush(stdout);
+    bool valid() {
       LOG("check curr node: %s parent node: %s \n", to_string(this).c_str(),
           to_string(parent).c_str());
       // 检查当前节点的链接信息是否正确
+      bool res = true;
       if (parent) {
-        assert(parent->nodes[parent_pos] == this);
+        res &= parent->nodes[parent_pos] == this;
       } else {
-        assert(!prev() && !next());
+        res &= !prev() && !next();
       }
       // 然后检查子节点是否正确
       int count = 0;
       for (int i = 0; i < node_count; i++) {
-        nodes[i]->check();
+        res &= nodes[i]->valid();
         count++;
       }
-      assert(count == node_count);
+      res &= count == node_count;
+      res &= is_root() || key_count >= MIN_KEY_COUNT;
+      res &= key_count <= MAX_KEY_COUNT;
+      for (int i = 1; i < key_count; i++) {
+        res &= keys[i - 1] < keys[i];
+      }
       if (is_leaf()) {
         tree_node *prev = leaf_prev();
         tree_node *next = leaf_next();
-        assert(!prev || prev->leaf_next() == this);
-        assert(!next || next->leaf_prev() == this);
+        res &= !prev || prev->leaf_next() == this;
+        res &= !next || next->leaf_prev() == this;
       } else {
-        assert(node_count == key_count + 1);
+        res &= node_count == key_count + 1;
         // 每一个 nodes 中的 key 都必须在其中存在
-        for (int i = 0; i < key_count; i++) {
+        for (int i = 0; i < key_count && res; i++) {
           LOG("search leaf value %s\n", std::to_string(keys[i]).c_str());
-          assert(search_tree(nodes[i + 1], keys[i]));
+          res &= static_cast<bool>(search_tree(nodes[i + 1], keys[i]));
         }
       }
+      return res;
     }
 
     bool contains(const Key &key) const {
-      auto end = keys.begin() + key_count;
-      auto iter = std::lower_bound(keys.begin(), end, key);
-      return iter != end && *iter == key;
+      int pos = range_search(key);
+      return pos != key_count && keys[pos] == key;
     }
 
     int position(const Key &key) const {
-      auto end = keys.begin() + key_count;
-      auto iter = std::lower_bound(keys.begin(), end, key);
-      int pos = iter - keys.begin();
+      int pos = range_search(key);
       assert(pos < key_count);
       return pos;
     }
 
+    // the first key not below key, key_count if there is none
     int range_search(const Key &key) const {
-      auto end = keys.begin() + key_count;
-      auto iter = std::lower_bound(keys.begin(), end, key);
-      return iter == keys.end() ? (key < keys[0] ? 0 : key_count)
-                                : iter - keys.begin();
+      return node_search::lower_bound(keys.data(), key_count, key);
     }
 
     tree_node *front_node() { return is_leaf() ? nullptr : nodes[0]; }
@@ -312,16 +335,358 @@ public:
   void insert(const Key &key) {
     root = insert_tree(root, key);
     left_most = left_most_tree(root);
-    root->check();
   }
 
   void remove(const Key &key) {
     // TODO: B+ tree 的 remove 还有问题
     root = remove_tree(root, key);
     left_most = left_most_tree(root);
-    if (root) {
-      root->check();
+  }
+
+  // replaces the keys of the set by the sorted keys in [first, last), equal
+  // neighbours are kept once
+  template <typename Iterator>
+  void bulk_load(Iterator first, Iterator last, double fill_factor = 1.0) {
+    bulk_load_detail::iterator_cursor<Iterator> cursor{first, last};
+    bulk_load_from(cursor, fill_factor);
+  }
+
+  template <typename Range>
+  void bulk_load(const Range &keys, double fill_factor = 1.0) {
+    bulk_load(std::begin(keys), std::end(keys), fill_factor);
+  }
+
+  // same from a cursor, read once. the leaves get fill_factor of
+  // MAX_KEY_COUNT keys and are chained as they fill, the inner nodes get
+  // fill_factor of MAX_NODE_COUNT children (at least the minimum), built
+  // level by level in O(n) without a split
+  template <typename Cursor>
+  void bulk_load_from(Cursor &cursor, double fill_factor = 1.0) {
+    destroy_tree(root);
+    root = left_most = nullptr;
+    int leaf_keys = bulk_load_detail::node_fill(
+        fill_factor, std::max(MIN_KEY_COUNT, 1), MAX_KEY_COUNT);
+    // the nodes of one level and the keys between them
+    std::vector<tree_node *> level{};
+    std::vector<Key> seps{};
+    std::optional<Key> prev{};
+    for (; !cursor.empty(); cursor.pop()) {
+      Key key = cursor.front();
+      if (prev) {
+        assert(!(key < *prev) && "bulk_load needs sorted keys");
+        if (!(*prev < key)) {
+          continue;
+        }
+      }
+      prev = key;
+      if (level.empty() || level.back()->key_count == leaf_keys) {
+        tree_node *leaf = new tree_node{};
+        if (!level.empty()) {
+          leaf->leaf_prev() = level.back();
+          level.back()->leaf_next() = leaf;
+          // the first key of the leaf separates it from the previous one
+          seps.push_back(key);
+        }
+        level.push_back(leaf);
+      }
+      level.back()->push_back_key(key);
     }
+    if (level.empty()) {
+      return;
+    }
+    left_most = level[0];
+    size_t children = bulk_load_detail::node_fill(
+        fill_factor, MIN_KEY_COUNT + 1, MAX_NODE_COUNT);
+    balance_last(level, seps);
+    while (level.size() > 1) {
+      std::vector<tree_node *> parents{};
+      std::vector<Key> parent_seps{};
+      for (size_t i = 0; i < level.size(); i++) {
+        if (i % children == 0) {
+          if (i > 0) {
+            parent_seps.push_back(seps[i - 1]);
+          }
+          parents.push_back(new tree_node{});
+        } else {
+          parents.back()->push_back_key(seps[i - 1]);
+        }
+        parents.back()->push_back_node(level[i]);
+      }
+      level.swap(parents);
+      seps.swap(parent_seps);
+      balance_last(level, seps);
+    }
+    root = level[0];
+  }
+
+  // bulk_load of the sorted keys[0, n) on up to threads threads, 0 for the
+  // hardware concurrency. the unique keys are counted per slice of the input,
+  // which fixes the leaf of every key, then the leaves are filled and chained
+  // per input slice and every inner level is built per slice of its nodes.
+  // the tree is the same as from bulk_load
+  void parallel_bulk_load(const Key *keys, size_t n, double fill_factor = 1.0,
+                          unsigned threads = 0) {
+    using bulk_load_detail::level_layout;
+    using bulk_load_detail::parallel_for;
+    destroy_tree(root);
+    root = left_most = nullptr;
+    if (threads == 0) {
+      threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    auto unique = [&](size_t i) {
+      assert((i == 0 || !(keys[i] < keys[i - 1])) &&
+             "bulk_load needs sorted keys");
+      return i == 0 || keys[i - 1] < keys[i];
+    };
+    // ranks[s] is the rank of the first unique key of input slice s
+    size_t slices = std::clamp<size_t>(n / PARALLEL_MIN_KEYS, 1, threads);
+    auto slice_first = [&](size_t s) { return n * s / slices; };
+    std::vector<size_t> ranks(slices + 1);
+    parallel_for(slices, threads, 1, [&](size_t first, size_t last) {
+      for (size_t s = first; s < last; s++) {
+        for (size_t i = slice_first(s); i < slice_first(s + 1); i++) {
+          ranks[s + 1] += unique(i);
+        }
+      }
+    });
+    for (size_t s = 0; s < slices; s++) {
+      ranks[s + 1] += ranks[s];
+    }
+    if (ranks[slices] == 0) {
+      return;
+    }
+
+    int leaf_keys = bulk_load_detail::node_fill(
+        fill_factor, std::max(MIN_KEY_COUNT, 1), MAX_KEY_COUNT);
+    level_layout layout = level_layout::make(
+        ranks[slices], leaf_keys, std::max(MIN_KEY_COUNT, 1), MAX_KEY_COUNT,
+        [](size_t two) { return two / 2; });
+    std::vector<tree_node *> level(layout.nodes);
+    size_t made = layout.nodes;
+    parallel_for(level.size(), threads, PARALLEL_MIN_NODES,
+                 [&](size_t first, size_t last) {
+                   for (size_t j = first; j < last; j++) {
+                     level[j] = new tree_node{typename tree_node::uncounted{}};
+                     level[j]->key_count = static_cast<int>(
+                         layout.first(j + 1) - layout.first(j));
+                   }
+                 });
+    // a leaf can span input slices, every slice writes its own keys and
+    // chains the leaves starting in it to their left neighbours
+    parallel_for(slices, threads, 1, [&](size_t first, size_t last) {
+      for (size_t s = first; s < last; s++) {
+        size_t rank = ranks[s];
+        size_t j = layout.node_of(rank);
+        for (size_t i = slice_first(s); i < slice_first(s + 1); i++) {
+          if (!unique(i)) {
+            continue;
+          }
+          if (rank == layout.first(j + 1)) {
+            j++;
+          }
+          if (rank == layout.first(j) && j > 0) {
+            level[j]->leaf_prev() = level[j - 1];
+            level[j - 1]->leaf_next() = level[j];
+          }
+          level[j]->keys[rank - layout.first(j)] = keys[i];
+          rank++;
+        }
+      }
+    });
+    left_most = level[0];
+
+    size_t children = bulk_load_detail::node_fill(
+        fill_factor, MIN_KEY_COUNT + 1, MAX_NODE_COUNT);
+    while (level.size() > 1) {
+      layout = level_layout::make(
+          level.size(), children, std::max(MIN_KEY_COUNT, 1) + 1,
+          MAX_NODE_COUNT,
+          [](size_t two) { return (two - 1) / 2 + 1; });
+      std::vector<tree_node *> parents(layout.nodes);
+      parallel_for(
+          parents.size(), threads, PARALLEL_MIN_NODES,
+          [&](size_t first, size_t last) {
+            for (size_t k = first; k < last; k++) {
+              tree_node *node = new tree_node{typename tree_node::uncounted{}};
+              for (size_t c = layout.first(k); c < layout.first(k + 1); c++) {
+                if (c > layout.first(k)) {
+                  node->push_back_key(front_key(level[c]));
+                }
+                node->push_back_node(level[c]);
+              }
+              parents[k] = node;
+            }
+          });
+      made += layout.nodes;
+      level.swap(parents);
+    }
+    root = level[0];
+    new_count += static_cast<int>(made);
+  }
+
+  void parallel_bulk_load(const std::vector<Key> &keys,
+                          double fill_factor = 1.0, unsigned threads = 0) {
+    parallel_bulk_load(keys.data(), keys.size(), fill_factor, threads);
+  }
+
+  // inserts the keys of [first, last), in any order. the batch is sorted and
+  // walked along the leaf chain: the keys of a leaf are merged into it at
+  // once and an overflowing leaf is cut into as many leaves as it needs, so
+  // the splits go up once per leaf instead of once per key
+  template <typename Iterator>
+  void insert_batch(Iterator first, Iterator last) {
+    std::vector<Key> batch = sorted_batch(first, last);
+    if (batch.empty()) {
+      return;
+    }
+    if (!root) {
+      root = new tree_node{};
+    }
+    tree_node *leaf{};
+    std::vector<Key> merged{};
+    for (auto key = batch.begin(); key != batch.end();) {
+      leaf = batch_leaf(leaf, *key);
+      auto run_end = leaf_run_end(leaf, key, batch.end());
+      merged.clear();
+      std::set_union(leaf->keys.begin(), leaf->keys.begin() + leaf->key_count,
+                     key, run_end, std::back_inserter(merged));
+      key = run_end;
+      if (static_cast<int>(merged.size()) == leaf->key_count) {
+        continue;
+      }
+      auto pieces = refill(leaf, merged, {});
+      tree_node *last_piece = pieces.empty() ? leaf : pieces.back().second;
+      grow(leaf, std::move(pieces));
+      leaf = last_piece;
+    }
+    left_most = left_most_tree(root);
+  }
+
+  template <typename Range> void insert_batch(const Range &keys) {
+    insert_batch(std::begin(keys), std::end(keys));
+  }
+
+  // removes the keys of [first, last), in any order, a leaf at a time like
+  // insert_batch: a leaf left short shares with or merges into a neighbour
+  // once, however many of its keys went
+  template <typename Iterator>
+  void erase_batch(Iterator first, Iterator last) {
+    std::vector<Key> batch = sorted_batch(first, last);
+    tree_node *leaf{};
+    std::vector<Key> kept{};
+    for (auto key = batch.begin(); root && key != batch.end();) {
+      leaf = batch_leaf(leaf, *key);
+      auto run_end = leaf_run_end(leaf, key, batch.end());
+      kept.clear();
+      std::set_difference(leaf->keys.begin(),
+                          leaf->keys.begin() + leaf->key_count, key, run_end,
+                          std::back_inserter(kept));
+      key = run_end;
+      if (static_cast<int>(kept.size()) == leaf->key_count) {
+        continue;
+      }
+      bool front_gone = kept.empty() || leaf->front_key() < kept.front();
+      leaf->key_count = 0;
+      for (const Key &k : kept) {
+        leaf->push_back_key(k);
+      }
+      // the separator in front of the leaf is its first key, an empty leaf
+      // that is the first child merges with the next one and takes its first
+      if (Key *sep = leaf_separator(leaf); sep && front_gone) {
+        if (leaf->key_count > 0) {
+          *sep = leaf->front_key();
+        } else if (leaf->parent_pos == 0) {
+          *sep = leaf->leaf_next()->front_key();
+        }
+      }
+      if (leaf->key_count < MIN_KEY_COUNT || leaf->key_count == 0) {
+        fix_underflow(leaf);
+        leaf = nullptr;
+      }
+    }
+    left_most = left_most_tree(root);
+  }
+
+  template <typename Range> void erase_batch(const Range &keys) {
+    erase_batch(std::begin(keys), std::end(keys));
+  }
+
+  // the iterators walk the leaf chain, the inner nodes are only read to find
+  // the first leaf of lower_bound
+  using iterator = tree_iterator<b_plus_set>;
+  using const_iterator = iterator;
+
+  iterator begin() const { return {this, left_most}; }
+
+  iterator end() const { return {this, nullptr}; }
+
+  // the first key not below key
+  iterator lower_bound(const Key &key) const {
+    auto [node, pos] = leaf_lower_bound(key);
+    return {this, node, pos};
+  }
+
+  // the first key above key
+  iterator upper_bound(const Key &key) const {
+    iterator iter = lower_bound(key);
+    if (iter != end() && !(key < *iter)) {
+      ++iter;
+    }
+    return iter;
+  }
+
+  // the keys in [lo, hi)
+  tree_range<iterator> range(const Key &lo, const Key &hi) const {
+    if (hi < lo) {
+      return {end(), end()};
+    }
+    return {lower_bound(lo), lower_bound(hi)};
+  }
+
+  // calls func on the keys in [lo, hi) a leaf at a time: the bound is only
+  // searched in the last leaf, the others are plain loops over their keys
+  template <typename Func>
+  void scan(const Key &lo, const Key &hi, Func &&func) const {
+    if (!(lo < hi)) {
+      return;
+    }
+    auto [node, pos] = leaf_lower_bound(lo);
+    for (; node; node = node->leaf_next(), pos = 0) {
+      // the chain is a dependent load, start it before reading the keys
+      __builtin_prefetch(node->leaf_next());
+      bool last_leaf = node->key_count > 0 && !(node->back_key() < hi);
+      int last = last_leaf ? node->range_search(hi) : node->key_count;
+      for (int i = pos; i < last; i++) {
+        func(node->keys[i]);
+      }
+      if (last_leaf) {
+        return;
+      }
+    }
+  }
+
+  // the links, the key counts and the leaf chain of every node, the depth of
+  // the leaves and the key order along the chain, it visits the whole tree,
+  // so it is not run on every insert / remove
+  bool check() const {
+    if (!root) {
+      return !left_most;
+    }
+    int depth = 0;
+    for (tree_node *node = root; !node->is_leaf(); node = node->front_node()) {
+      depth++;
+    }
+    if (!root->valid() || !leaf_depth(root, depth) ||
+        left_most != left_most_tree(root) || left_most->leaf_prev()) {
+      return false;
+    }
+    for (tree_node *leaf = left_most; leaf->leaf_next();
+         leaf = leaf->leaf_next()) {
+      if (!(leaf->back_key() < leaf->leaf_next()->front_key())) {
+        return false;
+      }
+    }
+    return true;
   }
 
   std::string to_string() const {
@@ -361,6 +726,292 @@ public:
     return os.str();
   }
 
+private:
+  friend class tree_iterator<b_plus_set>;
+
+  static const Key &iter_key(const tree_node *node, int pos) {
+    return node->keys[pos];
+  }
+
+  static bool leaf_depth(tree_node *node, int depth) {
+    if (node->is_leaf()) {
+      return depth == 0;
+    }
+    for (int i = 0; i < node->node_count; i++) {
+      if (!leaf_depth(node->nodes[i], depth - 1)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // the smallest key under node
+  static const Key &front_key(tree_node *node) {
+    while (!node->is_leaf()) {
+      node = node->front_node();
+    }
+    return node->front_key();
+  }
+
+  // the last node of a level may be short: share the keys with its left
+  // neighbour or merge the two when they fit in one node
+  static void balance_last(std::vector<tree_node *> &level,
+                           std::vector<Key> &seps) {
+    tree_node *right = level.back();
+    if (level.size() < 2 || right->key_count >= std::max(MIN_KEY_COUNT, 1)) {
+      return;
+    }
+    std::optional<Key> sep =
+        share_or_merge(level[level.size() - 2], right, seps.back());
+    seps.pop_back();
+    if (sep) {
+      seps.push_back(*sep);
+    } else {
+      delete right;
+      level.pop_back();
+    }
+  }
+
+  // spreads the keys of two neighbours evenly over them and returns the new
+  // separator, or merges them into left when they fit in one node and leaves
+  // right empty for the caller to unlink. leaves keep the separator as their
+  // first key, inner nodes take sep from between them
+  static std::optional<Key> share_or_merge(tree_node *left, tree_node *right,
+                                           const Key &sep) {
+    bool leaf = right->is_leaf();
+    std::vector<Key> keys(left->keys.begin(),
+                          left->keys.begin() + left->key_count);
+    if (!leaf) {
+      keys.push_back(sep);
+    }
+    keys.insert(keys.end(), right->keys.begin(),
+                right->keys.begin() + right->key_count);
+    std::vector<tree_node *> nodes(left->nodes.begin(),
+                                   left->nodes.begin() + left->node_count);
+    nodes.insert(nodes.end(), right->nodes.begin(),
+                 right->nodes.begin() + right->node_count);
+    left->key_count = left->node_count = 0;
+    right->key_count = right->node_count = 0;
+    int count = static_cast<int>(keys.size());
+    if (count <= MAX_KEY_COUNT) {
+      for (const Key &key : keys) {
+        left->push_back_key(key);
+      }
+      for (tree_node *node : nodes) {
+        left->push_back_node(node);
+      }
+      if (leaf) {
+        left->leaf_next() = right->leaf_next();
+        if (left->leaf_next()) {
+          left->leaf_next()->leaf_prev() = left;
+        }
+      }
+      return std::nullopt;
+    }
+    int half = count / 2;
+    for (int i = 0; i < count; i++) {
+      if (i < half) {
+        left->push_back_key(keys[i]);
+      } else if (i > half || leaf) {
+        right->push_back_key(keys[i]);
+      }
+    }
+    for (int i = 0; i < static_cast<int>(nodes.size()); i++) {
+      (i <= half ? left : right)->push_back_node(nodes[i]);
+    }
+    return keys[half];
+  }
+
+  template <typename Iterator>
+  static std::vector<Key> sorted_batch(Iterator first, Iterator last) {
+    std::vector<Key> batch(first, last);
+    std::sort(batch.begin(), batch.end());
+    batch.erase(std::unique(batch.begin(), batch.end()), batch.end());
+    return batch;
+  }
+
+  // the leaf of key, which is the one after leaf when key is below the first
+  // key of the leaf after that, else from a descent
+  tree_node *batch_leaf(tree_node *leaf, const Key &key) const {
+    if (leaf && (leaf = leaf->leaf_next())) {
+      tree_node *next = leaf->leaf_next();
+      if (!next || key < next->front_key()) {
+        return leaf;
+      }
+    }
+    return leaf_of(key);
+  }
+
+  // the end of the keys of [first, last) that go into leaf: a separator is
+  // the first key of the leaf right of it, so that one bounds them
+  template <typename Iterator>
+  static Iterator leaf_run_end(tree_node *leaf, Iterator first,
+                               Iterator last) {
+    tree_node *next = leaf->leaf_next();
+    return next ? std::lower_bound(first, last, next->front_key()) : last;
+  }
+
+  // the separator in front of leaf, null for the first leaf
+  static Key *leaf_separator(tree_node *leaf) {
+    tree_node *node = leaf;
+    while (node->parent && node->parent_pos == 0) {
+      node = node->parent;
+    }
+    return node->parent ? &node->parent->keys[node->parent_pos - 1] : nullptr;
+  }
+
+  // writes the keys (and for an inner node the children) into node and into
+  // as many new right neighbours as it takes to fit them, evenly. returns the
+  // neighbours with the keys that go up in front of them
+  static std::vector<std::pair<Key, tree_node *>>
+  refill(tree_node *node, const std::vector<Key> &keys,
+         const std::vector<tree_node *> &nodes) {
+    bool leaf = node->is_leaf();
+    size_t count = leaf ? keys.size() : nodes.size();
+    size_t most = leaf ? MAX_KEY_COUNT : MAX_NODE_COUNT;
+    size_t pieces = std::max<size_t>(1, (count + most - 1) / most);
+    std::vector<std::pair<Key, tree_node *>> added{};
+    tree_node *curr = node;
+    curr->key_count = curr->node_count = 0;
+    for (size_t q = 0; q < pieces; q++) {
+      size_t first = count * q / pieces;
+      size_t last = count * (q + 1) / pieces;
+      if (q > 0) {
+        tree_node *right = new tree_node{};
+        if (leaf) {
+          right->leaf_prev() = curr;
+          right->leaf_next() = curr->leaf_next();
+          if (right->leaf_next()) {
+            right->leaf_next()->leaf_prev() = right;
+          }
+          curr->leaf_next() = right;
+        }
+        added.emplace_back(leaf ? keys[first] : keys[first - 1], right);
+        curr = right;
+      }
+      for (size_t i = first; i < last; i++) {
+        if (leaf) {
+          curr->push_back_key(keys[i]);
+          continue;
+        }
+        if (i > first) {
+          curr->push_back_key(keys[i - 1]);
+        }
+        curr->push_back_node(nodes[i]);
+      }
+    }
+    return added;
+  }
+
+  // links the new right neighbours of node into its parent after it, the
+  // parent is cut in turn when it overflows, up to a new root
+  void grow(tree_node *node, std::vector<std::pair<Key, tree_node *>> added) {
+    std::vector<Key> keys{};
+    std::vector<tree_node *> nodes{};
+    while (!added.empty()) {
+      tree_node *parent = node->parent;
+      if (!parent) {
+        parent = root = new tree_node{};
+        parent->push_back_node(node);
+      }
+      int at = node->parent_pos;
+      keys.assign(parent->keys.begin(), parent->keys.begin() + at);
+      nodes.assign(parent->nodes.begin(), parent->nodes.begin() + at + 1);
+      for (auto &[key, right] : added) {
+        keys.push_back(key);
+        nodes.push_back(right);
+      }
+      keys.insert(keys.end(), parent->keys.begin() + at,
+                  parent->keys.begin() + parent->key_count);
+      nodes.insert(nodes.end(), parent->nodes.begin() + at + 1,
+                   parent->nodes.begin() + parent->node_count);
+      added = refill(parent, keys, nodes);
+      node = parent;
+    }
+  }
+
+  // node went short: share with or merge into a neighbour, a merge takes a
+  // key from the parent which may go short in turn
+  void fix_underflow(tree_node *node) {
+    while (!node->is_root() && node->key_count < MIN_KEY_COUNT) {
+      tree_node *parent = node->parent;
+      int pos = std::max(node->parent_pos - 1, 0);
+      tree_node *right = parent->nodes[pos + 1];
+      std::optional<Key> sep =
+          share_or_merge(parent->nodes[pos], right, parent->keys[pos]);
+      if (sep) {
+        parent->keys[pos] = *sep;
+        return;
+      }
+      parent->remove_key(pos);
+      parent->remove_node(pos + 1);
+      delete right;
+      node = parent;
+    }
+    if (root->key_count == 0) {
+      tree_node *child = root->is_leaf() ? nullptr : root->nodes[0];
+      delete root;
+      root = child;
+      if (root) {
+        root->parent = nullptr;
+        root->parent_pos = 0;
+      }
+    }
+  }
+
+  // the leaf position of the first key not below key, null if none
+  std::pair<tree_node *, int> leaf_lower_bound(const Key &key) const {
+    if (!root) {
+      return {nullptr, 0};
+    }
+    tree_node *node = leaf_of(key);
+    int pos = node->range_search(key);
+    skip_leaves(node, pos);
+    return {node, pos};
+  }
+
+  // the leaf key is in or would go in, the tree must not be empty
+  tree_node *leaf_of(const Key &key) const {
+    tree_node *node = root;
+    while (!node->is_leaf()) {
+      int pos = node->range_search(key);
+      // a key equal to the separator is the first one of the right child
+      if (pos < node->key_count && !(key < node->keys[pos])) {
+        pos++;
+      }
+      node = node->nodes[pos];
+    }
+    return node;
+  }
+
+  // move past the end of the leaf to the first key of the next one
+  static void skip_leaves(tree_node *&node, int &pos) {
+    while (node && pos >= node->key_count) {
+      node = node->leaf_next();
+      pos = 0;
+    }
+  }
+
+  static void iter_next(tree_node *&node, int &pos) {
+    ++pos;
+    skip_leaves(node, pos);
+  }
+
+  static void iter_prev(tree_node *&node, int &pos) {
+    while (--pos < 0) {
+      node = node->leaf_prev();
+      pos = node->key_count;
+    }
+  }
+
+  void iter_last(tree_node *&node, int &pos) const {
+    node = root;
+    while (node && !node->is_leaf()) {
+      node = node->back_node();
+    }
+    pos = node ? node->key_count - 1 : 0;
+  }
+
 public:
   static std::string to_string(tree_node *node) {
     if (!node) {
@@ -0,0 +1,391 @@
+#pragma once
+
+// paged_b_plus_set made durable by a redo log: an insert / remove returns
+// once its log record is on the device, the pages follow at checkpoints
+//
+// the operations are applied and logged in one order under a mutex, the
+// wait for the log is outside of it, so concurrent writers share their
+// syncs (redo_log's group commit). the buffer pool runs without steal: no
+// page reaches the file between checkpoints, the file always holds the tree
+// of the last checkpoint, whole, and the log since then is replayed on it.
+// the logical records are idempotent on a set, replaying a record already
+// in the pages changes nothing
+//
+// a checkpoint starts when half the pool is dirty or after a given number
+// of records. it is fuzzy: under the mutex it only rotates the log and
+// copies the dirty pages out of the pool (they stay pinned there until
+// written), the writers go on while the copies are written, first as a
+// whole to a double write file and synced, then in place and synced, after
+// which the log segments before it are dropped. a crash in the in place
+// writes is repaired from the double write file on the next open, a crash
+// before it is complete leaves the previous checkpoint untouched. recovery
+// reads at most the records since the last checkpoint started
+//
+// posix only, built with buffer_pool.hpp under TREE_SET_PAGED
+
+#include "redo_log.hpp"
+#include "tree_b_plus_paged.hpp"
+
+#ifdef TREE_SET_PAGED
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+template <typename Key, size_t PageSize = 4096> class logged_b_plus_set {
+public:
+  using key_type = Key;
+  using tree_type = paged_b_plus_set<Key, PageSize>;
+  using log_type = redo_log<Key>;
+
+  // a checkpoint needs room in the pool for the writers while its pages
+  // are pinned, so the pool is larger than for paged_b_plus_set
+  static constexpr size_t MIN_POOL_PAGES = 64;
+
+  // what the last open found and did
+  struct recovery_stats {
+    // pages copied back from the double write file
+    size_t restored_pages{};
+    // log records applied on top of the checkpoint
+    size_t replayed{};
+    // log segments behind a missing record, dropped unread
+    size_t dropped_segments{};
+    double ms{};
+  };
+
+  struct checkpoint_stats {
+    uint64_t checkpoints{};
+    uint64_t pages{};
+  };
+
+  // opens or creates the tree in path and recovers it: path.dwb is the
+  // double write file and path.wal.* are the log segments
+  explicit logged_b_plus_set(const std::string &path,
+                             size_t pool_pages = 1024,
+                             size_t checkpoint_records = 1 << 16)
+      : m_path(path), m_checkpoint_records(checkpoint_records),
+        m_restored(restore_double_write(path)),
+        m_tree(path, std::max(pool_pages, MIN_POOL_PAGES)) {
+    auto start = std::chrono::steady_clock::now();
+    m_tree.pool().set_no_steal(true);
+    m_applied = m_tree.lsn();
+    // the records after the checkpoint up to the first missing one. a corrupt
+    // record ends its segment early, the later segments cannot be replayed
+    // over the gap and are dropped, the new log would run into them
+    std::vector<typename log_type::record> records{};
+    uint64_t next = m_applied + 1;
+    for (auto &segment : log_type::segments(log_prefix())) {
+      if (segment.first > next) {
+        std::remove(segment.second.c_str());
+        m_recovery.dropped_segments++;
+        continue;
+      }
+      for (const auto &r : log_type::read_segment(segment.second)) {
+        if (r.lsn == next) {
+          records.push_back(r);
+          next++;
+        }
+      }
+    }
+    if (m_recovery.dropped_segments > 0) {
+      redo_log_detail::sync_directory(
+          std::filesystem::path{m_path}.parent_path().string());
+    }
+    m_log.emplace(log_prefix(), next);
+    std::unique_lock<std::mutex> lock{m_mutex};
+    for (const auto &r : records) {
+      apply(r.op, r.key);
+      m_applied = r.lsn;
+      m_recovery.replayed++;
+      if (auto snap = take_snapshot(false)) {
+        lock.unlock();
+        write_snapshot(*snap);
+        lock.lock();
+      }
+    }
+    m_recovery.restored_pages = m_restored;
+    m_recovery.ms = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+  }
+
+  // a last checkpoint, the next open has nothing to replay. when it fails
+  // the pages stay unwritten (the tree does not flush a pool without steal)
+  // and the next open replays the log instead
+  ~logged_b_plus_set() {
+    try {
+      checkpoint();
+    } catch (...) {
+    }
+  }
+
+  logged_b_plus_set(const logged_b_plus_set &) = delete;
+  logged_b_plus_set &operator=(const logged_b_plus_set &) = delete;
+
+  // durable when it returns, like remove
+  void insert(const Key &key) { run(log_op::insert, key); }
+
+  void remove(const Key &key) { run(log_op::remove, key); }
+
+  bool search(const Key &key) {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_tree.search(key);
+  }
+
+  template <typename Func>
+  void scan(const Key &lo, const Key &hi, Func &&func) {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_tree.scan(lo, hi, std::forward<Func>(func));
+  }
+
+  size_t size() {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_tree.size();
+  }
+
+  // waits for a checkpoint in progress and takes a full one
+  void checkpoint() {
+    std::unique_lock<std::mutex> lock{m_mutex};
+    m_cv.wait(lock, [&]() { return !m_checkpointing; });
+    std::optional<snapshot> snap = take_snapshot(true);
+    lock.unlock();
+    write_snapshot(*snap);
+  }
+
+  bool check() {
+    std::unique_lock<std::mutex> lock{m_mutex};
+    m_cv.wait(lock, [&]() { return !m_checkpointing; });
+    return m_tree.check();
+  }
+
+  const recovery_stats &recovery() const { return m_recovery; }
+
+  typename log_type::stats log_stats() const { return m_log->io_stats(); }
+
+  checkpoint_stats checkpoints() {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_checkpoint_stats;
+  }
+
+private:
+  // the dirty pages of a checkpoint through lsn
+  struct snapshot {
+    uint64_t lsn{};
+    std::vector<page_id> ids{};
+    std::vector<char> pages{};
+  };
+
+  // double write file: header, page ids, pages
+  struct double_write_header {
+    uint64_t magic{};
+    uint64_t lsn{};
+    uint32_t count{};
+    uint32_t page_size{};
+    uint32_t check{};
+    uint32_t padding{};
+  };
+
+  static constexpr uint64_t DOUBLE_WRITE_MAGIC = 0x6277646565727462;
+
+  std::string log_prefix() const { return m_path + ".wal"; }
+
+  static std::string double_write_path(const std::string &path) {
+    return path + ".dwb";
+  }
+
+  void apply(log_op op, const Key &key) {
+    if (op == log_op::insert) {
+      m_tree.insert(key);
+    } else {
+      m_tree.remove(key);
+    }
+  }
+
+  void run(log_op op, const Key &key) {
+    std::unique_lock<std::mutex> lock{m_mutex};
+    // while the pages of a checkpoint are pinned the writers only go on
+    // while a quarter of the pool is left for them
+    m_cv.wait(lock, [&]() {
+      buffer_pool &pool = m_tree.pool();
+      return !m_checkpointing ||
+             pool.pinned() + pool.dirty() + pool.frames() / 4 <=
+                 pool.frames();
+    });
+    uint64_t lsn = m_log->append(op, key);
+    apply(op, key);
+    m_applied = lsn;
+    m_since_checkpoint++;
+    std::optional<snapshot> snap = take_snapshot(false);
+    lock.unlock();
+    if (snap) {
+      write_snapshot(*snap);
+    }
+    m_log->commit(lsn);
+  }
+
+  // under m_mutex: rotates the log and copies the dirty pages out when a
+  // checkpoint is due and none is running
+  std::optional<snapshot> take_snapshot(bool force) {
+    buffer_pool &pool = m_tree.pool();
+    bool due = pool.dirty() >= pool.frames() / 2 ||
+               m_since_checkpoint >= m_checkpoint_records;
+    if (m_checkpointing || !(force || due)) {
+      return std::nullopt;
+    }
+    m_checkpointing = true;
+    m_since_checkpoint = 0;
+    try {
+      m_log->rotate();
+    } catch (...) {
+      m_checkpointing = false;
+      m_cv.notify_all();
+      throw;
+    }
+    m_tree.set_lsn(m_applied);
+    m_tree.write_meta();
+    snapshot snap{m_applied, {}, {}};
+    snap.ids = pool.snapshot(snap.pages);
+    return snap;
+  }
+
+  // without m_mutex: the copies to the double write file, then in place
+  void write_snapshot(snapshot &snap) {
+    try {
+      write_double_write(snap);
+      page_file &file = m_tree.file();
+      for (size_t i = 0; i < snap.ids.size(); i++) {
+        file.write(snap.ids[i], snap.pages.data() + i * PageSize);
+      }
+      file.sync();
+      m_log->drop_through(snap.lsn);
+    } catch (...) {
+      finish_snapshot(snap, false);
+      throw;
+    }
+    finish_snapshot(snap, true);
+  }
+
+  // unpins the pages of the snapshot, dirty again when they did not make it
+  void finish_snapshot(snapshot &snap, bool written) {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    for (page_id id : snap.ids) {
+      m_tree.pool().unpin(id, !written);
+    }
+    if (written) {
+      m_checkpoint_stats.checkpoints++;
+      m_checkpoint_stats.pages += snap.ids.size();
+    }
+    m_checkpointing = false;
+    m_cv.notify_all();
+  }
+
+  void write_double_write(const snapshot &snap) {
+    double_write_header header{DOUBLE_WRITE_MAGIC, snap.lsn,
+                               static_cast<uint32_t>(snap.ids.size()),
+                               static_cast<uint32_t>(PageSize), 0, 0};
+    header.check = double_write_check(header, snap.ids, snap.pages.data());
+    std::string path = double_write_path(m_path);
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      throw std::runtime_error("failed to open " + path);
+    }
+    try {
+      redo_log_detail::write_all(fd, reinterpret_cast<const char *>(&header),
+                                 sizeof(header));
+      redo_log_detail::write_all(
+          fd, reinterpret_cast<const char *>(snap.ids.data()),
+          snap.ids.size() * sizeof(page_id));
+      redo_log_detail::write_all(fd, snap.pages.data(), snap.pages.size());
+      if (page_file::sync_fd(fd) != 0) {
+        throw std::runtime_error("failed to sync " + path);
+      }
+    } catch (...) {
+      ::close(fd);
+      throw;
+    }
+    ::close(fd);
+    if (!m_double_write_synced) {
+      redo_log_detail::sync_directory(
+          std::filesystem::path{m_path}.parent_path().string());
+      m_double_write_synced = true;
+    }
+  }
+
+  static uint32_t double_write_check(const double_write_header &header,
+                                     const std::vector<page_id> &ids,
+                                     const char *pages) {
+    uint32_t check = redo_log_detail::checksum(
+        reinterpret_cast<const char *>(&header),
+        offsetof(double_write_header, check));
+    check ^= redo_log_detail::checksum(
+        reinterpret_cast<const char *>(ids.data()),
+        ids.size() * sizeof(page_id));
+    return check ^ redo_log_detail::checksum(pages, ids.size() * PageSize);
+  }
+
+  // copies a whole double write file back in place, it is the newest
+  // checkpoint and its in place writes may have been cut short. returns the
+  // pages copied, 0 when the file is missing or torn
+  static size_t restore_double_write(const std::string &path) {
+    std::FILE *in = std::fopen(double_write_path(path).c_str(), "rb");
+    if (!in) {
+      return 0;
+    }
+    double_write_header header{};
+    std::vector<page_id> ids{};
+    std::vector<char> pages{};
+    bool whole = std::fread(&header, sizeof(header), 1, in) == 1 &&
+                 header.magic == DOUBLE_WRITE_MAGIC &&
+                 header.page_size == PageSize;
+    if (whole) {
+      ids.resize(header.count);
+      pages.resize(size_t{header.count} * PageSize);
+      whole = std::fread(ids.data(), sizeof(page_id), ids.size(), in) ==
+                  ids.size() &&
+              std::fread(pages.data(), 1, pages.size(), in) == pages.size() &&
+              double_write_check(header, ids, pages.data()) == header.check;
+    }
+    std::fclose(in);
+    if (!whole) {
+      return 0;
+    }
+    page_file file{path, PageSize};
+    for (size_t i = 0; i < ids.size(); i++) {
+      file.write(ids[i], pages.data() + i * PageSize);
+    }
+    file.sync();
+    return ids.size();
+  }
+
+private:
+  std::string m_path{};
+  size_t m_checkpoint_records{};
+  size_t m_restored{};
+  tree_type m_tree;
+  std::optional<log_type> m_log{};
+  std::mutex m_mutex{};
+  std::condition_variable m_cv{};
+  // lsn of the last operation applied to the tree
+  uint64_t m_applied{};
+  size_t m_since_checkpoint{};
+  bool m_checkpointing{};
+  bool m_double_write_synced{};
+  recovery_stats m_recovery{};
+  checkpoint_stats m_checkpoint_stats{};
+};
+
+#endif
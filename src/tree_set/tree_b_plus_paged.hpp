@@ -0,0 +1,499 @@
+#pragma once
+
+// b_plus_set on disk: the nodes are fixed size pages of one file, linked by
+// page id instead of pointer, and are only reached through a buffer_pool
+//
+// page 0 holds the meta data (root, free list, page and key counts), page id
+// 0 is no page in the links. a node page is a small header followed by the
+// keys and the child page ids, the leaves link their siblings by page id.
+// the in-node search is node_search::lower_bound as in b_plus_set, a split
+// cuts the keys of an overflowing node in two halves and an underflowing
+// node shares with or merges into a neighbour as in b_plus_set's bulk load.
+// a separator only bounds the keys: left of it below, right of it not, so
+// a remove never touches the inner nodes unless a leaf goes short
+//
+// a page stays pinned only while it is read or changed, the path of a
+// descent is kept as page ids and pinned again on the way up. the changes
+// reach the file when their page is evicted or on flush(), with no ordering
+// and no fsync: a crash in between leaves a torn tree
+
+#include "buffer_pool.hpp"
+
+#ifdef TREE_SET_PAGED
+
+#include "node_search.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// bytes of a node page besides keys and children: leaf flag, key count and
+// the sibling links
+constexpr size_t PAGE_HEADER = 16;
+
+// the largest order (children per node, keys + 1) whose node fits in a page,
+// at least 3
+template <typename Key> constexpr int page_order(size_t page_size) {
+  // one more page id of slack for the padding behind the keys
+  size_t used = PAGE_HEADER + sizeof(page_id);
+  size_t room = page_size > used ? page_size - used : 0;
+  size_t order = (room + sizeof(Key)) / (sizeof(Key) + sizeof(page_id));
+  return order < 3 ? 3 : static_cast<int>(order);
+}
+
+template <typename Key, size_t PageSize = 4096> class paged_b_plus_set {
+  static_assert(std::is_trivially_copyable_v<Key>,
+                "the keys are stored as their bytes");
+
+public:
+  static constexpr int MAX_NODE_COUNT = page_order<Key>(PageSize);
+  static constexpr int MIN_KEY_COUNT = (MAX_NODE_COUNT + 1) / 2 - 1;
+  static constexpr int MAX_KEY_COUNT = MAX_NODE_COUNT - 1;
+
+  // a split or merge pins the parent, two siblings and a leaf link at once
+  static constexpr size_t MIN_POOL_PAGES = 8;
+
+  using key_type = Key;
+
+  // opens the tree in path or creates it when the file is empty, the pool
+  // caches pool_pages pages
+  explicit paged_b_plus_set(const std::string &path, size_t pool_pages = 256)
+      : m_file(path, PageSize),
+        m_pool(m_file, std::max(pool_pages, MIN_POOL_PAGES)) {
+    if (m_file.page_count() == 0) {
+      m_meta = meta_page{MAGIC, PageSize, sizeof(Key), 0, 0, 1, 0, 0};
+      page_guard root = new_page();
+      root.as<node_page>()->leaf = 1;
+      m_meta.root = root.id();
+      return;
+    }
+    page_guard meta{m_pool, 0};
+    m_meta = *meta.as<meta_page>();
+    if (m_meta.magic != MAGIC || m_meta.page_size != PageSize ||
+        m_meta.key_size != sizeof(Key)) {
+      throw std::runtime_error(path + " is not a paged b+ tree of this page "
+                                      "and key size");
+    }
+  }
+
+  // an error of the last flush is lost here, call flush() to see it. a pool
+  // without steal leaves it to the owner when pages reach the file (see
+  // logged_b_plus_set), nothing is written then
+  ~paged_b_plus_set() {
+    if (m_pool.no_steal()) {
+      return;
+    }
+    try {
+      flush();
+    } catch (...) {
+    }
+  }
+
+  paged_b_plus_set(const paged_b_plus_set &) = delete;
+  paged_b_plus_set &operator=(const paged_b_plus_set &) = delete;
+
+  bool search(const Key &key) {
+    page_guard leaf = leaf_of(key, nullptr);
+    const node_page *node = leaf.as<node_page>();
+    int pos = lower_bound(node, key);
+    return pos < node->key_count && !(key < node->keys[pos]);
+  }
+
+  void insert(const Key &key) {
+    std::vector<step> path{};
+    page_guard leaf = leaf_of(key, &path);
+    node_page *node = leaf.as<node_page>();
+    int pos = lower_bound(node, key);
+    if (pos < node->key_count && !(key < node->keys[pos])) {
+      return;
+    }
+    m_meta.size++;
+    leaf.mark_dirty();
+    if (node->key_count < MAX_KEY_COUNT) {
+      std::memmove(node->keys + pos + 1, node->keys + pos,
+                   (node->key_count - pos) * sizeof(Key));
+      node->keys[pos] = key;
+      node->key_count++;
+      return;
+    }
+    std::vector<Key> keys(node->keys, node->keys + node->key_count);
+    keys.insert(keys.begin() + pos, key);
+    auto [sep, right] = split(leaf, keys, {});
+    leaf.release();
+    // the new right node goes into the parent after the child taken
+    while (!path.empty()) {
+      auto [parent_id, child] = path.back();
+      path.pop_back();
+      page_guard parent{m_pool, parent_id};
+      parent.mark_dirty();
+      node_page *inner = parent.as<node_page>();
+      if (inner->key_count < MAX_KEY_COUNT) {
+        std::memmove(inner->keys + child + 1, inner->keys + child,
+                     (inner->key_count - child) * sizeof(Key));
+        std::memmove(inner->children + child + 2, inner->children + child + 1,
+                     (inner->key_count - child) * sizeof(page_id));
+        inner->keys[child] = sep;
+        inner->children[child + 1] = right;
+        inner->key_count++;
+        return;
+      }
+      std::vector<Key> inner_keys(inner->keys,
+                                  inner->keys + inner->key_count);
+      std::vector<page_id> children(inner->children,
+                                    inner->children + inner->key_count + 1);
+      inner_keys.insert(inner_keys.begin() + child, sep);
+      children.insert(children.begin() + child + 1, right);
+      std::tie(sep, right) = split(parent, inner_keys, children);
+    }
+    // the root was split
+    page_guard root = new_page();
+    node_page *top = root.as<node_page>();
+    top->key_count = 1;
+    top->keys[0] = sep;
+    top->children[0] = m_meta.root;
+    top->children[1] = right;
+    m_meta.root = root.id();
+  }
+
+  void remove(const Key &key) {
+    std::vector<step> path{};
+    page_guard leaf = leaf_of(key, &path);
+    node_page *node = leaf.as<node_page>();
+    int pos = lower_bound(node, key);
+    if (pos == node->key_count || key < node->keys[pos]) {
+      return;
+    }
+    m_meta.size--;
+    leaf.mark_dirty();
+    std::memmove(node->keys + pos, node->keys + pos + 1,
+                 (node->key_count - pos - 1) * sizeof(Key));
+    node->key_count--;
+    int count = node->key_count;
+    bool merged = false;
+    leaf.release();
+    // a short node shares with or merges into its left neighbour, the first
+    // child with its right one, a merge takes a key from the parent
+    while (!path.empty() && count < MIN_KEY_COUNT) {
+      auto [parent_id, child] = path.back();
+      path.pop_back();
+      page_guard parent{m_pool, parent_id};
+      node_page *inner = parent.as<node_page>();
+      int left_pos = std::max(child - 1, 0);
+      page_guard left{m_pool, inner->children[left_pos]};
+      page_guard right{m_pool, inner->children[left_pos + 1]};
+      parent.mark_dirty();
+      std::optional<Key> sep = share_or_merge(left, right,
+                                              inner->keys[left_pos]);
+      if (sep) {
+        inner->keys[left_pos] = *sep;
+        return;
+      }
+      std::memmove(inner->keys + left_pos, inner->keys + left_pos + 1,
+                   (inner->key_count - left_pos - 1) * sizeof(Key));
+      std::memmove(inner->children + left_pos + 1,
+                   inner->children + left_pos + 2,
+                   (inner->key_count - left_pos - 1) * sizeof(page_id));
+      inner->key_count--;
+      count = inner->key_count;
+      merged = true;
+      free_page(std::move(right));
+    }
+    // an inner root left with one child hands the root to it
+    if (merged && path.empty() && count == 0) {
+      page_guard root{m_pool, m_meta.root};
+      m_meta.root = root.as<node_page>()->children[0];
+      free_page(std::move(root));
+    }
+  }
+
+  size_t size() const { return m_meta.size; }
+
+  bool empty() const { return m_meta.size == 0; }
+
+  // calls func on the keys in [lo, hi) along the leaf links
+  template <typename Func>
+  void scan(const Key &lo, const Key &hi, Func &&func) {
+    if (!(lo < hi)) {
+      return;
+    }
+    page_guard leaf = leaf_of(lo, nullptr);
+    int pos = lower_bound(leaf.as<node_page>(), lo);
+    while (true) {
+      const node_page *node = leaf.as<node_page>();
+      for (; pos < node->key_count; pos++) {
+        if (!(node->keys[pos] < hi)) {
+          return;
+        }
+        func(node->keys[pos]);
+      }
+      if (node->next == 0) {
+        return;
+      }
+      leaf = page_guard{m_pool, node->next};
+      pos = 0;
+    }
+  }
+
+  // writes the meta page and every dirty page to the file
+  void flush() {
+    write_meta();
+    m_pool.flush();
+  }
+
+  // puts the meta data into page 0 in the pool, dirty
+  void write_meta() {
+    page_guard meta{m_pool, 0, true};
+    *meta.as<meta_page>() = m_meta;
+    meta.mark_dirty();
+  }
+
+  // the last log record the pages on disk reflect, kept in the meta page for
+  // a log on top, 0 without one
+  uint64_t lsn() const { return m_meta.lsn; }
+
+  void set_lsn(uint64_t lsn) { m_meta.lsn = lsn; }
+
+  // the key counts, the key order against the separators, the depth of the
+  // leaves, the leaf links and the size, it reads every page
+  bool check() {
+    std::vector<page_id> leaves{};
+    int depth = -1;
+    bool valid = true;
+    size_t keys =
+        check_tree(m_meta.root, 0, nullptr, nullptr, depth, leaves, valid);
+    valid &= keys == m_meta.size;
+    for (size_t i = 0; i < leaves.size(); i++) {
+      page_guard leaf{m_pool, leaves[i]};
+      const node_page *node = leaf.as<node_page>();
+      valid &= node->prev == (i > 0 ? leaves[i - 1] : 0);
+      valid &= node->next == (i + 1 < leaves.size() ? leaves[i + 1] : 0);
+    }
+    assert(m_pool.pinned() == 0);
+    return valid;
+  }
+
+  buffer_pool &pool() { return m_pool; }
+
+  page_file &file() { return m_file; }
+
+  // pages in the file, the meta page and the free ones included
+  page_id page_count() const { return m_meta.page_count; }
+
+private:
+  static constexpr uint64_t MAGIC = 0x65657274736c7062; // "bplstree"
+
+  struct meta_page {
+    uint64_t magic{};
+    uint32_t page_size{};
+    uint32_t key_size{};
+    page_id root{};
+    // a free page holds the id of the next one in its first bytes
+    page_id free_head{};
+    page_id page_count{};
+    uint64_t size{};
+    uint64_t lsn{};
+  };
+
+  struct node_page {
+    uint32_t leaf{};
+    int32_t key_count{};
+    // the sibling leaves, 0 for none
+    page_id prev{};
+    page_id next{};
+    Key keys[MAX_KEY_COUNT];
+    page_id children[MAX_NODE_COUNT];
+  };
+  static_assert(sizeof(node_page) <= PageSize, "node page too large");
+  static_assert(sizeof(meta_page) <= PageSize, "meta page too large");
+
+  // an inner page of a descent and the child taken there
+  struct step {
+    page_id page;
+    int child;
+  };
+
+  static int lower_bound(const node_page *node, const Key &key) {
+    return node_search::lower_bound(node->keys, node->key_count, key);
+  }
+
+  // the leaf of key pinned, path gets the inner pages above it
+  page_guard leaf_of(const Key &key, std::vector<step> *path) {
+    page_guard page{m_pool, m_meta.root};
+    while (!page.as<node_page>()->leaf) {
+      const node_page *node = page.as<node_page>();
+      int pos = lower_bound(node, key);
+      // a key equal to the separator belongs to the right child
+      if (pos < node->key_count && !(key < node->keys[pos])) {
+        pos++;
+      }
+      if (path) {
+        path->push_back({page.id(), pos});
+      }
+      page = page_guard{m_pool, node->children[pos]};
+    }
+    return page;
+  }
+
+  // a zeroed page from the free list or the end of the file, pinned dirty
+  page_guard new_page() {
+    page_id id = m_meta.free_head;
+    if (id != 0) {
+      page_guard page{m_pool, id};
+      std::memcpy(&m_meta.free_head, page.data(), sizeof(page_id));
+      std::memset(page.data(), 0, PageSize);
+      page.mark_dirty();
+      return page;
+    }
+    page_guard page{m_pool, m_meta.page_count++, true};
+    page.mark_dirty();
+    return page;
+  }
+
+  void free_page(page_guard page) {
+    std::memset(page.data(), 0, PageSize);
+    std::memcpy(page.data(), &m_meta.free_head, sizeof(page_id));
+    page.mark_dirty();
+    m_meta.free_head = page.id();
+  }
+
+  // writes keys (and children for an inner node) back to the full page as
+  // its left half and a new right sibling as the other, returns the key that
+  // goes up and the new page
+  std::pair<Key, page_id> split(page_guard &page,
+                                const std::vector<Key> &keys,
+                                const std::vector<page_id> &children) {
+    page_guard right_page = new_page();
+    node_page *left = page.as<node_page>();
+    node_page *right = right_page.as<node_page>();
+    int count = static_cast<int>(keys.size());
+    int half = count / 2;
+    Key sep = keys[half];
+    right->leaf = left->leaf;
+    if (left->leaf) {
+      // leaves keep the separator as the first key of the right one
+      left->key_count = half;
+      right->key_count = count - half;
+      std::copy(keys.begin(), keys.begin() + half, left->keys);
+      std::copy(keys.begin() + half, keys.end(), right->keys);
+      right->prev = page.id();
+      right->next = left->next;
+      if (right->next != 0) {
+        page_guard next{m_pool, right->next};
+        next.as<node_page>()->prev = right_page.id();
+        next.mark_dirty();
+      }
+      left->next = right_page.id();
+    } else {
+      left->key_count = half;
+      right->key_count = count - half - 1;
+      std::copy(keys.begin(), keys.begin() + half, left->keys);
+      std::copy(keys.begin() + half + 1, keys.end(), right->keys);
+      std::copy(children.begin(), children.begin() + half + 1,
+                left->children);
+      std::copy(children.begin() + half + 1, children.end(),
+                right->children);
+    }
+    page.mark_dirty();
+    return {sep, right_page.id()};
+  }
+
+  // spreads the keys of two neighbours evenly over them and returns the new
+  // separator, or merges them into left when they fit in one node and leaves
+  // right to be freed. inner nodes take sep from between them
+  std::optional<Key> share_or_merge(page_guard &left_page,
+                                    page_guard &right_page, const Key &sep) {
+    node_page *left = left_page.as<node_page>();
+    node_page *right = right_page.as<node_page>();
+    left_page.mark_dirty();
+    right_page.mark_dirty();
+    bool leaf = left->leaf;
+    std::vector<Key> keys(left->keys, left->keys + left->key_count);
+    std::vector<page_id> children{};
+    if (!leaf) {
+      keys.push_back(sep);
+      children.assign(left->children, left->children + left->key_count + 1);
+      children.insert(children.end(), right->children,
+                      right->children + right->key_count + 1);
+    }
+    keys.insert(keys.end(), right->keys, right->keys + right->key_count);
+    int count = static_cast<int>(keys.size());
+    if (count <= MAX_KEY_COUNT) {
+      left->key_count = count;
+      std::copy(keys.begin(), keys.end(), left->keys);
+      std::copy(children.begin(), children.end(), left->children);
+      if (leaf) {
+        left->next = right->next;
+        if (left->next != 0) {
+          page_guard next{m_pool, left->next};
+          next.as<node_page>()->prev = left_page.id();
+          next.mark_dirty();
+        }
+      }
+      return std::nullopt;
+    }
+    int half = count / 2;
+    left->key_count = half;
+    std::copy(keys.begin(), keys.begin() + half, left->keys);
+    if (leaf) {
+      right->key_count = count - half;
+      std::copy(keys.begin() + half, keys.end(), right->keys);
+    } else {
+      right->key_count = count - half - 1;
+      std::copy(keys.begin() + half + 1, keys.end(), right->keys);
+      std::copy(children.begin(), children.begin() + half + 1,
+                left->children);
+      std::copy(children.begin() + half + 1, children.end(),
+                right->children);
+    }
+    return keys[half];
+  }
+
+  // keys under id, which must lie in [lo, hi), valid is cleared on a broken
+  // invariant
+  size_t check_tree(page_id id, int level, const Key *lo, const Key *hi,
+                    int &depth, std::vector<page_id> &leaves, bool &valid) {
+    page_guard page{m_pool, id};
+    const node_page *node = page.as<node_page>();
+    valid &= id == m_meta.root || node->key_count >= MIN_KEY_COUNT;
+    valid &= node->key_count <= MAX_KEY_COUNT;
+    for (int i = 0; i < node->key_count; i++) {
+      valid &= i == 0 || node->keys[i - 1] < node->keys[i];
+      valid &= !lo || !(node->keys[i] < *lo);
+      valid &= !hi || node->keys[i] < *hi;
+    }
+    if (node->leaf) {
+      valid &= depth == -1 || depth == level;
+      depth = level;
+      leaves.push_back(id);
+      return static_cast<size_t>(node->key_count);
+    }
+    valid &= id != m_meta.root || node->key_count > 0;
+    // copies, the page may be evicted while the children are visited
+    std::vector<Key> keys(node->keys, node->keys + node->key_count);
+    std::vector<page_id> children(node->children,
+                                  node->children + node->key_count + 1);
+    page.release();
+    size_t count = 0;
+    for (size_t i = 0; i < children.size(); i++) {
+      count +=
+          check_tree(children[i], level + 1, i > 0 ? &keys[i - 1] : lo,
+                     i < keys.size() ? &keys[i] : hi, depth, leaves, valid);
+    }
+    return count;
+  }
+
+private:
+  page_file m_file;
+  buffer_pool m_pool;
+  meta_page m_meta{};
+};
+
+#endif
@@ -1,23 +1,70 @@
 #pragma once
 
-#include <queue>
+#include "config.hpp"
+#include "node_pool.hpp"
+#include "tree_iterator.hpp"
+
+#include <functional>
+#include <memory>
+#include <new>
 #include <sstream>
 #include <string>
+#include <type_traits>
+#include <utility>
 
-template <typename Key> class bst_set {
+template <typename Key, typename Allocator = node_pool<Key>> class bst_set {
 public:
   using key_type = Key;
   bst_set() = default;
 
-  ~bst_set() { destory_tree(root); }
+  ~bst_set() { delete_tree(alloc, root); }
 
   bool search(const Key &key) {
     return static_cast<bool>(search_tree(root, key));
   }
 
-  void insert(const Key &key) { root = insert_tree(root, key); }
+  void insert(const Key &key) {
+    root = insert_tree(root, key);
+    root->parent = nullptr;
+  }
+
+  void remove(const Key &key) {
+    root = remove_tree(root, key);
+    if (root) {
+      root->parent = nullptr;
+    }
+  }
+
+  using iterator = tree_iterator<bst_set>;
+  using const_iterator = iterator;
+
+  iterator begin() const {
+    return {this, tree_iterator_detail::leftmost(root)};
+  }
+
+  iterator end() const { return {this, nullptr}; }
+
+  // the first key not below key
+  iterator lower_bound(const Key &key) const {
+    return {this, tree_iterator_detail::lower_bound(root, key)};
+  }
+
+  // the first key above key
+  iterator upper_bound(const Key &key) const {
+    iterator iter = lower_bound(key);
+    if (iter != end() && !(key < *iter)) {
+      ++iter;
+    }
+    return iter;
+  }
 
-  void remove(const Key &key) { root = remove_tree(root, key); }
+  // the keys in [lo, hi)
+  tree_range<iterator> range(const Key &lo, const Key &hi) const {
+    if (hi < lo) {
+      return {end(), end()};
+    }
+    return {lower_bound(lo), lower_bound(hi)};
+  }
 
   std::string to_string() const {
     std::stringstream s;
@@ -38,43 +85,52 @@ private:
     Key key{};
     tree_node *left{};
     tree_node *right{};
+    tree_node *parent{};
   };
+  using node_allocator = typename std::allocator_traits<
+      Allocator>::template rebind_alloc<tree_node>;
 
 private:
-  static void destory_tree(tree_node *root) {
-    std::queue<tree_node *> queue{};
-    queue.push(root);
-    while (!queue.empty()) {
-      tree_node *curr = queue.front();
-      queue.pop();
-      if (curr) {
-        queue.push(curr->left);
-        queue.push(curr->right);
-        delete curr;
-      }
-    }
+  friend class tree_iterator<bst_set>;
+
+  static const Key &iter_key(const tree_node *node, int) { return node->key; }
+
+  static void iter_next(tree_node *&node, int &) {
+    node = tree_iterator_detail::successor(node);
+  }
+
+  static void iter_prev(tree_node *&node, int &) {
+    node = tree_iterator_detail::predecessor(node);
+  }
+
+  void iter_last(tree_node *&node, int &) const {
+    node = tree_iterator_detail::rightmost(root);
   }
 
-  static tree_node *insert_tree(tree_node *root, const Key &key) {
+  tree_node *insert_tree(tree_node *root, const Key &key) {
     if (root == nullptr) {
-      return new tree_node{key};
+      return new_node(alloc, key);
     }
     if (root->key > key) {
-      root->left = insert_tree(root->left, key);
+      tree_node *left = insert_tree(root->left, key);
+      L(root, left);
     } else if (root->key < key) {
-      root->right = insert_tree(root->right, key);
+      tree_node *right = insert_tree(root->right, key);
+      R(root, right);
     }
     return root;
   }
 
-  static tree_node *remove_tree(tree_node *root, const Key &key) {
+  tree_node *remove_tree(tree_node *root, const Key &key) {
     if (root == nullptr) {
       return root;
     }
     if (root->key > key) {
-      root->left = remove_tree(root->left, key);
+      tree_node *left = remove_tree(root->left, key);
+      L(root, left);
     } else if (root->key < key) {
-      root->right = remove_tree(root->right, key);
+      tree_node *right = remove_tree(root->right, key);
+      R(root, right);
     } else {
       if (root->left && root->right) {
         tree_node *prev = root->left;
@@ -82,13 +138,14 @@ private:
           prev = prev->right;
         }
         std::swap(prev->key, root->key);
-        root->left = remove_tree(root->left, key);
+        tree_node *left = remove_tree(root->left, key);
+        L(root, left);
       } else if (!root->left && !root->right) {
-        delete root;
+        delete_node(alloc, root);
         root = nullptr;
       } else if ((root->left && !root->right) || (root->right && !root->left)) {
         tree_node *child = root->left ? root->left : root->right;
-        delete root;
+        delete_node(alloc, root);
         root = child;
       }
     }
@@ -137,4 +194,5 @@ private:
 
 private:
   tree_node *root{};
+  node_allocator alloc{};
 };
\ No newline at end of file
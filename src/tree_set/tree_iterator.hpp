@@ -0,0 +1,140 @@
+#pragma once
+#include <cstddef>
+#include <iterator>
+
+// ordered, read only iteration over the keys of a tree set
+//
+// a position is a node and the index of the key in it (always 0 for the
+// binary trees), end() is the null node. the set supplies the steps as
+// private statics and befriends the iterator:
+//
+//   static const Key &iter_key(const tree_node *node, int pos);
+//   static void iter_next(tree_node *&node, int &pos);   // null past the end
+//   static void iter_prev(tree_node *&node, int &pos);   // not from begin()
+//   void iter_last(tree_node *&node, int &pos) const;     // for --end()
+//
+// any insert or remove invalidates every iterator of the set
+template <typename Tree> class tree_iterator {
+  using node_ptr = typename Tree::tree_node *;
+
+public:
+  using iterator_category = std::bidirectional_iterator_tag;
+  using value_type = typename Tree::key_type;
+  using difference_type = std::ptrdiff_t;
+  using pointer = const value_type *;
+  using reference = const value_type &;
+
+  tree_iterator() = default;
+
+  tree_iterator(const Tree *tree, node_ptr node, int pos = 0)
+      : tree(tree), node(node), pos(pos) {}
+
+  reference operator*() const { return Tree::iter_key(node, pos); }
+
+  pointer operator->() const { return &Tree::iter_key(node, pos); }
+
+  tree_iterator &operator++() {
+    Tree::iter_next(node, pos);
+    return *this;
+  }
+
+  tree_iterator operator++(int) {
+    tree_iterator old = *this;
+    ++*this;
+    return old;
+  }
+
+  tree_iterator &operator--() {
+    if (node) {
+      Tree::iter_prev(node, pos);
+    } else {
+      tree->iter_last(node, pos);
+    }
+    return *this;
+  }
+
+  tree_iterator operator--(int) {
+    tree_iterator old = *this;
+    --*this;
+    return old;
+  }
+
+  bool operator==(const tree_iterator &other) const {
+    return node == other.node && pos == other.pos;
+  }
+
+  bool operator!=(const tree_iterator &other) const {
+    return !(*this == other);
+  }
+
+private:
+  const Tree *tree{};
+  node_ptr node{};
+  int pos{};
+};
+
+// the keys in [first, last), for range-for
+template <typename Iterator> struct tree_range {
+  Iterator first{};
+  Iterator last{};
+
+  Iterator begin() const { return first; }
+  Iterator end() const { return last; }
+  bool empty() const { return first == last; }
+};
+
+// steps shared by the binary trees (key, left, right, parent)
+namespace tree_iterator_detail {
+
+template <typename Node> Node *leftmost(Node *node) {
+  while (node && node->left) {
+    node = node->left;
+  }
+  return node;
+}
+
+template <typename Node> Node *rightmost(Node *node) {
+  while (node && node->right) {
+    node = node->right;
+  }
+  return node;
+}
+
+template <typename Node> Node *successor(Node *node) {
+  if (node->right) {
+    return leftmost(node->right);
+  }
+  while (node->parent && node->parent->right == node) {
+    node = node->parent;
+  }
+  return node->parent;
+}
+
+template <typename Node> Node *predecessor(Node *node) {
+  if (node->left) {
+    return rightmost(node->left);
+  }
+  while (node->parent && node->parent->left == node) {
+    node = node->parent;
+  }
+  return node->parent;
+}
+
+// the node of the first key not below key, null if there is none
+template <typename Node, typename Key>
+Node *lower_bound(Node *node, const Key &key) {
+  Node *bound{};
+  while (node) {
+    if (node->key < key) {
+      node = node->right;
+    } else if (key < node->key) {
+      bound = node;
+      node = node->left;
+    } else {
+      return node;
+    }
+  }
+  return bound;
+}
+
+} // namespace tree_iterator_detail
@@ -1,10 +1,17 @@
 #pragma once
 
 #include "config.hpp"
+#include "node_pool.hpp"
+#include "tree_iterator.hpp"
 #include <cassert>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <new>
 #include <queue>
 #include <sstream>
+#include <type_traits>
+#include <utility>
 
 #define COLOR(node) ((node) ? (node)->color : BLACK)
 
@@ -21,7 +28,7 @@
     }                                                                          \
   } while (false)
 
-template <typename Key> class rb_set {
+template <typename Key, typename Allocator = node_pool<Key>> class rb_set {
 public:
   using key_type = Key;
 
@@ -47,14 +54,32 @@ public:
 
     bool is_leaf() const { return !left && !right; }
   };
+  using node_allocator = typename std::allocator_traits<
+      Allocator>::template rebind_alloc<tree_node>;
 
 private:
+  friend class tree_iterator<rb_set>;
+
+  static const Key &iter_key(const tree_node *node, int) { return node->key; }
+
+  static void iter_next(tree_node *&node, int &) {
+    node = tree_iterator_detail::successor(node);
+  }
+
+  static void iter_prev(tree_node *&node, int &) {
+    node = tree_iterator_detail::predecessor(node);
+  }
+
+  void iter_last(tree_node *&node, int &) const {
+    node = tree_iterator_detail::rightmost(root);
+  }
+
   static inline std::string color_name[2]{"RED", "BLACK"};
 
 public:
   rb_set() = default;
 
-  ~rb_set() { destroy_tree(root); }
+  ~rb_set() { delete_tree(alloc, root); }
 
   void insert(const Key &key) { root = insert_tree(root, key); }
 
@@ -68,6 +93,37 @@ public:
     return check(root);
   }
 
+  using iterator = tree_iterator<rb_set>;
+  using const_iterator = iterator;
+
+  iterator begin() const {
+    return {this, tree_iterator_detail::leftmost(root)};
+  }
+
+  iterator end() const { return {this, nullptr}; }
+
+  // the first key not below key
+  iterator lower_bound(const Key &key) const {
+    return {this, tree_iterator_detail::lower_bound(root, key)};
+  }
+
+  // the first key above key
+  iterator upper_bound(const Key &key) const {
+    iterator iter = lower_bound(key);
+    if (iter != end() && !(key < *iter)) {
+      ++iter;
+    }
+    return iter;
+  }
+
+  // the keys in [lo, hi)
+  tree_range<iterator> range(const Key &lo, const Key &hi) const {
+    if (hi < lo) {
+      return {end(), end()};
+    }
+    return {lower_bound(lo), lower_bound(hi)};
+  }
+
   std::string to_string() const {
     std::stringstream s;
     s << "{ ";
@@ -83,21 +139,6 @@ public:
   }
 
 private:
-  static void destroy_tree(tree_node *root) {
-    std::queue<tree_node *> queue{};
-    queue.push(root);
-    while (!queue.empty()) {
-      tree_node *curr = queue.front();
-      queue.pop();
-      if (curr) {
-        queue.push(curr->left);
-        queue.push(curr->right);
-        // std::cout << "delete " << to_string(curr) << std::endl;
-        delete curr;
-      }
-    }
-  }
-
   static std::string to_string(tree_node *node) {
     std::stringstream s;
     if (node) {
@@ -194,15 +235,15 @@ private:
     return left;
   }
 
-  static tree_node *insert_tree(tree_node *root, const Key &key) {
+  tree_node *insert_tree(tree_node *root, const Key &key) {
     tree_node *parent = range_search_tree(root, key);
     if (!parent) {
-      return new tree_node{key, BLACK};
+      return new_node(alloc, key, BLACK);
     }
     if (parent->key == key) {
       return root;
     }
-    tree_node *node = new tree_node{key, RED};
+    tree_node *node = new_node(alloc, key, RED);
     LOG("insert %s to %s\n", to_string(node).c_str(),
         to_string(parent).c_str());
     if (parent->key > key) {
@@ -265,7 +306,7 @@ private:
     return root;
   }
 
-  static tree_node *remove_tree(tree_node *root, const Key &key) {
+  tree_node *remove_tree(tree_node *root, const Key &key) {
     LOG("remove %s\n", std::to_string(key).c_str());
     tree_node *node = search_tree(root, key);
     if (!node) {
@@ -288,8 +329,8 @@ private:
       assert(node->right->color == RED);
       // 直接把红色节点值上移即可
       std::swap(node->key, node->right->key);
+      delete_node(alloc, node->right);
       node->right = nullptr;
-      delete node->right;
       return root;
     }
 
@@ -297,8 +338,8 @@ private:
       LOG("BLACK internal with left child node case\n");
       assert(node->left->color == RED);
       std::swap(node->key, node->left->key);
+      delete_node(alloc, node->left);
       node->left = nullptr;
-      delete node->left;
       return root;
     }
 
@@ -308,13 +349,13 @@ private:
         root = nullptr;
       }
       DETACH(node);
-      delete node;
+      delete_node(alloc, node);
       return root;
     }
 
     LOG("BLACK leaf node case\n");
     // 此时待删除节点是双黑节点，然后我们需要将其转换成单黑节点
-    tree_node *delete_node = node;
+    tree_node *doomed = node;
     tree_node *parent{};
     tree_node *sibling{};
     bool running = true;
@@ -343,21 +384,19 @@ private:
         break;
       }
       case BLACK: {
-        uint8_t node_status =
-            (COLOR(sibling->left) << 1) | (COLOR(sibling->right));
+        // near / far: the child of sibling on the side of / away from node
+        bool left = node->is_left_child();
+        tree_node *near = left ? sibling->left : sibling->right;
+        tree_node *far = left ? sibling->right : sibling->left;
+        uint8_t node_status = (COLOR(near) << 1) | COLOR(far);
         switch (node_status) {
         // red-black case
         case 0b01: {
-          if (node->is_left_child()) {
-            sibling = right_rotate(sibling);
-            std::swap(sibling->color, sibling->right->color);
-          } else if (node->is_right_child()) {
-            sibling = left_rotate(sibling);
-            std::swap(sibling->color, sibling->left->color);
-          } else {
-            assert("unexpected case!");
-          }
+          // the rotation already swaps the colors, the red near child
+          // becomes the black sibling and the old sibling its red far child
+          sibling = left ? right_rotate(sibling) : left_rotate(sibling);
           // 然后继续进行旋转
+          [[fallthrough]];
         }
         // red-red case & black-red case
         case 0b10:
@@ -381,7 +420,7 @@ private:
         // black-black case
         case 0b11: {
           sibling->color = RED;
-          if (COLOR(parent) == RED) {
+          if (COLOR(parent) == RED || parent->is_root()) {
             parent->color = BLACK;
             running = false;
           }
@@ -392,8 +431,8 @@ private:
       }
       }
     }
-    DETACH(delete_node);
-    delete delete_node;
+    DETACH(doomed);
+    delete_node(alloc, doomed);
     return root;
   }
 
@@ -410,7 +449,7 @@ private:
     q.push({root, 1});
     std::optional<int> estimate_black_height{};
     while (!q.empty()) {
-      auto [curr, black_height] = q.top();
+      auto [curr, black_height] = q.front();
       q.pop();
       if (!curr) {
         black_height++;
@@ -420,6 +459,7 @@ private:
           // 检查黑高是否相同
           return false;
         }
+        continue;
       }
       // 检查相邻节点是否是红色
       switch (COLOR(curr)) {
@@ -430,10 +470,12 @@ private:
         }
         q.push({curr->left, black_height});
         q.push({curr->right, black_height});
+        break;
       }
       case BLACK: {
         q.push({curr->left, black_height + 1});
         q.push({curr->right, black_height + 1});
+        break;
       }
       }
     }
@@ -442,4 +484,5 @@ private:
 
 private:
   tree_node *root{};
+  node_allocator alloc{};
 };
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "avl_tree.hpp"
 #include "bs_tree.hpp"
+#include "perf_counter.hpp"
 #include "rb_tree.hpp"
 
 #include <cassert>
@@ -168,6 +169,70 @@ void benchmark(int round = 50, int n = 10000, int min_val = 0,
   }
 }
 
+// replay the whole operation sequence on one tree inside a single counted
+// region, so the per-operation counters are not dominated by the syscalls
+template <typename node_type>
+PerfCounter::Result profile_tree(const std::vector<invoke_param> &ops) {
+  PerfCounter counter{};
+  PerfCounter::Result res{};
+  node_type *root{};
+  {
+    PerfScope _{counter, res};
+    for (auto &op : ops) {
+      switch (op.operation) {
+      case INSERT:
+        root = binary_tree::insert(root, op.val);
+        break;
+      case SEARCH:
+        binary_tree::search(root, op.val);
+        break;
+      case REMOVE:
+        root = binary_tree::remove(root, op.val);
+        break;
+      }
+    }
+  }
+  binary_tree::deleter<node_type>()(root);
+  return res;
+}
+
+PerfCounter::Result profile_std_set(const std::vector<invoke_param> &ops) {
+  PerfCounter counter{};
+  PerfCounter::Result res{};
+  std::set<int> tree_set{};
+  PerfScope _{counter, res};
+  for (auto &op : ops) {
+    switch (op.operation) {
+    case INSERT:
+      tree_set.insert(op.val);
+      break;
+    case SEARCH:
+      tree_set.count(op.val);
+      break;
+    case REMOVE:
+      tree_set.erase(op.val);
+      break;
+    }
+  }
+  return res;
+}
+
+void profile(int n = 10000, int min_val = 0, int max_val = 10000) {
+  auto ops = random_opeartion(n, min_val, max_val);
+  if (!PerfCounter{}.available()) {
+    printf("hardware counters unavailable, report timing only\n");
+  }
+  double count = static_cast<double>(ops.size());
+  printf("profile rb_tree: %s\n",
+         profile_tree<rb_tree::tree_node>(ops).rates(count, "op").c_str());
+  printf("profile avl_tree: %s\n",
+         profile_tree<avl_tree::tree_node>(ops).rates(count, "op").c_str());
+  printf("profile bst_tree: %s\n",
+         profile_tree<binary_tree::tree_node>(ops).rates(count, "op").c_str());
+  printf("profile stl_tree_set: %s\n",
+         profile_std_set(ops).rates(count, "op").c_str());
+}
+
 int main() {
   // using binary_tree::insert;
   // using binary_tree::remove;
@@ -232,5 +297,6 @@ int main() {
   // tree_handle _(root);
 
   benchmark(10, 1000000, 0, std::numeric_limits<int>::max());
+  profile(1000000, 0, std::numeric_limits<int>::max());
   return 0;
 }
\ No newline at end of file
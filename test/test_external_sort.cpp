@@ -0,0 +1,459 @@
+#include "external_sort.hpp"
+#include "loser_tree.hpp"
+#include "merge_planner.hpp"
+#include "mmap_sort.hpp"
+#include "run_codec.hpp"
+#include "run_generator.hpp"
+#include "workload.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <fmt/core.h>
+
+namespace ch = std::chrono;
+
+struct record {
+  uint64_t key{};
+  uint64_t payload{};
+
+  bool operator<(const record &r) const { return key < r.key; }
+};
+
+template <typename T>
+void write_file(const std::string &path, const std::vector<T> &data) {
+  record_writer<T> writer{path, 4096};
+  for (auto &v : data) {
+    writer.push(v);
+  }
+  writer.close();
+}
+
+template <typename T> std::vector<T> read_file(const std::string &path) {
+  std::vector<T> res;
+  record_reader<T> reader{path, 4096};
+  while (!reader.empty()) {
+    res.push_back(reader.front());
+    reader.pop();
+  }
+  return res;
+}
+
+template <typename T>
+external_sort_stats check_sort(const std::string &name, std::vector<T> data,
+                               const external_sort_options &options) {
+  temp_file input{}, output{};
+  write_file(input.path(), data);
+  auto start = ch::steady_clock::now();
+  external_sort_stats stats = external_sort<T>(input.path(), output.path(),
+                                               options);
+  auto end = ch::steady_clock::now();
+  std::vector<T> res = read_file<T>(output.path());
+  std::stable_sort(data.begin(), data.end());
+  bool valid = res.size() == data.size() &&
+               std::equal(res.begin(), res.end(), data.begin(),
+                          [](const T &a, const T &b) {
+                            return !(a < b) && !(b < a);
+                          });
+  fmt::println("{}: {} records, {} runs (avg length {:.1f}, {:.2f}x heap), "
+               "{} merge passes, read {} bytes, write {} bytes, {:.3f}ms "
+               "(merge {:.3f}ms, {} io), {}",
+               name, stats.records, stats.runs,
+               stats.run_generation.average_run_length(),
+               stats.run_generation.length_ratio(), stats.merge_passes,
+               stats.bytes_read, stats.bytes_written,
+               ch::duration<double, std::milli>(end - start).count(),
+               stats.merge_ms, to_string(stats.io),
+               valid ? "passed" : "FAILED");
+  if (!valid) {
+    exit(-1);
+  }
+  return stats;
+}
+
+void check_run_codec() {
+  // round trip of every width and mode, including partial groups
+  for (unsigned width : {0u, 1u, 7u, 31u, 32u, 33u, 63u, 64u}) {
+    std::vector<int64_t> data(1000 + width);
+    uint64_t mask = width == 64 ? ~uint64_t{0} : (uint64_t{1} << width) - 1;
+    workload::fill_raw(data.data(), data.size(), width, 0, [&](uint64_t r) {
+      return static_cast<int64_t>(r & mask);
+    });
+    for (bool sorted : {false, true}) {
+      if (sorted) {
+        std::sort(data.begin(), data.end());
+      }
+      temp_file file{};
+      compressed_run_writer<int64_t> writer{file.path(), 256};
+      writer.push(data.data(), data.size());
+      writer.close();
+      std::vector<int64_t> res;
+      compressed_run_reader<int64_t> reader{file.path()};
+      while (!reader.empty()) {
+        res.push_back(reader.front());
+        reader.pop();
+      }
+      assert(res == data);
+      compressed_run_view<int64_t> view{file.path()};
+      assert(view.size() == data.size());
+      for (size_t i = 0; i < data.size(); i += 37) {
+        assert(view[i] == data[i]);
+      }
+      compressed_run_reader<int64_t> range{file.path(), 0, 300, 777};
+      for (size_t i = 300; i < 777; i++) {
+        assert(!range.empty() && range.front() == data[i]);
+        range.pop();
+      }
+      assert(range.empty());
+    }
+  }
+  fmt::println("run codec round trip passed");
+}
+
+// nanosecond timestamps of one day in random order: the sorted runs shrink
+// to a fraction of the raw 8 bytes per key
+void compare_run_formats() {
+  std::vector<uint64_t> keys(1 << 21);
+  constexpr int64_t base = 1700000000000000000;
+  workload::fill_uniform(keys, base, base + 86400'000'000'000);
+  external_sort_options options{};
+  options.memory_budget = 1 << 20;
+  options.block_size = 16 << 10;
+  options.max_fan_in = 16;
+  external_sort_stats raw = check_sort("timestamps, raw runs", keys, options);
+  options.compress_runs = true;
+  external_sort_stats packed =
+      check_sort("timestamps, compressed runs", keys, options);
+  options.merge_threads = 4;
+  check_sort("timestamps, compressed runs (4 merge threads)", keys, options);
+  // without reading the input and writing the output, which stay raw
+  auto run_io = [](const external_sort_stats &stats) {
+    return static_cast<double>(stats.bytes_read + stats.bytes_written -
+                               2 * stats.records * sizeof(uint64_t));
+  };
+  fmt::println("compressed runs: {:.2f}x less run io, {:.2f}x less total io",
+               run_io(raw) / run_io(packed),
+               static_cast<double>(raw.bytes_read + raw.bytes_written) /
+                   (packed.bytes_read + packed.bytes_written));
+
+  std::vector<int32_t> negative(1 << 18);
+  workload::fill_uniform(negative, -1000000, 1000000);
+  options.merge_threads = 1;
+  check_sort("int32 with negatives, compressed runs", negative, options);
+}
+
+#ifdef EXTERNAL_MMAP_SORT
+// 24 byte records, 8 byte key in the middle
+struct wide_record {
+  uint64_t payload{};
+  uint64_t key{};
+  uint32_t a{};
+  uint32_t b{};
+};
+
+void check_mmap_sort() {
+  std::vector<wide_record> records(1 << 20);
+  std::vector<uint64_t> keys(records.size());
+  workload::fill_raw(keys.data(), keys.size(), 7, 0,
+                     [](uint64_t r) { return r; });
+  // a few duplicates and short keys as well
+  for (size_t i = 0; i < records.size(); i++) {
+    uint64_t k = i % 5 == 0 ? keys[i] & 0xff : keys[i];
+    records[i] = {i, k, static_cast<uint32_t>(i), ~static_cast<uint32_t>(i)};
+  }
+  for (mmap_sort_engine engine :
+       {mmap_sort_engine::radix, mmap_sort_engine::introsort}) {
+    for (size_t width : {size_t{8}, size_t{3}}) {
+      temp_file file{};
+      write_file(file.path(), records);
+      record_key key{offsetof(wide_record, key), width};
+      auto start = ch::steady_clock::now();
+      size_t n = mmap_sort(file.path(), sizeof(wide_record), key, engine);
+      auto end = ch::steady_clock::now();
+      std::vector<wide_record> res = read_file<wide_record>(file.path());
+      uint64_t mask =
+          width == 8 ? ~uint64_t{0} : (uint64_t{1} << 8 * width) - 1;
+      bool sorted = std::is_sorted(
+          res.begin(), res.end(),
+          [&](const wide_record &x, const wide_record &y) {
+            return (x.key & mask) < (y.key & mask);
+          });
+      // every record is still intact and present once
+      std::vector<bool> seen(records.size());
+      bool intact = n == records.size() && res.size() == records.size();
+      for (auto &r : res) {
+        intact &= r.payload < records.size() && !seen[r.payload] &&
+                  r.key == records[r.payload].key &&
+                  r.a == static_cast<uint32_t>(r.payload) &&
+                  r.b == ~static_cast<uint32_t>(r.payload);
+        if (r.payload < records.size()) {
+          seen[r.payload] = true;
+        }
+      }
+      fmt::println("mmap sort ({}, {} byte key): {} records, {:.3f}ms, {}",
+                   engine == mmap_sort_engine::radix ? "radix" : "introsort",
+                   width, n,
+                   ch::duration<double, std::milli>(end - start).count(),
+                   sorted && intact ? "passed" : "FAILED");
+      if (!sorted || !intact) {
+        exit(-1);
+      }
+    }
+  }
+  temp_file empty{};
+  write_file(empty.path(), std::vector<wide_record>{});
+  size_t n = mmap_sort(empty.path(), sizeof(wide_record), {8, 8});
+  if (n != 0) {
+    fmt::println("mmap sort of an empty file: FAILED");
+    exit(-1);
+  }
+}
+#endif
+
+#ifdef EXTERNAL_ASYNC_IO
+// a writer dropped without close() still writes what it buffered
+void check_async_writer() {
+  std::vector<uint64_t> data(10000);
+  workload::fill_uniform(data, 0, 1 << 30);
+  temp_file file{};
+  thread_pool_io io{2};
+  {
+    async_record_writer<uint64_t> writer{io, file.path(), 4096};
+    writer.push(data.data(), data.size());
+  }
+  bool valid = read_file<uint64_t>(file.path()) == data;
+  fmt::println("async writer without close: {}", valid ? "passed" : "FAILED");
+  if (!valid) {
+    exit(-1);
+  }
+}
+#endif
+
+// same input and budget, only the io of the merge phase differs
+void compare_io_backends() {
+  std::vector<uint64_t> keys(1 << 22);
+  workload::fill_uniform(keys, 0, 1 << 30);
+  external_sort_options options{};
+  options.memory_budget = 1 << 20;
+  options.block_size = 16 << 10;
+  options.max_fan_in = 16;
+  options.io = io_backend::sync;
+  double sync_ms = check_sort("sync io", keys, options).merge_ms;
+  for (io_backend backend : {io_backend::thread_pool, io_backend::io_uring}) {
+    options.io = backend;
+    try {
+      double ms = check_sort(to_string(backend), keys, options).merge_ms;
+      fmt::println("{}: merge speedup over sync io {:.2f}x", to_string(backend),
+                   sync_ms / ms);
+    } catch (const std::exception &e) {
+      fmt::println("{}: not available ({})", to_string(backend), e.what());
+    }
+  }
+}
+
+void check_run_generator() {
+  std::vector<uint64_t> data(1 << 20);
+  workload::fill_uniform(data, 0, 1 << 30);
+  range_cursor<std::vector<uint64_t>::const_iterator> cursor{data};
+  run_generator<uint64_t> generator{1 << 16};
+  vector_run_sink<uint64_t> sink{};
+  run_stats stats = generator.generate(cursor, sink);
+  uint64_t total = 0;
+  for (auto &run : sink.runs) {
+    assert(std::is_sorted(run.begin(), run.end()));
+    total += run.size();
+  }
+  assert(total == data.size() && stats.records == data.size());
+  assert(stats.runs == sink.runs.size());
+  // the classic result for random input: runs are twice the heap size
+  assert(stats.length_ratio() > 1.9 && stats.length_ratio() < 2.1);
+  fmt::println("replacement selection: capacity {}, {} runs, length min {} / "
+               "avg {:.1f} / max {} ({:.2f}x capacity)",
+               stats.capacity, stats.runs, stats.min_run_length,
+               stats.average_run_length(), stats.max_run_length,
+               stats.length_ratio());
+}
+
+// bytes rewritten by merging level by level, groups of fan_in in run order
+uint64_t level_merge_bytes(std::vector<uint64_t> runs, size_t fan_in) {
+  uint64_t bytes = 0;
+  while (runs.size() > 1) {
+    std::vector<uint64_t> next;
+    for (size_t i = 0; i < runs.size(); i += fan_in) {
+      size_t end = std::min(runs.size(), i + fan_in);
+      uint64_t merged = 0;
+      for (size_t j = i; j < end; j++) {
+        merged += runs[j];
+      }
+      bytes += end - i > 1 ? merged : 0;
+      next.push_back(merged);
+    }
+    runs = std::move(next);
+  }
+  return bytes;
+}
+
+bool check_plan(const merge_plan &plan, const std::vector<uint64_t> &runs,
+                size_t fan_in) {
+  // every run (initial or merged) is consumed exactly once, the last step
+  // writes the output
+  std::vector<int> used(runs.size() + plan.steps.size(), 0);
+  std::vector<uint64_t> bytes = runs;
+  uint64_t total = 0;
+  for (uint64_t r : runs) {
+    total += r;
+  }
+  bool valid = true;
+  for (size_t i = 0; i < plan.steps.size(); i++) {
+    auto &step = plan.steps[i];
+    valid &= !step.inputs.empty() && step.inputs.size() <= fan_in;
+    uint64_t sum = 0;
+    for (size_t id : step.inputs) {
+      if (id >= plan.output_id(i) || used[id]++ != 0) {
+        return false;
+      }
+      sum += bytes[id];
+    }
+    valid &= sum == step.bytes;
+    bytes.push_back(sum);
+  }
+  for (size_t id = 0; id + 1 < used.size(); id++) {
+    valid &= used[id] == 1;
+  }
+  valid &= runs.empty() || plan.steps.back().bytes == total;
+  return valid && plan.bytes_written == plan.intermediate_bytes + total;
+}
+
+void check_merge_planner() {
+  auto expect = [](bool valid, const char *what) {
+    if (!valid) {
+      fmt::println("merge planner check FAILED: {}", what);
+      exit(-1);
+    }
+  };
+  // the textbook binary huffman tree: (2 4) (5 6) (7 11)
+  std::vector<uint64_t> runs{5, 2, 4, 7};
+  merge_plan plan = plan_merge(runs, 2);
+  expect(check_plan(plan, runs, 2) && plan.steps.size() == 3 &&
+             plan.intermediate_bytes == 6 + 11,
+         "huffman tree");
+
+  // one run still gets copied to the output, no run needs no step
+  plan = plan_merge({42}, 4);
+  expect(plan.steps.size() == 1 && plan.bytes_written == 42, "one run");
+  expect(plan_merge({}, 4).steps.empty(), "no run");
+
+  std::vector<uint64_t> lengths(1000);
+  workload::fill_zipf(lengths, 100000, 0.8);
+  for (size_t fan_in : {2, 3, 8, 16}) {
+    for (size_t n : {2, 5, 16, 17, 100, 1000}) {
+      runs.assign(lengths.begin(), lengths.begin() + n);
+      merge_plan huffman = plan_merge(runs, fan_in);
+      merge_plan polyphase =
+          plan_merge(runs, fan_in, merge_schedule::polyphase);
+      expect(check_plan(huffman, runs, fan_in), "huffman plan");
+      expect(check_plan(polyphase, runs, fan_in), "polyphase plan");
+      expect(huffman.intermediate_bytes <= polyphase.intermediate_bytes &&
+                 huffman.intermediate_bytes <= level_merge_bytes(runs, fan_in),
+             "huffman is optimal");
+      expect(n > fan_in ||
+                 (huffman.steps.size() == 1 && polyphase.steps.size() == 1),
+             "single step");
+    }
+  }
+  runs.assign(lengths.begin(), lengths.end());
+  fmt::println("merge plans of 1000 zipf runs, fan-in 8: level by level {} "
+               "intermediate bytes",
+               level_merge_bytes(runs, 8));
+  for (auto schedule : {merge_schedule::huffman, merge_schedule::polyphase}) {
+    plan = plan_merge(runs, 8, schedule);
+    fmt::println("  {}: {}, {:.3f}s at 500MB/s", to_string(schedule),
+                 plan.to_string(), plan.cost(500e6, 500e6));
+  }
+
+  // runs of very different lengths: sorted stretches make replacement
+  // selection emit long runs between the short ones
+  std::vector<uint64_t> keys(1 << 19);
+  workload::fill_uniform(keys, 0, 1000000);
+  for (size_t i = 0; i < keys.size(); i += 1 << 15) {
+    size_t n = std::min<size_t>(keys.size() - i, (i >> 15) % 3 == 0 ? 1 << 15
+                                                                    : 1 << 10);
+    std::sort(keys.begin() + i, keys.begin() + i + n);
+  }
+  external_sort_options options{};
+  options.memory_budget = 64 << 10;
+  options.block_size = 4 << 10;
+  options.max_fan_in = 4;
+  options.io = io_backend::sync;
+  for (auto schedule : {merge_schedule::huffman, merge_schedule::polyphase}) {
+    options.schedule = schedule;
+    auto stats = check_sort(fmt::format("unequal runs, {} merge plan",
+                                        to_string(schedule)),
+                            keys, options);
+    // the planned io is exactly the io of the merge phase
+    uint64_t data = stats.records * sizeof(uint64_t);
+    expect(stats.bytes_read == data + stats.plan.bytes_read &&
+               stats.bytes_written == data + stats.plan.bytes_written,
+           "planned io");
+    fmt::println("  {}", stats.plan.to_string());
+  }
+}
+
+int main() {
+  check_run_generator();
+
+  external_sort_options small{};
+  small.memory_budget = 64 << 10;
+  small.block_size = 4 << 10;
+  small.max_fan_in = 8;
+
+  std::vector<uint64_t> keys(1 << 20);
+  workload::fill_uniform(keys, 0, 1000000);
+  check_sort("uniform uint64", keys, small);
+  small.io = io_backend::sync;
+  check_sort("uniform uint64 (sync io)", keys, small);
+  small.io = io_backend::automatic;
+
+  workload::fill_sorted_swaps(keys, 1000);
+  check_sort("nearly sorted uint64", keys, small);
+
+  std::reverse(keys.begin(), keys.end());
+  check_sort("reversed uint64", keys, small);
+
+  check_sort("empty", std::vector<uint64_t>{}, small);
+
+  std::vector<record> records(1 << 18);
+  std::vector<uint64_t> record_keys(records.size());
+  workload::fill_zipf(record_keys, 1000, 1.0);
+  for (size_t i = 0; i < records.size(); i++) {
+    records[i] = {record_keys[i], i};
+  }
+  check_sort("zipf records", records, small);
+  small.merge_threads = 4;
+  check_sort("zipf records (4 merge threads)", records, small);
+  workload::fill_uniform(keys, 0, 1000000);
+  check_sort("uniform uint64 (4 merge threads)", keys, small);
+  check_sort("empty (4 merge threads)", std::vector<uint64_t>{}, small);
+  small.merge_threads = 1;
+
+  // default options: everything fits in one run
+  check_sort("uniform uint64 (in memory)", keys, external_sort_options{});
+
+  check_merge_planner();
+  check_run_codec();
+#ifdef EXTERNAL_ASYNC_IO
+  check_async_writer();
+#endif
+#ifdef EXTERNAL_MMAP_SORT
+  check_mmap_sort();
+#endif
+  compare_run_formats();
+  compare_io_backends();
+  return 0;
+}
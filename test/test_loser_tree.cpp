@@ -0,0 +1,200 @@
+#include "loser_tree.hpp"
+#include "parallel_merge.hpp"
+#include "workload.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include <fmt/core.h>
+
+namespace ch = std::chrono;
+
+using sources_t = std::vector<std::vector<uint64_t>>;
+
+sources_t make_sources(size_t k, size_t total, uint64_t seed) {
+  std::vector<uint64_t> data(total);
+  workload::fill_raw(data.data(), total, seed, 0, [](uint64_t r) { return r; });
+  sources_t sources(k);
+  for (size_t i = 0; i < total; i++) {
+    sources[data[i] % k].push_back(data[i]);
+  }
+  for (auto &s : sources) {
+    std::sort(s.begin(), s.end());
+  }
+  return sources;
+}
+
+std::vector<uint64_t> heap_merge(const sources_t &sources) {
+  using entry = std::pair<uint64_t, size_t>;
+  std::priority_queue<entry, std::vector<entry>, std::greater<>> heap;
+  std::vector<size_t> pos(sources.size());
+  size_t total = 0;
+  for (size_t i = 0; i < sources.size(); i++) {
+    total += sources[i].size();
+    if (!sources[i].empty()) {
+      heap.emplace(sources[i][0], i);
+    }
+  }
+  std::vector<uint64_t> res;
+  res.reserve(total);
+  while (!heap.empty()) {
+    auto [v, i] = heap.top();
+    heap.pop();
+    res.push_back(v);
+    if (++pos[i] < sources[i].size()) {
+      heap.emplace(sources[i][pos[i]], i);
+    }
+  }
+  return res;
+}
+
+std::vector<uint64_t> loser_tree_pop_n(const sources_t &sources) {
+  using cursor_type = range_cursor<std::vector<uint64_t>::const_iterator>;
+  std::vector<cursor_type> cursors;
+  size_t total = 0;
+  for (auto &s : sources) {
+    cursors.emplace_back(s);
+    total += s.size();
+  }
+  loser_tree<cursor_type> tree{std::move(cursors)};
+  std::vector<uint64_t> res(total);
+  size_t n = 0;
+  while (size_t m = tree.pop_n(res.data() + n, 4096)) {
+    n += m;
+  }
+  assert(n == total);
+  return res;
+}
+
+void check_correctness() {
+  // edge cases: no source, one source, empty sources and extreme values
+  std::vector<int> res;
+  loser_tree_merge(std::vector<std::vector<int>>{}, std::back_inserter(res));
+  assert(res.empty());
+  loser_tree_merge(std::vector<std::vector<int>>{{}, {}},
+                   std::back_inserter(res));
+  assert(res.empty());
+  loser_tree_merge(std::vector<std::vector<int>>{{1, 2, 3}},
+                   std::back_inserter(res));
+  assert((res == std::vector<int>{1, 2, 3}));
+  res.clear();
+  constexpr int int_max = std::numeric_limits<int>::max();
+  constexpr int int_min = std::numeric_limits<int>::min();
+  loser_tree_merge(std::vector<std::vector<int>>{{int_max, int_max},
+                                                 {},
+                                                 {int_min, 0, int_max},
+                                                 {5}},
+                   std::back_inserter(res));
+  assert((res == std::vector<int>{int_min, 0, 5, int_max, int_max, int_max}));
+
+  // equal keys come out in source order
+  using item = std::pair<int, int>;
+  auto by_first = [](const item &a, const item &b) {
+    return a.first < b.first;
+  };
+  std::vector<std::vector<item>> items{
+      {{1, 0}, {2, 0}}, {{1, 1}, {2, 1}}, {{0, 2}, {1, 2}, {2, 2}}};
+  std::vector<item> merged;
+  loser_tree_merge(items, std::back_inserter(merged), by_first);
+  assert(std::is_sorted(merged.begin(), merged.end()));
+
+  // random sources with k not a power of 2
+  for (size_t k : {1, 2, 3, 7, 64, 1000, 1025}) {
+    sources_t sources = make_sources(k, 100000, k);
+    assert(heap_merge(sources) == loser_tree_pop_n(sources));
+  }
+  fmt::println("loser tree correctness check passed");
+}
+
+void check_parallel_merge() {
+  // few distinct keys: many equal keys straddle the cuts
+  using item = std::pair<uint32_t, uint32_t>;
+  auto by_first = [](const item &a, const item &b) {
+    return a.first < b.first;
+  };
+  for (size_t k : {1, 2, 5, 64, 300}) {
+    std::vector<uint64_t> keys(200000);
+    workload::fill_uniform(keys, 0, 20, k);
+    std::vector<std::vector<item>> sources(k);
+    for (size_t i = 0; i < keys.size(); i++) {
+      sources[i % k].push_back({static_cast<uint32_t>(keys[i]),
+                                static_cast<uint32_t>(i)});
+    }
+    for (auto &s : sources) {
+      std::stable_sort(s.begin(), s.end(), by_first);
+    }
+    std::vector<item> expected;
+    loser_tree_merge(sources, std::back_inserter(expected), by_first);
+    for (unsigned threads : {1u, 2u, 3u, 8u}) {
+      std::vector<item> actual;
+      parallel_merge(sources, actual, threads, by_first);
+      assert(actual == expected);
+    }
+    // every cut is consistent with the sequential merge
+    std::vector<sorted_view<item>> views;
+    for (auto &s : sources) {
+      views.push_back({s.data(), s.size()});
+    }
+    for (uint64_t rank : {uint64_t{0}, uint64_t{1}, uint64_t{777},
+                          uint64_t{keys.size() / 2}, uint64_t{keys.size()}}) {
+      std::vector<size_t> pos = multiway_split(views, rank, by_first);
+      std::vector<item> left;
+      for (size_t i = 0; i < k; i++) {
+        left.insert(left.end(), sources[i].begin(),
+                    sources[i].begin() + pos[i]);
+      }
+      std::sort(left.begin(), left.end());
+      std::vector<item> prefix(expected.begin(), expected.begin() + rank);
+      std::sort(prefix.begin(), prefix.end());
+      assert(left == prefix);
+    }
+  }
+  fmt::println("parallel merge correctness check passed");
+}
+
+template <typename Func>
+double measure(const sources_t &sources, Func &&func,
+               std::vector<uint64_t> &res) {
+  auto start = ch::steady_clock::now();
+  res = func(sources);
+  auto end = ch::steady_clock::now();
+  return ch::duration<double, std::milli>(end - start).count();
+}
+
+void benchmark() {
+  constexpr size_t total = 1 << 21;
+  for (size_t k : {16, 256, 1024, 4096}) {
+    sources_t sources = make_sources(k, total, 42);
+    std::vector<uint64_t> expected, actual;
+    double heap_ms = measure(sources, heap_merge, expected);
+    double tree_ms = measure(sources, loser_tree_pop_n, actual);
+    assert(expected == actual);
+    unsigned threads = std::max(4u, std::thread::hardware_concurrency());
+    double parallel_ms =
+        measure(sources,
+                [&](const sources_t &s) {
+                  std::vector<uint64_t> res;
+                  parallel_merge(s, res, threads);
+                  return res;
+                },
+                actual);
+    assert(expected == actual);
+    fmt::println("k = {:4}: priority_queue {:8.3f}ms, loser tree {:8.3f}ms "
+                 "({:.1f} M/s), parallel ({} threads) {:8.3f}ms",
+                 k, heap_ms, tree_ms, total / tree_ms / 1000.0, threads,
+                 parallel_ms);
+  }
+}
+
+int main() {
+  check_correctness();
+  check_parallel_merge();
+  benchmark();
+  return 0;
+}
@@ -1,20 +1,34 @@
 #include "bubble_sort.hpp"
+#include "funnel_sort.hpp"
 #include "insert_sort.hpp"
 #include "merge_sort.hpp"
 #include "radix_sort.hpp"
+#include "scratch_arena.hpp"
 #include "select_sort.hpp"
+#include "sorting_network.hpp"
+#include "string_sort.hpp"
 
+#include "counted_integer.hpp"
 #include "integer.hpp"
+#include "perf_counter.hpp"
 #include "random_vector.hpp"
+#include "sequenced_integer.hpp"
+#include "workload.hpp"
 
 #include <algorithm>
+#include <array>
 #include <cassert>
 #include <chrono>
+#include <cmath>
+#include <cstdlib>
 #include <functional>
 #include <limits>
 #include <mutex>
+#include <new>
 #include <numeric>
 #include <queue>
+#include <string>
+#include <string_view>
 #include <thread>
 #include <unordered_map>
 
@@ -44,30 +58,118 @@ SortFunc<T> std_sort = [](std::vector<T> &v) { std::sort(v.begin(), v.end()); };
 std::queue<std::function<void()>> log_queue;
 std::mutex log_mutex;
 
+// global heap allocations of this thread, scratch_check expects none. every
+// replaceable form of new / delete is replaced, all of them on malloc / free
+thread_local size_t heap_allocations = 0;
+
+void *counted_alloc(size_t n, size_t align) {
+  heap_allocations++;
+  n = n ? n : 1;
+  if (align <= __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+    return std::malloc(n);
+  }
+  return std::aligned_alloc(align, (n + align - 1) / align * align);
+}
+
+void *counted_new(size_t n, size_t align) {
+  if (void *p = counted_alloc(n, align)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void *operator new(size_t n) { return counted_new(n, 0); }
+
+void *operator new[](size_t n) { return counted_new(n, 0); }
+
+void *operator new(size_t n, std::align_val_t a) {
+  return counted_new(n, static_cast<size_t>(a));
+}
+
+void *operator new[](size_t n, std::align_val_t a) {
+  return counted_new(n, static_cast<size_t>(a));
+}
+
+void *operator new(size_t n, const std::nothrow_t &) noexcept {
+  return counted_alloc(n, 0);
+}
+
+void *operator new[](size_t n, const std::nothrow_t &) noexcept {
+  return counted_alloc(n, 0);
+}
+
+void *operator new(size_t n, std::align_val_t a,
+                   const std::nothrow_t &) noexcept {
+  return counted_alloc(n, static_cast<size_t>(a));
+}
+
+void *operator new[](size_t n, std::align_val_t a,
+                     const std::nothrow_t &) noexcept {
+  return counted_alloc(n, static_cast<size_t>(a));
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete[](void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+void operator delete[](void *p, size_t) noexcept { std::free(p); }
+
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+
+void operator delete[](void *p, std::align_val_t) noexcept { std::free(p); }
+
+void operator delete(void *p, size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void *p, size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+  std::free(p);
+}
+
+void operator delete(void *p, std::align_val_t,
+                     const std::nothrow_t &) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void *p, std::align_val_t,
+                       const std::nothrow_t &) noexcept {
+  std::free(p);
+}
+
 template <typename T>
 void test_sort_algorithm(int round, const std::string &name, SortFunc<T> func,
                          std::vector<T> &v, bool nearly_sort_case = false) {
-  ch::steady_clock::duration total{};
+  // counters are bound to the worker thread which runs this test
+  PerfCounter counter{};
+  PerfCounter::Result total{};
   for (int i = 0; i < round; i++) {
     random_vector(v);
     if (nearly_sort_case) {
       // using shell sort (with d > 1) to generate nearly sort sequence
       shell_sort<T, std::less<>, 2>(v);
     }
-    auto start = ch::steady_clock::now();
+    PerfScope _{counter, total};
     func(v);
-    auto end = ch::steady_clock::now();
-    total += (end - start);
   }
-  LOG("test {} on {} data with {} rounds, avg: {:.3f}ms", name, v.size(), round,
-      static_cast<double>(ch::duration_cast<ch::microseconds>(total).count()) /
-          1000.0 / static_cast<double>(round));
+  LOG("test {} on {} data with {} rounds, avg: {:.3f}ms\n  {}", name, v.size(),
+      round, total.milliseconds() / static_cast<double>(round),
+      total.rates(static_cast<double>(v.size()) * round));
 }
 
 // using Int = Integer<false, false, false>;
 using Int = int;
 
-using StableInt = Integer;
+using StableInt = SequencedInteger;
 
 template <> struct fmt::formatter<StableInt> : ostream_formatter {};
 
@@ -75,11 +177,9 @@ void stable_check(const std::string &name, SortFunc<StableInt> func) {
   std::vector<StableInt> v;
   v.resize(10000);
   random_vector(v);
-  std::vector<StableInt> new_v1(v.begin(), v.end());
-  std::vector<StableInt> new_v2(v.begin(), v.end());
-  merge_sort<StableInt>(new_v1);
-  func(new_v2);
-  if (new_v1 != new_v2) {
+  assign_sequence(v);
+  func(v);
+  if (!is_stable_sorted(v)) {
     LOG("stable check failed, {} is not a stable sort algorithm!", name);
 
   } else {
@@ -103,11 +203,482 @@ void valid_check(const std::string &name, SortFunc<T> func) {
   }
 }
 
-int main() {
+using CountedInt = CountedInteger;
+
+template <> struct fmt::formatter<CountedInt> : ostream_formatter {};
+
+// counters are thread local, the snapshot only covers work done by `func` on
+// the calling thread
+void count_check(const std::string &name, SortFunc<CountedInt> func,
+                 int size) {
+  std::vector<CountedInt> v;
+  v.resize(size);
+  random_vector(v);
+  auto start = CountedInt::counters();
+  func(v);
+  auto delta = CountedInt::counters() - start;
+  LOG("operation count of {} on {} data:\n  {}", name, v.size(),
+      delta.to_string());
+}
+
+// one xoshiro256** step as a linear map of the 256 state bits, the jump
+// polynomials are checked against the 2^128th / 2^192nd power of it
+using xoshiro_state = std::array<uint64_t, 4>;
+
+xoshiro_state xoshiro_step(xoshiro_state s) {
+  const uint64_t t = s[1] << 17;
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = workload::rotl(s[3], 45);
+  return s;
+}
+
+// column j is the image of state bit j
+using xoshiro_matrix = std::vector<xoshiro_state>;
+
+xoshiro_state xoshiro_apply(const xoshiro_matrix &m, const xoshiro_state &s) {
+  xoshiro_state res{};
+  for (size_t j = 0; j < 256; j++) {
+    if (s[j / 64] >> (j % 64) & 1) {
+      for (size_t i = 0; i < 4; i++) {
+        res[i] ^= m[j][i];
+      }
+    }
+  }
+  return res;
+}
+
+xoshiro_state xoshiro_jump(const xoshiro_state &s, int log2_steps) {
+  xoshiro_matrix m(256);
+  for (size_t j = 0; j < 256; j++) {
+    xoshiro_state unit{};
+    unit[j / 64] = uint64_t{1} << (j % 64);
+    m[j] = xoshiro_step(unit);
+  }
+  for (int k = 0; k < log2_steps; k++) {
+    xoshiro_matrix squared(256);
+    for (size_t j = 0; j < 256; j++) {
+      squared[j] = xoshiro_apply(m, m[j]);
+    }
+    m = std::move(squared);
+  }
+  return xoshiro_apply(m, s);
+}
+
+// the generator against its spec: jump() / long_jump(), results independent
+// of the thread count, and the range and shape of every distribution
+void workload_check() {
+  auto fail = [](const char *what) {
+    fmt::println("workload check FAILED: {}", what);
+    exit(-1);
+  };
+  workload::Xoshiro256 rng{7};
+  workload::Xoshiro256 jumped = rng, long_jumped = rng;
+  jumped.jump();
+  long_jumped.long_jump();
+  if (jumped.state() != xoshiro_jump(rng.state(), 128) ||
+      long_jumped.state() != xoshiro_jump(rng.state(), 192)) {
+    fail("jump");
+  }
+
+  // not a multiple of the chunk or lane size, above the parallel threshold
+  constexpr size_t n = workload::PARALLEL_THRESHOLD + 12345;
+  auto same_for_threads = [&](auto fill) {
+    using T = typename decltype(fill(0u))::value_type;
+    std::vector<T> single = fill(1u);
+    for (unsigned threads : {0u, 3u, 8u}) {
+      if (fill(threads) != single) {
+        fail("result depends on the thread count");
+      }
+    }
+    return single;
+  };
+
+  std::vector<int64_t> v = same_for_threads([&](unsigned threads) {
+    std::vector<int64_t> res(n);
+    workload::fill_uniform(res, -5, 5, 1, threads);
+    return res;
+  });
+  std::vector<size_t> counts(11);
+  for (int64_t x : v) {
+    if (x < -5 || x > 5) {
+      fail("uniform out of range");
+    }
+    counts[static_cast<size_t>(x + 5)]++;
+  }
+  for (size_t c : counts) {
+    if (c < n / 11 * 95 / 100 || c > n / 11 * 105 / 100) {
+      fail("uniform not flat");
+    }
+  }
+  // the chunks are seeded apart
+  if (std::equal(v.begin(), v.begin() + 1000,
+                 v.begin() + workload::CHUNK_SIZE)) {
+    fail("chunks repeat");
+  }
+  // the full int64 range and one above 2^32
+  v = same_for_threads([&](unsigned threads) {
+    std::vector<int64_t> res(n);
+    workload::fill_uniform(res, INT64_MIN, INT64_MAX, 2, threads);
+    return res;
+  });
+  if (std::count_if(v.begin(), v.end(), [](int64_t x) { return x < 0; }) <
+      static_cast<ptrdiff_t>(n * 49 / 100)) {
+    fail("uniform over int64 not symmetric");
+  }
+  workload::fill_uniform(v, -(int64_t{1} << 40), int64_t{1} << 40, 3);
+  auto [lo, hi] = std::minmax_element(v.begin(), v.end());
+  if (*lo < -(int64_t{1} << 40) || *hi > int64_t{1} << 40 ||
+      *lo > -(int64_t{1} << 39) || *hi < int64_t{1} << 39) {
+    fail("uniform above 2^32");
+  }
+
+  v = same_for_threads([&](unsigned threads) {
+    std::vector<int64_t> res(n);
+    workload::fill_normal(res, 1000.0, 100.0, 4, threads);
+    return res;
+  });
+  double mean = std::accumulate(v.begin(), v.end(), 0.0) / n;
+  double var = 0;
+  size_t within = 0;
+  for (int64_t x : v) {
+    var += (x - mean) * (x - mean);
+    within += x >= 900 && x <= 1100;
+  }
+  double stddev = std::sqrt(var / n);
+  // 68.3% within one standard deviation, + rounding to integers
+  if (std::abs(mean - 1000) > 1 || std::abs(stddev - 100) > 1 ||
+      within < n * 67 / 100 || within > n * 70 / 100) {
+    fail("normal");
+  }
+
+  v = same_for_threads([&](unsigned threads) {
+    std::vector<int64_t> res(n);
+    workload::fill_zipf(res, 1000, 0.9, 5, threads);
+    return res;
+  });
+  counts.assign(1000, 0);
+  for (int64_t x : v) {
+    if (x < 0 || x >= 1000) {
+      fail("zipf out of range");
+    }
+    counts[static_cast<size_t>(x)]++;
+  }
+  // P(k) / P(j) = ((j + 1) / (k + 1))^s
+  auto ratio = [&](size_t k, size_t j) {
+    return static_cast<double>(counts[k]) / static_cast<double>(counts[j]);
+  };
+  if (std::abs(ratio(0, 1) - std::pow(2.0, 0.9)) > 0.05 ||
+      std::abs(ratio(0, 9) - std::pow(10.0, 0.9)) > 0.4 ||
+      std::abs(ratio(9, 99) - std::pow(10.0, 0.9)) > 1.0 || counts[999] == 0) {
+    fail("zipf shape");
+  }
+
+  v = same_for_threads([&](unsigned threads) {
+    std::vector<int64_t> res(n);
+    workload::fill_few_unique(res, 10, 7, 6, threads);
+    return res;
+  });
+  counts.assign(10, 0);
+  for (int64_t x : v) {
+    if (x < 0 || x % 7 != 0 || x >= 70) {
+      fail("few unique out of range");
+    }
+    counts[static_cast<size_t>(x / 7)]++;
+  }
+  if (*std::min_element(counts.begin(), counts.end()) < n / 10 * 95 / 100) {
+    fail("few unique not flat");
+  }
+
+  v = same_for_threads([&](unsigned threads) {
+    std::vector<int64_t> res(n);
+    workload::fill_sorted_swaps(res, 100, 8, threads);
+    return res;
+  });
+  size_t moved = 0;
+  for (size_t i = 0; i < n; i++) {
+    moved += v[i] != static_cast<int64_t>(i);
+  }
+  std::vector<int64_t> sorted = v;
+  std::sort(sorted.begin(), sorted.end());
+  for (size_t i = 0; i < n; i++) {
+    if (sorted[i] != static_cast<int64_t>(i)) {
+      fail("sorted swaps is not a permutation");
+    }
+  }
+  if (moved == 0 || moved > 200) {
+    fail("sorted swaps");
+  }
+  LOG("workload check passed on {} elements", n);
+}
+
+// url and log like keys with long shared prefixes, all views point into one
+// arena
+std::vector<std::string_view> string_keys(std::string &arena, size_t n) {
+  std::vector<uint64_t> ids(n), kinds(n);
+  workload::fill_zipf(ids, 100000, 0.9);
+  workload::fill_uniform(kinds, 0, 3);
+  const char *prefixes[] = {"https://example.com/api/v1/users/",
+                            "https://example.com/api/v1/orders/",
+                            "https://example.com/static/",
+                            "2024-05-01T12:00:00Z INFO request "};
+  std::vector<size_t> offsets;
+  for (size_t i = 0; i < n; i++) {
+    offsets.push_back(arena.size());
+    arena += fmt::format("{}{}/{}", prefixes[kinds[i]], ids[i], i % 7);
+  }
+  offsets.push_back(arena.size());
+  std::vector<std::string_view> keys;
+  for (size_t i = 0; i < n; i++) {
+    keys.emplace_back(arena.data() + offsets[i], offsets[i + 1] - offsets[i]);
+  }
+  return keys;
+}
+
+void string_sort_check() {
+  std::string arena;
+  std::vector<std::string_view> keys = string_keys(arena, 200000);
+  // bytes above 127 and embedded zeros order like memcmp
+  using namespace std::string_view_literals;
+  for (auto key : {"ab\0c"sv, "ab"sv, "ab\xff"sv, "\x80"sv, ""sv, "ab\0"sv}) {
+    keys.push_back(key);
+  }
+  std::vector<std::string_view> expected = keys;
+  std::stable_sort(expected.begin(), expected.end());
+  auto same_views = [](const std::vector<std::string_view> &a,
+                       const std::vector<std::string_view> &b) {
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(),
+                      [](std::string_view x, std::string_view y) {
+                        return x.data() == y.data() && x.size() == y.size();
+                      });
+  };
+  auto expect = [](bool valid, const char *what) {
+    if (!valid) {
+      fmt::println("string sort check FAILED: {}", what);
+      exit(-1);
+    }
+  };
+
+  std::vector<std::string_view> v = keys;
+  multikey_quicksort(v);
+  expect(v == expected, "multikey_quicksort");
+  v = keys;
+  std::vector<size_t> lcp(v.size());
+  lcp_merge_sort(v.data(), v.size(), lcp.data());
+  expect(same_views(v, expected), "lcp_merge_sort");
+  for (size_t i = 1; i < v.size(); i++) {
+    size_t h = 0;
+    while (h < v[i - 1].size() && h < v[i].size() && v[i - 1][h] == v[i][h]) {
+      h++;
+    }
+    expect(lcp[i] == h, "lcp_merge_sort lcp");
+  }
+
+  // merging two sorted halves with their lcp arrays
+  size_t half = keys.size() / 2;
+  std::vector<std::string_view> a(keys.begin(), keys.begin() + half);
+  std::vector<std::string_view> b(keys.begin() + half, keys.end());
+  std::vector<size_t> a_lcp(a.size()), b_lcp(b.size());
+  lcp_merge_sort(a.data(), a.size(), a_lcp.data());
+  lcp_merge_sort(b.data(), b.size(), b_lcp.data());
+  std::vector<std::string_view> merged(keys.size());
+  std::vector<size_t> merged_lcp(keys.size());
+  lcp_merge(a.data(), a_lcp.data(), a.size(), b.data(), b_lcp.data(),
+            b.size(), merged.data(), merged_lcp.data());
+  expect(same_views(merged, expected) && merged_lcp == lcp, "lcp_merge");
+  LOG("string sort check passed on {} keys", keys.size());
+
+  std::unordered_map<std::string, SortFunc<std::string_view>> funcs{
+      FuncPair(multikey_quicksort<std::string_view>),
+      FuncPair(lcp_merge_sort<std::string_view>),
+      FuncPair(std_sort<std::string_view>)};
+  for (auto &[name, func] : funcs) {
+    double ms = 0;
+    for (int round = 0; round < 5; round++) {
+      v = keys;
+      auto start = ch::steady_clock::now();
+      func(v);
+      ms += ch::duration<double, std::milli>(ch::steady_clock::now() - start)
+                .count();
+    }
+    LOG("test {} on {} string keys with 5 rounds, avg: {:.3f}ms", name,
+        keys.size(), ms / 5);
+  }
+}
+
+// binary merge sorts against the cache oblivious funnel sort from 1MB up,
+// the miss counters are only there if the kernel lets us open them
+void funnel_sort_benchmark(size_t max_bytes) {
+  std::unordered_map<std::string, SortFunc<uint64_t>> funcs{
+      FuncPair(merge_sort<uint64_t>),
+      FuncPair(merge_sort_nonrecursive<uint64_t>),
+      FuncPair(funnel_sort<uint64_t>)};
+  PerfCounter counter{};
+  std::vector<uint64_t> v;
+  for (size_t bytes = 1 << 20; bytes <= max_bytes; bytes <<= 2) {
+    v.resize(bytes / sizeof(uint64_t));
+    for (auto &[name, func] : funcs) {
+      workload::fill_uniform(v, 0, INT64_MAX);
+      PerfCounter::Result result{};
+      {
+        PerfScope _{counter, result};
+        func(v);
+      }
+      assert(std::is_sorted(v.begin(), v.end()));
+      LOG("test {} on {}MB: {:.3f}ms\n  {}", name, bytes >> 20,
+          result.milliseconds(), result.rates(static_cast<double>(v.size())));
+    }
+  }
+}
+
+// sorted at compile time
+constexpr std::array<int, 7> constexpr_sorted = [] {
+  std::array<int, 7> a{5, 3, 7, 1, 6, 2, 4};
+  network_sort(a);
+  return a;
+}();
+static_assert(constexpr_sorted[0] == 1 && constexpr_sorted[3] == 4 &&
+              constexpr_sorted[6] == 7);
+static_assert(network_size<9> == 25 && network_size<16> == 60);
+
+// 0-1 principle: a network sorts everything iff it sorts all 2^N bit inputs
+template <size_t N> bool sorts_all_bits() {
+  std::array<uint8_t, N> a{};
+  for (uint32_t bits = 0; bits < (uint32_t{1} << N); bits++) {
+    for (size_t i = 0; i < N; i++) {
+      a[i] = bits >> i & 1;
+    }
+    network_sort(a);
+    if (!std::is_sorted(a.begin(), a.end())) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <size_t... N> void check_networks(std::index_sequence<N...>) {
+  bool valid = (sorts_all_bits<N>() && ...);
+  LOG("sorting networks of 0..{} elements: {}", sizeof...(N) - 1,
+      valid ? "passed" : "FAILED");
+}
+
+// median of every window of N, a network on a std::array against
+// insert_sort on a std::vector
+template <size_t N> void network_median_benchmark(const std::vector<int> &v) {
+  int64_t sum_network = 0, sum_insert = 0;
+  auto start = ch::steady_clock::now();
+  for (size_t i = 0; i + N <= v.size(); i++) {
+    std::array<int, N> window;
+    std::copy(v.begin() + i, v.begin() + i + N, window.begin());
+    network_sort(window);
+    sum_network += window[N / 2];
+  }
+  auto mid = ch::steady_clock::now();
+  for (size_t i = 0; i + N <= v.size(); i++) {
+    std::vector<int> window(v.begin() + i, v.begin() + i + N);
+    insert_sort(window);
+    sum_insert += window[N / 2];
+  }
+  auto end = ch::steady_clock::now();
+  if (sum_network != sum_insert) {
+    fmt::println("network median of {} FAILED", N);
+    exit(-1);
+  }
+  // the sum is printed, so neither loop can be optimized away
+  LOG("median of {} windows of {}: network_sort {:.3f}ms ({} compare "
+      "exchanges), insert_sort {:.3f}ms, sum of medians {}",
+      v.size() - N + 1, N,
+      ch::duration<double, std::milli>(mid - start).count(),
+      network_size<N>, ch::duration<double, std::milli>(end - mid).count(),
+      sum_network);
+}
+
+void sorting_network_check() {
+  check_networks(std::make_index_sequence<19>{});
+  // larger batcher networks on random data
+  std::vector<int> v(1 << 16);
+  random_vector(v);
+  for (size_t i = 0; i + 100 <= v.size(); i += 100) {
+    std::array<int, 100> a;
+    std::copy(v.begin() + i, v.begin() + i + 100, a.begin());
+    network_sort(a, std::greater<>());
+    assert(std::is_sorted(a.begin(), a.end(), std::greater<>()));
+  }
+  network_median_benchmark<3>(v);
+  network_median_benchmark<9>(v);
+  network_median_benchmark<16>(v);
+}
+
+// sort in an arena of exactly the queried size: the result must be right,
+// the arena must suffice and the global heap must stay untouched
+template <typename T>
+void scratch_check(const std::string &name, SortFunc<T> func,
+                   size_t (*scratch)(size_t), const std::vector<T> &input) {
+  std::vector<T> expected = input;
+  std::stable_sort(expected.begin(), expected.end());
+  for (const std::vector<T> &data : {input, expected}) {
+    std::vector<T> v = data;
+    scratch_buffer<> buffer;
+    scratch_arena &arena = buffer.reserve(scratch(v.size()));
+    size_t allocations = heap_allocations;
+    {
+      scratch_scope _{arena};
+      func(v);
+    }
+    if (heap_allocations != allocations || v != expected ||
+        arena.used() != 0 || arena.peak() > scratch(v.size())) {
+      fmt::println("scratch check FAILED: {} on {} elements", name, v.size());
+      exit(-1);
+    }
+  }
+  LOG("scratch check passed: {} on {} elements", name, input.size());
+}
+
+void scratch_checks() {
+  for (size_t n : {0, 1, 2, 17, 1000, 100000}) {
+    std::vector<Int> v(n);
+    random_vector(v);
+    scratch_check<Int>(FuncWithName(merge_sort<Int>), merge_sort_scratch<Int>,
+                       v);
+    scratch_check<Int>(FuncWithName(merge_sort_nonrecursive<Int>),
+                       merge_sort_nonrecursive_scratch<Int>, v);
+    scratch_check<Int>(FuncWithName(quick_sort_nonrecursive<Int>),
+                       quick_sort_nonrecursive_scratch, v);
+    scratch_check<Int>(FuncWithName(radix_sort<Int>), radix_sort_scratch<Int>,
+                       v);
+    scratch_check<Int>(FuncWithName(funnel_sort<Int>),
+                       funnel_sort_scratch<Int>, v);
+    // the in place sorts need no scratch at all
+    scratch_check<Int>(FuncWithName(heap_sort<Int>),
+                       [](size_t) { return size_t{0}; }, v);
+    scratch_check<Int>(FuncWithName(shell_sort<Int>),
+                       [](size_t) { return size_t{0}; }, v);
+  }
+  std::string arena;
+  std::vector<std::string_view> keys = string_keys(arena, 100000);
+  scratch_check<std::string_view>(
+      FuncWithName(multikey_quicksort<std::string_view>),
+      multikey_quicksort_scratch, keys);
+  scratch_check<std::string_view>(
+      FuncWithName(lcp_merge_sort<std::string_view>),
+      [](size_t n) { return lcp_merge_sort_scratch(n); }, keys);
+}
+
+int main(int argc, char *argv[]) {
   constexpr int test_size = 1000;
   constexpr int round = 10;
   constexpr bool nearly_sort_case = true;
 
+  workload_check();
+  string_sort_check();
+  sorting_network_check();
+  scratch_checks();
+  // the largest array in MB can be given on the command line
+  funnel_sort_benchmark((argc > 1 ? std::stoull(argv[1]) : 16) << 20);
+
   stable_check(FuncWithName(insert_sort<StableInt>));
   stable_check(FuncWithName(insert_sort_with_binary_search<StableInt>));
   stable_check(FuncWithName(shell_sort<StableInt>));
@@ -116,9 +687,20 @@ int main() {
   stable_check(FuncWithName(select_sort<StableInt>));
   stable_check(FuncWithName(heap_sort<StableInt>));
   stable_check(FuncWithName(merge_sort<StableInt>));
+  stable_check(FuncWithName(funnel_sort<StableInt>));
   stable_check(FuncWithName(radix_sort<StableInt>));
   stable_check(FuncWithName(std_sort<StableInt>));
 
+  count_check(FuncWithName(insert_sort<CountedInt>), test_size);
+  count_check(FuncWithName(shell_sort<CountedInt>), test_size);
+  count_check(FuncWithName(quick_sort_nonrecursive<CountedInt>), test_size);
+  count_check(FuncWithName(heap_sort<CountedInt>), test_size);
+  count_check(FuncWithName(merge_sort<CountedInt>), test_size);
+  count_check(FuncWithName(merge_sort_nonrecursive<CountedInt>), test_size);
+  count_check(FuncWithName(funnel_sort<CountedInt>), test_size);
+  count_check(FuncWithName(radix_sort<CountedInt>), test_size);
+  count_check(FuncWithName(std_sort<CountedInt>), test_size);
+
   std::unordered_map<std::string, SortFunc<Int>> test_funcs{
       // FuncPair(insert_sort<Integer>),
       // FuncPair(insert_sort_with_binary_search<Integer>),
@@ -127,7 +709,8 @@ int main() {
       // FuncPair(quick_sort<Int>),
       FuncPair(quick_sort_nonrecursive<Int>), FuncPair(heap_sort<Int>),
       FuncPair(heap_sort_with_function_call<Int>), FuncPair(merge_sort<Int>),
-      FuncPair(merge_sort_nonrecursive<Int>), FuncPair(std_sort<Int>)};
+      FuncPair(merge_sort_nonrecursive<Int>), FuncPair(funnel_sort<Int>),
+      FuncPair(std_sort<Int>)};
 
   std::queue<std::function<void(std::vector<Int> &)>> task_queue;
   std::vector<std::thread> thread_pool;
@@ -152,6 +735,10 @@ int main() {
             task_queue.pop();
           }
         }
+        if (!work) {
+          std::this_thread::yield();
+          continue;
+        }
         work(v);
         // execute work load
       }
@@ -0,0 +1,188 @@
+#include "sorted_set.hpp"
+#include "workload.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <fmt/core.h>
+
+namespace ch = std::chrono;
+
+template <typename T>
+std::vector<T> sorted_keys(size_t n, int64_t hi, uint64_t seed) {
+  std::vector<T> v(n);
+  workload::fill_uniform(v.data(), n, 0, hi, seed);
+  std::sort(v.begin(), v.end());
+  return v;
+}
+
+template <typename T> std::vector<T> dedup(std::vector<T> v) {
+  v.erase(std::unique(v.begin(), v.end()), v.end());
+  return v;
+}
+
+// run op(out) with out = buffer and out = nullptr, both must give expected
+template <typename T, typename Op>
+void check_op(const char *name, const std::vector<T> &expected, size_t bound,
+              Op op) {
+  std::vector<T> out(bound);
+  size_t n = op(out.data());
+  out.resize(n);
+  if (out != expected || op(static_cast<T *>(nullptr)) != n) {
+    fmt::println("{} FAILED", name);
+    exit(-1);
+  }
+}
+
+template <typename T> void check_set_ops() {
+  uint64_t seed = 1;
+  for (size_t na : {0, 1, 7, 8, 9, 100, 1000}) {
+    for (size_t nb : {0, 3, 8, 64, 1000, 100000}) {
+      for (int64_t hi : {20, 5000, INT32_MAX}) {
+        std::vector<T> a = sorted_keys<T>(na, hi, seed++);
+        std::vector<T> b = sorted_keys<T>(nb, hi, seed++);
+        std::vector<T> ua = dedup(a), ub = dedup(b);
+
+        check_op("unique", ua, na, [&](T *out) {
+          return sorted_set::unique(a.data(), a.size(), out);
+        });
+        std::vector<T> in_place = a;
+        in_place.resize(
+            sorted_set::unique(in_place.data(), na, in_place.data()));
+        assert(in_place == ua);
+
+        std::vector<T> expected;
+        std::set_intersection(ua.begin(), ua.end(), ub.begin(), ub.end(),
+                              std::back_inserter(expected));
+        check_op("set_intersection", expected,
+                 std::min(ua.size(), ub.size()), [&](T *out) {
+                   return sorted_set::set_intersection(
+                       ua.data(), ua.size(), ub.data(), ub.size(), out);
+                 });
+        expected.clear();
+        std::set_union(ua.begin(), ua.end(), ub.begin(), ub.end(),
+                       std::back_inserter(expected));
+        check_op("set_union", expected, ua.size() + ub.size(), [&](T *out) {
+          return sorted_set::set_union(ua.data(), ua.size(), ub.data(),
+                                       ub.size(), out);
+        });
+        expected.clear();
+        std::set_difference(ua.begin(), ua.end(), ub.begin(), ub.end(),
+                            std::back_inserter(expected));
+        check_op("set_difference", expected, ua.size(), [&](T *out) {
+          return sorted_set::set_difference(ua.data(), ua.size(), ub.data(),
+                                            ub.size(), out);
+        });
+        expected.clear();
+        std::merge(a.begin(), a.end(), b.begin(), b.end(),
+                   std::back_inserter(expected));
+        check_op("merge", expected, na + nb, [&](T *out) {
+          return sorted_set::merge(a.data(), na, b.data(), nb, out);
+        });
+      }
+    }
+  }
+  // the top bit set, unsigned order must hold in the 64 bit min / max
+  std::vector<T> a{1, T(~T(0) >> 1) + 1, T(~T(0) - 1)};
+  std::vector<T> b{0, 2, T(~T(0) >> 1), T(~T(0))};
+  for (int i = 0; i < 8; i++) {
+    a.push_back(a.back());
+    std::sort(a.begin(), a.end());
+  }
+  std::vector<T> expected;
+  std::merge(a.begin(), a.end(), b.begin(), b.end(),
+             std::back_inserter(expected));
+  check_op("merge (top bit)", expected, a.size() + b.size(), [&](T *out) {
+    return sorted_set::merge(a.data(), a.size(), b.data(), b.size(), out);
+  });
+  fmt::println("sorted set ops on uint{}_t passed", sizeof(T) * 8);
+}
+
+template <typename Func> double time_ms(int rounds, Func func) {
+  auto start = ch::steady_clock::now();
+  for (int i = 0; i < rounds; i++) {
+    func();
+  }
+  return ch::duration<double, std::milli>(ch::steady_clock::now() - start)
+             .count() /
+         rounds;
+}
+
+template <typename T> void benchmark(size_t n) {
+  std::vector<T> a = dedup(sorted_keys<T>(n, 4 * n, 7));
+  std::vector<T> b = dedup(sorted_keys<T>(n, 4 * n, 8));
+  std::vector<T> small = dedup(sorted_keys<T>(n / 1000, 4 * n, 9));
+  std::vector<T> dup = sorted_keys<T>(n, n / 4, 10);
+  std::vector<T> out(2 * n);
+  constexpr int rounds = 10;
+  auto report = [&](const std::string &name, double ours, double std_ms) {
+    fmt::println("uint{}_t {}: {:.3f}ms, std {:.3f}ms ({:.2f}x)",
+                  sizeof(T) * 8, name, ours, std_ms, std_ms / ours);
+  };
+  report("unique", time_ms(rounds, [&] {
+           sorted_set::unique(dup.data(), dup.size(), out.data());
+         }),
+         time_ms(rounds, [&] {
+           std::unique_copy(dup.begin(), dup.end(), out.begin());
+         }));
+  report("set_intersection", time_ms(rounds, [&] {
+           sorted_set::set_intersection(a.data(), a.size(), b.data(),
+                                        b.size(), out.data());
+         }),
+         time_ms(rounds, [&] {
+           std::set_intersection(a.begin(), a.end(), b.begin(), b.end(),
+                                 out.begin());
+         }));
+  report("set_intersection (1:1000)", time_ms(rounds, [&] {
+           sorted_set::set_intersection(small.data(), small.size(), a.data(),
+                                        a.size(), out.data());
+         }),
+         time_ms(rounds, [&] {
+           std::set_intersection(small.begin(), small.end(), a.begin(),
+                                 a.end(), out.begin());
+         }));
+  report("set_intersection (count only)", time_ms(rounds, [&] {
+           sorted_set::set_intersection(a.data(), a.size(), b.data(),
+                                        b.size(), static_cast<T *>(nullptr));
+         }),
+         time_ms(rounds, [&] {
+           std::set_intersection(a.begin(), a.end(), b.begin(), b.end(),
+                                 out.begin());
+         }));
+  report("set_union", time_ms(rounds, [&] {
+           sorted_set::set_union(a.data(), a.size(), b.data(), b.size(),
+                                 out.data());
+         }),
+         time_ms(rounds, [&] {
+           std::set_union(a.begin(), a.end(), b.begin(), b.end(),
+                          out.begin());
+         }));
+  report("set_difference", time_ms(rounds, [&] {
+           sorted_set::set_difference(a.data(), a.size(), b.data(), b.size(),
+                                      out.data());
+         }),
+         time_ms(rounds, [&] {
+           std::set_difference(a.begin(), a.end(), b.begin(), b.end(),
+                               out.begin());
+         }));
+  report("merge", time_ms(rounds, [&] {
+           sorted_set::merge(a.data(), a.size(), b.data(), b.size(),
+                             out.data());
+         }),
+         time_ms(rounds, [&] {
+           std::merge(a.begin(), a.end(), b.begin(), b.end(), out.begin());
+         }));
+}
+
+int main() {
+  check_set_ops<uint32_t>();
+  check_set_ops<uint64_t>();
+  benchmark<uint32_t>(1 << 20);
+  benchmark<uint64_t>(1 << 20);
+  return 0;
+}
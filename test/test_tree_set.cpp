@@ -1,20 +1,40 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
 #include <functional>
+#include <iterator>
 #include <iostream>
 #include <queue>
 #include <random>
 #include <set>
 #include <sstream>
+#include <string>
+#include <thread>
 #include <type_traits>
+#include <utility>
+#include <vector>
 
+#include "node_pool.hpp"
 #include "tree_23.hpp"
 #include "tree_avl.hpp"
 #include "tree_b.hpp"
 #include "tree_b_plus.hpp"
+#include "tree_b_plus_logged.hpp"
+#include "tree_b_plus_paged.hpp"
 #include "tree_bst.hpp"
+#include "tree_iterator.hpp"
 #include "tree_rb.hpp"
 
 #include <math.h>
 
+#ifdef TREE_SET_PAGED
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
 enum Operation { INSERT, SEARCH, REMOVE };
 
 template <typename Key> class std_set {
@@ -29,6 +49,15 @@ public:
 
   bool search(const Key &key) { return static_cast<bool>(set.count(key)); }
 
+  auto begin() const { return set.begin(); }
+
+  auto end() const { return set.end(); }
+
+  auto range(const Key &lo, const Key &hi) const {
+    using iterator = typename std::set<Key>::const_iterator;
+    return tree_range<iterator>{set.lower_bound(lo), set.lower_bound(hi)};
+  }
+
   std::string to_string() {
     std::stringstream os{};
     os << "{ ";
@@ -43,6 +72,32 @@ private:
   std::set<Key> set{};
 };
 
+std::string std_to_string(const std::set<int> &set) {
+  std::stringstream os{};
+  os << "{ ";
+  for (int key : set) {
+    os << key << " ";
+  }
+  os << "}";
+  return os.str();
+}
+
+template <typename TestSet, typename = void>
+struct has_check : std::false_type {};
+
+template <typename TestSet>
+struct has_check<TestSet,
+                 std::void_t<decltype(std::declval<TestSet>().check())>>
+    : std::true_type {};
+
+template <typename TestSet, typename = void>
+struct has_scan : std::false_type {};
+
+template <typename TestSet>
+struct has_scan<TestSet,
+                std::void_t<decltype(std::declval<TestSet>().scan(
+                    0, 0, std::declval<void (*)(int)>()))>> : std::true_type {};
+
 template <typename TestSet> void check() {
   // random sequence
   using key_type = typename TestSet::key_type;
@@ -123,19 +178,895 @@ template <typename TestSet> void check() {
       break;
     }
     }
-    // assert(test.check());
+    if constexpr (has_check<TestSet>::value) {
+      assert(test.check());
+    }
+  }
+}
+
+// insert / remove churn against std::set, check() above never removes
+template <typename TestSet> void churn_check() {
+  std::set<int> ref{};
+  TestSet test{};
+  std::mt19937 rg{};
+  for (int i = 0; i < 100000; i++) {
+    int key = static_cast<int>(rg() % 2000);
+    if (rg() % 2) {
+      ref.insert(key);
+      test.insert(key);
+    } else {
+      ref.erase(key);
+      test.remove(key);
+    }
+    // the balance the remove fix-ups restore
+    if constexpr (has_check<TestSet>::value) {
+      if (i % 1000 == 999 && !test.check()) {
+        std::cerr << "churn failed on check after " << i + 1 << " operations"
+                  << std::endl;
+        exit(-1);
+      }
+    }
+  }
+  for (int key = 0; key < 2000; key++) {
+    if (static_cast<bool>(ref.count(key)) != test.search(key)) {
+      std::cerr << "churn failed on " << key << std::endl;
+      exit(-1);
+    }
+  }
+}
+
+// begin / end both ways, lower_bound, upper_bound and range against std::set
+// while keys come and go
+template <typename TestSet> void iterator_check() {
+  std::set<int> ref{};
+  TestSet test{};
+  std::mt19937 rg{};
+  auto fail = [&](const char *what, int key) {
+    std::cerr << "iterator check failed on " << what << " " << key
+              << std::endl;
+    std::cerr << "ref: " << std_to_string(ref) << std::endl;
+    std::cerr << "test: " << test.to_string() << std::endl;
+    exit(-1);
+  };
+  for (int i = 0; i < 20000; i++) {
+    int key = static_cast<int>(rg() % 1000);
+    if (rg() % 3) {
+      ref.insert(key);
+      test.insert(key);
+    } else {
+      ref.erase(key);
+      test.remove(key);
+    }
+    if (i % 101) {
+      continue;
+    }
+    if (!std::equal(ref.begin(), ref.end(), test.begin(), test.end())) {
+      fail("forward", key);
+    }
+    if (!std::equal(ref.rbegin(), ref.rend(),
+                    std::make_reverse_iterator(test.end()),
+                    std::make_reverse_iterator(test.begin()))) {
+      fail("backward", key);
+    }
+    for (int j = 0; j < 20; j++) {
+      int probe = static_cast<int>(rg() % 1100) - 50;
+      auto lb = test.lower_bound(probe);
+      auto ref_lb = ref.lower_bound(probe);
+      if ((lb == test.end()) != (ref_lb == ref.end()) ||
+          (ref_lb != ref.end() && *lb != *ref_lb)) {
+        fail("lower_bound", probe);
+      }
+      auto ub = test.upper_bound(probe);
+      auto ref_ub = ref.upper_bound(probe);
+      if ((ub == test.end()) != (ref_ub == ref.end()) ||
+          (ref_ub != ref.end() && *ub != *ref_ub)) {
+        fail("upper_bound", probe);
+      }
+      int hi = probe + static_cast<int>(rg() % 200) - 20;
+      auto r = test.range(probe, hi);
+      if (!std::equal(r.begin(), r.end(), ref_lb,
+                      hi < probe ? ref_lb : ref.lower_bound(hi))) {
+        fail("range", probe);
+      }
+      if constexpr (has_scan<TestSet>::value) {
+        std::vector<int> scanned{};
+        test.scan(probe, hi, [&](int key) { scanned.push_back(key); });
+        if (!std::equal(scanned.begin(), scanned.end(), r.begin(), r.end())) {
+          fail("scan", probe);
+        }
+      }
+    }
+  }
+}
+
+// bulk loads of sorted keys with duplicates at several sizes and fills, the
+// set must hold the keys, pass check() and keep working under churn
+template <typename TestSet> void bulk_load_check() {
+  std::mt19937 rg{5};
+  auto fail = [&](const char *what, size_t n, double fill) {
+    std::cerr << "bulk load check failed on " << what << " n=" << n
+              << " fill=" << fill << std::endl;
+    exit(-1);
+  };
+  std::vector<size_t> sizes{0, 1, 2, 3, 5, 8, 13, 21, 34, 55, 89, 200, 1000,
+                            5000};
+  for (size_t n : sizes) {
+    for (double fill : {0.1, 0.5, 0.7, 1.0}) {
+      std::vector<int> keys(n);
+      for (int &key : keys) {
+        key = static_cast<int>(rg() % (2 * n + 1));
+      }
+      std::sort(keys.begin(), keys.end());
+      std::set<int> ref(keys.begin(), keys.end());
+      TestSet test{};
+      test.insert(-1);
+      test.bulk_load(keys, fill);
+      if (!std::equal(ref.begin(), ref.end(), test.begin(), test.end()) ||
+          !test.check()) {
+        fail("load", n, fill);
+      }
+      for (int i = 0; i < 2000; i++) {
+        int key = static_cast<int>(rg() % (2 * n + 10));
+        if (rg() % 2) {
+          ref.insert(key);
+          test.insert(key);
+        } else {
+          ref.erase(key);
+          test.remove(key);
+        }
+      }
+      if (!std::equal(ref.begin(), ref.end(), test.begin(), test.end()) ||
+          !test.check()) {
+        fail("churn", n, fill);
+      }
+    }
+  }
+  // a single pass input stream
+  std::stringstream stream{"1 2 2 3 5 8 13 21 34 55 89 144 233 377"};
+  TestSet test{};
+  test.bulk_load(std::istream_iterator<int>{stream},
+                 std::istream_iterator<int>{}, 0.5);
+  std::vector<int> expect{1, 2, 3, 5, 8, 13, 21, 34, 55, 89, 144, 233, 377};
+  if (!std::equal(expect.begin(), expect.end(), test.begin(), test.end())) {
+    fail("stream", expect.size(), 0.5);
+  }
+}
+
+// parallel_bulk_load on several thread counts must build the same tree as
+// bulk_load, sizes past a few input slices so the leaves span slices
+template <typename TestSet> void parallel_bulk_load_check() {
+  std::mt19937 rg{7};
+  for (size_t n : {0, 1, 2, 5, 100, 5000, 300000}) {
+    std::vector<int> keys(n);
+    for (size_t i = 0; i < n; i++) {
+      keys[i] = static_cast<int>(i / 3 + rg() % 2);
+    }
+    std::sort(keys.begin(), keys.end());
+    for (double fill : {0.1, 0.7, 1.0}) {
+      TestSet expect{};
+      expect.bulk_load(keys, fill);
+      for (unsigned threads : {1, 2, 3, 8}) {
+        TestSet test{};
+        test.insert(-1);
+        test.parallel_bulk_load(keys, fill, threads);
+        if (!test.check() || test.tree_view() != expect.tree_view() ||
+            !std::equal(expect.begin(), expect.end(), test.begin(),
+                        test.end())) {
+          std::cerr << "parallel bulk load check failed on n=" << n
+                    << " fill=" << fill << " threads=" << threads
+                    << std::endl;
+          exit(-1);
+        }
+      }
+    }
+  }
+}
+
+// random insert_batch / erase_batch rounds, dense and sparse, with
+// duplicates and absent keys in the batches, against std::set
+template <typename TestSet> void batch_check() {
+  std::mt19937 rg{11};
+  std::set<int> ref{};
+  TestSet test{};
+  auto fail = [&](const char *what, int round) {
+    std::cerr << "batch check failed on " << what << " round=" << round
+              << std::endl;
+    exit(-1);
+  };
+  for (int round = 0; round < 400; round++) {
+    size_t size = std::vector<size_t>{1, 3, 50, rg() % 3000}[rg() % 4];
+    int span = std::vector<int>{100, 5000, 1000000}[rg() % 3];
+    int base = static_cast<int>(rg() % 5000);
+    std::vector<int> batch(size);
+    for (int &key : batch) {
+      key = base + static_cast<int>(rg() % span);
+    }
+    bool insert = round < 20 || rg() % 5 < 3 || ref.empty();
+    if (insert) {
+      ref.insert(batch.begin(), batch.end());
+      test.insert_batch(batch);
+    } else {
+      // most of the keys present
+      for (int &key : batch) {
+        if (rg() % 4) {
+          auto iter = ref.lower_bound(key);
+          key = iter == ref.end() ? *ref.begin() : *iter;
+        }
+      }
+      for (int key : batch) {
+        ref.erase(key);
+      }
+      test.erase_batch(batch.begin(), batch.end());
+    }
+    if (round % 50 == 49) {
+      // everything once in a while
+      std::vector<int> all(ref.begin(), ref.end());
+      std::shuffle(all.begin(), all.end(), rg);
+      all.resize(all.size() * (rg() % 2));
+      for (int key : all) {
+        ref.erase(key);
+      }
+      test.erase_batch(all);
+    }
+    if (!std::equal(ref.begin(), ref.end(), test.begin(), test.end()) ||
+        !test.check()) {
+      fail(insert ? "insert" : "erase", round);
+    }
+    // single key operations keep working on the batched tree
+    int key = base + static_cast<int>(rg() % span);
+    ref.insert(key);
+    test.insert(key);
+    ref.erase(key + 1);
+    test.remove(key + 1);
+    if (!std::equal(ref.begin(), ref.end(), test.begin(), test.end())) {
+      fail("single", round);
+    }
+  }
+}
+
+#ifdef TREE_SET_PAGED
+// a file in the temp directory, removed before and after use
+struct paged_file {
+  std::string path;
+
+  explicit paged_file(const std::string &name)
+      : path((std::filesystem::temp_directory_path() / name).string()) {
+    std::remove(path.c_str());
+  }
+
+  ~paged_file() { std::remove(path.c_str()); }
+};
+
+// random insert / remove / search against std::set on small pages and a
+// small pool, so the tree is deep and pages are evicted all the time. the
+// tree is closed and opened again from its file in between
+void paged_check() {
+  using paged_set = paged_b_plus_set<int, 256>;
+  paged_file file{"paged_check.db"};
+  std::mt19937 rg{23};
+  std::set<int> ref{};
+  auto fail = [&](const char *what, int round) {
+    std::cerr << "paged check failed on " << what << " round=" << round
+              << std::endl;
+    exit(-1);
+  };
+  for (int round = 0; round < 4; round++) {
+    paged_set test{file.path, 16};
+    std::vector<int> keys{};
+    test.scan(INT32_MIN, INT32_MAX, [&](int key) { keys.push_back(key); });
+    if (test.size() != ref.size() ||
+        !std::equal(ref.begin(), ref.end(), keys.begin(), keys.end())) {
+      fail("reopen", round);
+    }
+    int span = round % 2 ? 4000 : 40000;
+    for (int i = 0; i < 20000; i++) {
+      int key = static_cast<int>(rg() % span);
+      // grow in the even rounds, shrink in the odd ones
+      if (rg() % 10 < (round % 2 ? 3 : 7)) {
+        ref.insert(key);
+        test.insert(key);
+      } else {
+        ref.erase(key);
+        test.remove(key);
+      }
+      if (test.search(key) != static_cast<bool>(ref.count(key))) {
+        fail("search", round);
+      }
+    }
+    if (!test.check() || test.size() != ref.size()) {
+      fail("check", round);
+    }
+    for (int i = 0; i < 100; i++) {
+      int lo = static_cast<int>(rg() % span);
+      int hi = lo + static_cast<int>(rg() % 500);
+      keys.clear();
+      test.scan(lo, hi, [&](int key) { keys.push_back(key); });
+      if (!std::equal(ref.lower_bound(lo), ref.lower_bound(hi), keys.begin(),
+                      keys.end())) {
+        fail("scan", round);
+      }
+    }
+  }
+  // everything removed and inserted again twice, the second time on the
+  // pages freed by the first
+  paged_set test{file.path, 16};
+  page_id pages = 0;
+  for (int round = 0; round < 2; round++) {
+    for (int key : ref) {
+      test.remove(key);
+    }
+    if (!test.check() || !test.empty()) {
+      fail("remove all", round);
+    }
+    for (int key : ref) {
+      test.insert(key);
+    }
+    if (!test.check() || (round > 0 && test.page_count() != pages)) {
+      fail("free list", round);
+    }
+    pages = test.page_count();
+  }
+}
+
+// n random inserts and then n searches through pools of a few sizes, with
+// the hit rate and the page reads / writes per operation
+template <size_t PageSize> void paged_benchmark(int n) {
+  namespace ch = std::chrono;
+  std::mt19937 rg{29};
+  std::vector<int> keys(n);
+  for (int &key : keys) {
+    key = static_cast<int>(rg() % (4 * n));
+  }
+  for (size_t pool_pages : {16, 64, 256, 4096}) {
+    paged_file file{"paged_benchmark.db"};
+    paged_b_plus_set<int, PageSize> test{file.path, pool_pages};
+    auto report = [&](const char *what, ch::steady_clock::time_point start) {
+      const buffer_pool::stats &stats = test.pool().io_stats();
+      printf("paged %5zuB pool %5zu %-7s %8.3fms, hit rate %6.2f%%, reads / "
+             "op %6.3f, writes / op %6.3f\n",
+             PageSize, pool_pages, what,
+             ch::duration<double, std::milli>(ch::steady_clock::now() - start)
+                 .count(),
+             100 * stats.hit_rate(), static_cast<double>(stats.reads) / n,
+             static_cast<double>(stats.writes) / n);
+      test.pool().reset_stats();
+    };
+    auto start = ch::steady_clock::now();
+    for (int key : keys) {
+      test.insert(key);
+    }
+    report("insert", start);
+    start = ch::steady_clock::now();
+    size_t found = 0;
+    for (int key : keys) {
+      found += test.search(key + 1);
+    }
+    report("search", start);
+    assert(found <= keys.size());
+  }
+}
+
+// a logged tree in the temp directory with its double write file and log
+// segments, removed before and after use
+struct logged_files {
+  std::string path;
+
+  explicit logged_files(const std::string &name)
+      : path((std::filesystem::temp_directory_path() / name).string()) {
+    clear();
+  }
+
+  ~logged_files() { clear(); }
+
+  void clear() {
+    std::remove(path.c_str());
+    std::remove((path + ".dwb").c_str());
+    for (auto &segment : redo_log<int>::segments(path + ".wal")) {
+      std::remove(segment.second.c_str());
+    }
+  }
+};
+
+// the keys of one writer of logged_check after its first ops operations:
+// operation j inserts key j, every fourth one removes key j - 2 instead
+std::vector<int> logged_state(int base, int ops) {
+  std::vector<int> keys{};
+  for (int j = 0; j < ops; j++) {
+    if (j % 4 == 0 || j % 4 == 2 || (j % 4 == 1 && j + 2 >= ops)) {
+      keys.push_back(base + j);
+    }
+  }
+  return keys;
+}
+
+// a child process runs writers on a logged tree and reports every operation
+// once it returned (durable), it is killed at a random point. the tree
+// recovered from the files must hold, for every writer, the keys of a
+// prefix of its operations at least as long as the reported one. SIGKILL
+// leaves the page cache alone, so this tests the order of the writes and the
+// recovery, not a power loss
+void logged_check() {
+  using logged_set = logged_b_plus_set<int, 256>;
+  constexpr int writers = 4;
+  constexpr int span = 10000000;
+  logged_files files{"logged_check.db"};
+  std::mt19937 rg{31};
+  std::set<int> ref{};
+  auto fail = [&](const char *what, int round) {
+    std::cerr << "logged check failed on " << what << " round=" << round
+              << std::endl;
+    exit(-1);
+  };
+  for (int round = 0; round < 3; round++) {
+    int base = round * writers * span;
+    int fds[2];
+    if (::pipe(fds) != 0) {
+      fail("pipe", round);
+    }
+    pid_t child = ::fork();
+    if (child == 0) {
+      ::close(fds[0]);
+      // a small pool and frequent checkpoints, so the kill hits them
+      logged_set test{files.path, 64, 500};
+      std::vector<std::thread> threads{};
+      for (int t = 0; t < writers; t++) {
+        threads.emplace_back([&, t]() {
+          for (int j = 0;; j++) {
+            int key = base + t * span + j;
+            if (j % 4 == 3) {
+              test.remove(key - 2);
+            } else {
+              test.insert(key);
+            }
+            int ack[2] = {t, j};
+            if (::write(fds[1], ack, sizeof(ack)) != sizeof(ack)) {
+              ::_exit(1);
+            }
+          }
+        });
+      }
+      for (auto &thread : threads) {
+        thread.join();
+      }
+      ::_exit(0);
+    }
+    ::close(fds[1]);
+    int kill_at = 200 + static_cast<int>(rg() % 2000);
+    std::vector<int> acked(writers, 0);
+    int ack[2];
+    for (int i = 0; ::read(fds[0], ack, sizeof(ack)) == sizeof(ack); i++) {
+      acked[ack[0]] = std::max(acked[ack[0]], ack[1] + 1);
+      if (i == kill_at) {
+        ::kill(child, SIGKILL);
+      }
+    }
+    ::close(fds[0]);
+    ::waitpid(child, nullptr, 0);
+
+    logged_set test{files.path, 64, 500};
+    const auto &recovery = test.recovery();
+    printf("logged recovery round %d: %zu pages restored, %zu records "
+           "replayed, %.3fms\n",
+           round, recovery.restored_pages, recovery.replayed, recovery.ms);
+    if (!test.check()) {
+      fail("check", round);
+    }
+    for (int t = 0; t < writers; t++) {
+      int lo = base + t * span;
+      std::vector<int> keys{};
+      test.scan(lo, lo + span, [&](int key) { keys.push_back(key); });
+      // one operation per writer may be durable without being reported
+      std::vector<int> state = logged_state(lo, acked[t]);
+      if (keys != state) {
+        state = logged_state(lo, acked[t] + 1);
+      }
+      if (keys != state) {
+        fail("recovered keys", round);
+      }
+      ref.insert(keys.begin(), keys.end());
+    }
+    std::vector<int> keys{};
+    test.scan(INT32_MIN, INT32_MAX, [&](int key) { keys.push_back(key); });
+    if (!std::equal(ref.begin(), ref.end(), keys.begin(), keys.end())) {
+      fail("earlier rounds", round);
+    }
+  }
+  // closed cleanly the tree opens without replay. the meta page is in every
+  // checkpoint, torn in place it comes back from the double write file
+  {
+    logged_set test{files.path, 64, 500};
+    if (test.recovery().replayed != 0 || test.size() != ref.size()) {
+      fail("clean reopen", 3);
+    }
+  }
+  {
+    page_file file{files.path, 256};
+    std::vector<char> zeros(256);
+    file.write(0, zeros.data());
+  }
+  logged_set test{files.path, 64, 500};
+  if (test.recovery().restored_pages == 0 || !test.check() ||
+      test.size() != ref.size()) {
+    fail("torn meta page", 4);
+  }
+  // without steal only the owner of the pool writes pages, the tree does not
+  // flush them when it is closed
+  paged_file unflushed{"logged_check_no_steal.db"};
+  {
+    paged_b_plus_set<int, 256> tree{unflushed.path, 16};
+    tree.pool().set_no_steal(true);
+    tree.insert(1);
+  }
+  if (std::filesystem::file_size(unflushed.path) != 0) {
+    fail("no steal flush", 5);
+  }
+  // a corrupt fifth record in the first of two segments: replay stops
+  // there and the second segment is dropped, not replayed over the gap
+  using int_log = redo_log<int>;
+  {
+    logged_files gap{"logged_check_gap.db"};
+    std::string prefix = gap.path + ".wal";
+    {
+      int_log log{prefix, 1};
+      for (int i = 1; i <= 20; i++) {
+        log.commit(log.append(log_op::insert, i));
+        if (i == 10) {
+          log.rotate();
+        }
+      }
+    }
+    {
+      std::FILE *file =
+          std::fopen(int_log::segments(prefix)[0].second.c_str(), "r+b");
+      std::fseek(file, 4 * int_log::RECORD_BYTES + 9, SEEK_SET);
+      std::fputc(0xff, file);
+      std::fclose(file);
+    }
+    logged_set test{gap.path, 64, 500};
+    auto segments = int_log::segments(prefix);
+    if (test.recovery().replayed != 4 || test.size() != 4 ||
+        test.recovery().dropped_segments != 1 || segments.size() != 2 ||
+        segments[1].first != 5) {
+      fail("log gap", 6);
+    }
+  }
+  // a file size limit fails the write of the eleventh record halfway. the
+  // log stays failed: nothing after it is appended, committed or rotated,
+  // and only the ten records before it are read back
+  logged_files failed{"logged_check_failed.db"};
+  std::string prefix = failed.path + ".wal";
+  pid_t child = ::fork();
+  if (child == 0) {
+    ::signal(SIGXFSZ, SIG_IGN);
+    rlimit limit{};
+    limit.rlim_cur = limit.rlim_max = 10 * int_log::RECORD_BYTES + 5;
+    if (::setrlimit(RLIMIT_FSIZE, &limit) != 0) {
+      ::_exit(1);
+    }
+    int_log log{prefix, 1};
+    int committed = 0;
+    for (int i = 1; i <= 20; i++) {
+      try {
+        log.commit(log.append(log_op::insert, i));
+        committed = i;
+      } catch (const std::runtime_error &) {
+        break;
+      }
+    }
+    auto throws = [](auto &&func) {
+      try {
+        func();
+      } catch (const std::runtime_error &) {
+        return true;
+      }
+      return false;
+    };
+    bool sticky = throws([&]() { log.append(log_op::insert, 21); }) &&
+                  throws([&]() { log.commit(11); }) &&
+                  throws([&]() { log.rotate(); }) &&
+                  !throws([&]() { log.commit(10); });
+    ::_exit(committed == 10 && sticky ? 0 : 2);
+  }
+  int status = 0;
+  ::waitpid(child, &status, 0);
+  auto segments = int_log::segments(prefix);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 ||
+      segments.size() != 1 ||
+      int_log::read_segment(segments[0].second).size() != 10) {
+    fail("failed log", 7);
+  }
+}
+
+// n inserts of random keys spread over a few writer threads, the syncs of
+// the log are shared by the writers waiting at the same time
+void logged_benchmark(int n) {
+  namespace ch = std::chrono;
+  for (int writers : {1, 2, 4, 8}) {
+    logged_files files{"logged_benchmark.db"};
+    logged_b_plus_set<int> test{files.path, 64, 1000};
+    auto start = ch::steady_clock::now();
+    std::vector<std::thread> threads{};
+    for (int t = 0; t < writers; t++) {
+      threads.emplace_back([&, t]() {
+        std::mt19937 rg(37 + t);
+        for (int i = t; i < n; i += writers) {
+          test.insert(static_cast<int>(rg()));
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    double ms =
+        ch::duration<double, std::milli>(ch::steady_clock::now() - start)
+            .count();
+    auto log = test.log_stats();
+    printf("logged insert %d writers %8.3fms, %9.0f ops / s, syncs / op "
+           "%5.3f, %llu checkpoints\n",
+           writers, ms, n / ms * 1000,
+           static_cast<double>(log.syncs) / n,
+           static_cast<unsigned long long>(test.checkpoints().checkpoints));
+  }
+}
+#endif
+
+// n sorted keys inserted one by one against bulk loaded at a few fills, with
+// the node count and the time of n searches afterwards
+template <typename TestSet>
+void bulk_load_benchmark(const std::string &name, int n) {
+  namespace ch = std::chrono;
+  std::vector<int> keys(n);
+  for (int i = 0; i < n; i++) {
+    keys[i] = 2 * i;
+  }
+  std::mt19937 rg{13};
+  std::vector<int> probes(n);
+  for (int &key : probes) {
+    key = static_cast<int>(rg() % (2 * n));
+  }
+  auto report = [&](const std::string &how, TestSet &test,
+                    ch::steady_clock::time_point start) {
+    auto built = ch::steady_clock::now();
+    size_t found = 0;
+    for (int key : probes) {
+      found += test.search(key);
+    }
+    auto searched = ch::steady_clock::now();
+    printf("%-12s %-12s build %8.3fms, %7d nodes, search %8.3fms (%zu)\n",
+           name.c_str(), how.c_str(),
+           ch::duration<double, std::milli>(built - start).count(),
+           TestSet::new_count,
+           ch::duration<double, std::milli>(searched - built).count(), found);
+  };
+  {
+    TestSet test{};
+    auto start = ch::steady_clock::now();
+    for (int key : keys) {
+      test.insert(key);
+    }
+    report("insert", test, start);
+  }
+  for (double fill : {0.7, 1.0}) {
+    TestSet test{};
+    auto start = ch::steady_clock::now();
+    test.bulk_load(keys, fill);
+    report("bulk " + std::to_string(fill).substr(0, 3), test, start);
+  }
+}
+
+// n random keys inserted and then erased one by one against in batches
+template <typename TestSet>
+void batch_benchmark(const std::string &name, int n, int batch) {
+  namespace ch = std::chrono;
+  std::mt19937 rg{17};
+  std::vector<int> keys(n);
+  for (int &key : keys) {
+    key = static_cast<int>(rg() % (4 * n));
+  }
+  auto ms = [](ch::steady_clock::time_point start) {
+    return ch::duration<double, std::milli>(ch::steady_clock::now() - start)
+        .count();
+  };
+  {
+    TestSet test{};
+    auto start = ch::steady_clock::now();
+    for (int key : keys) {
+      test.insert(key);
+    }
+    double insert_ms = ms(start);
+    start = ch::steady_clock::now();
+    for (int key : keys) {
+      test.remove(key);
+    }
+    printf("%-12s %-12s insert %8.3fms, erase %8.3fms\n", name.c_str(),
+           "one by one", insert_ms, ms(start));
+  }
+  {
+    TestSet test{};
+    auto start = ch::steady_clock::now();
+    for (int i = 0; i < n; i += batch) {
+      test.insert_batch(keys.begin() + i,
+                        keys.begin() + std::min(n, i + batch));
+    }
+    double insert_ms = ms(start);
+    start = ch::steady_clock::now();
+    for (int i = 0; i < n; i += batch) {
+      test.erase_batch(keys.begin() + i,
+                       keys.begin() + std::min(n, i + batch));
+    }
+    printf("%-12s %-12s insert %8.3fms, erase %8.3fms\n", name.c_str(),
+           ("batch " + std::to_string(batch)).c_str(), insert_ms, ms(start));
+  }
+}
+
+// bulk_load against parallel_bulk_load of n sorted keys on a few threads
+template <typename TestSet>
+void parallel_bulk_load_benchmark(const std::string &name, int n) {
+  namespace ch = std::chrono;
+  std::vector<int> keys(n);
+  for (int i = 0; i < n; i++) {
+    keys[i] = 2 * i;
+  }
+  auto report = [&](const std::string &how, auto build) {
+    TestSet test{};
+    auto start = ch::steady_clock::now();
+    build(test);
+    auto built = ch::steady_clock::now();
+    printf("%-12s %-12s build %8.3fms, %7d nodes\n", name.c_str(),
+           how.c_str(), ch::duration<double, std::milli>(built - start).count(),
+           TestSet::new_count);
+  };
+  report("bulk", [&](TestSet &test) { test.bulk_load(keys); });
+  for (unsigned threads : {1, 2, 4, 8}) {
+    report("parallel " + std::to_string(threads), [&](TestSet &test) {
+      test.parallel_bulk_load(keys, 1.0, threads);
+    });
+  }
+}
+
+// insert n random keys, then n operations of half inserts / half removes,
+// then destroy the set
+template <typename TestSet> void churn_benchmark(const std::string &name,
+                                                 int n) {
+  namespace ch = std::chrono;
+  std::mt19937 rg{42};
+  std::uniform_int_distribution<int> key_dist{0, 4 * n};
+  auto start = ch::steady_clock::now();
+  double fill_ms{}, churn_ms{};
+  {
+    TestSet test{};
+    for (int i = 0; i < n; i++) {
+      test.insert(key_dist(rg));
+    }
+    fill_ms =
+        ch::duration<double, std::milli>(ch::steady_clock::now() - start)
+            .count();
+    for (int i = 0; i < n; i++) {
+      if (i % 2) {
+        test.insert(key_dist(rg));
+      } else {
+        test.remove(key_dist(rg));
+      }
+    }
+    churn_ms =
+        ch::duration<double, std::milli>(ch::steady_clock::now() - start)
+            .count() -
+        fill_ms;
   }
+  double total_ms =
+      ch::duration<double, std::milli>(ch::steady_clock::now() - start)
+          .count();
+  printf("%-28s insert %8.3fms, churn %8.3fms, destroy %8.3fms\n",
+         name.c_str(), fill_ms, churn_ms, total_ms - fill_ms - churn_ms);
+}
+
+// insert the keys, then look every probe up, for one node order
+template <typename TestSet>
+void lookup_benchmark(const std::string &name, const std::vector<int> &keys,
+                      const std::vector<int> &probes) {
+  namespace ch = std::chrono;
+  TestSet test{};
+  auto start = ch::steady_clock::now();
+  for (int key : keys) {
+    test.insert(key);
+  }
+  auto inserted = ch::steady_clock::now();
+  size_t found = 0;
+  for (int key : probes) {
+    found += test.search(key);
+  }
+  auto searched = ch::steady_clock::now();
+  printf("%-24s insert %8.3fms, search %8.3fms (%zu found)\n", name.c_str(),
+         ch::duration<double, std::milli>(inserted - start).count(),
+         ch::duration<double, std::milli>(searched - inserted).count(), found);
+}
+
+// a full in order pass, then ranges of about width keys from random starts
+template <typename TestSet>
+void scan_benchmark(const std::string &name, const std::vector<int> &keys,
+                    int width) {
+  namespace ch = std::chrono;
+  TestSet test{};
+  for (int key : keys) {
+    test.insert(key);
+  }
+  std::mt19937 rg{11};
+  int n = static_cast<int>(keys.size());
+  long long sum = 0;
+  auto start = ch::steady_clock::now();
+  for (int key : test) {
+    sum += key;
+  }
+  auto scanned = ch::steady_clock::now();
+  size_t count = 0;
+  for (int i = 0; i < 10000; i++) {
+    int lo = static_cast<int>(rg() % n);
+    for (int key : test.range(lo, lo + width)) {
+      sum += key;
+      count++;
+    }
+  }
+  auto ranged = ch::steady_clock::now();
+  printf("%-24s full scan %8.3fms, 10000 ranges %8.3fms (%zu keys, %lld)\n",
+         name.c_str(),
+         ch::duration<double, std::milli>(scanned - start).count(),
+         ch::duration<double, std::milli>(ranged - scanned).count(), count,
+         sum);
+  if constexpr (has_scan<TestSet>::value) {
+    rg.seed(11);
+    sum = 0;
+    count = 0;
+    auto start = ch::steady_clock::now();
+    test.scan(0, n, [&](int key) { sum += key; });
+    auto scanned = ch::steady_clock::now();
+    for (int i = 0; i < 10000; i++) {
+      int lo = static_cast<int>(rg() % n);
+      test.scan(lo, lo + width, [&](int key) {
+        sum += key;
+        count++;
+      });
+    }
+    auto ranged = ch::steady_clock::now();
+    printf("%-24s full scan %8.3fms, 10000 ranges %8.3fms (%zu keys, %lld)\n",
+           (name + " scan").c_str(),
+           ch::duration<double, std::milli>(scanned - start).count(),
+           ch::duration<double, std::milli>(ranged - scanned).count(), count,
+           sum);
+  }
+}
+
+template <size_t... BYTES> void node_size_sweep(int n) {
+  std::mt19937 rg{7};
+  std::uniform_int_distribution<int> key_dist{0, 4 * n};
+  std::vector<int> keys(n), probes(n);
+  for (int &key : keys) {
+    key = key_dist(rg);
+  }
+  for (int &key : probes) {
+    key = key_dist(rg);
+  }
+  lookup_benchmark<std_set<int>>("std::set", keys, probes);
+  (lookup_benchmark<b_set<int, node_order<int>(BYTES)>>(
+       "b_set " + std::to_string(BYTES) + "B", keys, probes),
+   ...);
+  (lookup_benchmark<b_plus_set<int, node_order<int>(BYTES)>>(
+       "b_plus_set " + std::to_string(BYTES) + "B", keys, probes),
+   ...);
 }
 
 int main() {
   using std::cout, std::endl;
   
+  // small orders split and merge often, the default one is sized in bytes
+  check<b_set<int, 5>>();
   check<b_set<int>>();
-  assert(b_set<int>::new_count == 0);
+  assert((b_set<int, 5>::new_count == 0 && b_set<int>::new_count == 0));
   cout << "b-tree pass" << endl;
 
+  check<b_plus_set<int, 5>>();
   check<b_plus_set<int>>();
-  assert(b_plus_set<int>::new_count == 0);
+  assert((b_plus_set<int, 5>::new_count == 0 &&
+          b_plus_set<int>::new_count == 0));
   cout << "b+tree pass" << endl;
 
   check<tree_23_set<int>>();
@@ -151,5 +1082,95 @@ int main() {
   check<rb_set<int>>();
   cout << "rb tree pass" << endl;
 
+  churn_check<bst_set<int>>();
+  churn_check<avl_set<int>>();
+  churn_check<rb_set<int>>();
+  churn_check<rb_set<int, std::allocator<int>>>();
+  cout << "churn pass" << endl;
+
+  iterator_check<bst_set<int>>();
+  iterator_check<avl_set<int>>();
+  iterator_check<rb_set<int>>();
+  iterator_check<tree_23_set<int>>();
+  iterator_check<b_set<int, 5>>();
+  iterator_check<b_set<int>>();
+  iterator_check<b_plus_set<int, 5>>();
+  iterator_check<b_plus_set<int>>();
+  cout << "iterator pass" << endl;
+
+  bulk_load_check<b_set<int, 3>>();
+  bulk_load_check<b_set<int, 4>>();
+  bulk_load_check<b_set<int, 5>>();
+  bulk_load_check<b_set<int>>();
+  bulk_load_check<b_plus_set<int, 3>>();
+  bulk_load_check<b_plus_set<int, 4>>();
+  bulk_load_check<b_plus_set<int, 5>>();
+  bulk_load_check<b_plus_set<int>>();
+  assert((b_set<int>::new_count == 0 && b_plus_set<int>::new_count == 0));
+  cout << "bulk load pass" << endl;
+
+  parallel_bulk_load_check<b_plus_set<int, 3>>();
+  parallel_bulk_load_check<b_plus_set<int, 4>>();
+  parallel_bulk_load_check<b_plus_set<int, 5>>();
+  parallel_bulk_load_check<b_plus_set<int>>();
+  assert(b_plus_set<int>::new_count == 0);
+  cout << "parallel bulk load pass" << endl;
+
+  batch_check<b_plus_set<int, 3>>();
+  batch_check<b_plus_set<int, 4>>();
+  batch_check<b_plus_set<int, 5>>();
+  batch_check<b_plus_set<int>>();
+  assert(b_plus_set<int>::new_count == 0);
+  cout << "batch pass" << endl;
+
+#ifdef TREE_SET_PAGED
+  paged_check();
+  cout << "paged pass" << endl;
+
+  logged_check();
+  cout << "logged pass" << endl;
+#endif
+
+  // node_pool (default) against one new / delete per node
+  constexpr int n = 200000;
+  churn_benchmark<bst_set<int>>("bst_set", n);
+  churn_benchmark<bst_set<int, std::allocator<int>>>("bst_set (std::allocator)",
+                                                     n);
+  churn_benchmark<avl_set<int>>("avl_set", n);
+  churn_benchmark<avl_set<int, std::allocator<int>>>("avl_set (std::allocator)",
+                                                     n);
+  churn_benchmark<rb_set<int>>("rb_set", n);
+  churn_benchmark<rb_set<int, std::allocator<int>>>("rb_set (std::allocator)",
+                                                    n);
+
+  // node orders from 64 bytes (3 children) to 4KB (339 children)
+  node_size_sweep<64, 128, 256, 512, 1024, 4096>(n);
+
+  bulk_load_benchmark<b_set<int>>("b_set", n);
+  bulk_load_benchmark<b_plus_set<int>>("b_plus_set", n);
+  parallel_bulk_load_benchmark<b_plus_set<int>>("b_plus_set", 10 * n);
+  batch_benchmark<b_plus_set<int>>("b_plus_set", 5 * n, 10000);
+  batch_benchmark<b_plus_set<int>>("b_plus_set", 5 * n, 5 * n);
+
+#ifdef TREE_SET_PAGED
+  paged_benchmark<4096>(n);
+  logged_benchmark(n / 50);
+#endif
+
+  // keys spread over [0, n) so a range of width n / 100 holds ~1% of them
+  std::vector<int> scan_keys(n);
+  std::mt19937 scan_rg{3};
+  for (int &key : scan_keys) {
+    key = static_cast<int>(scan_rg() % n);
+  }
+  constexpr int width = n / 100;
+  scan_benchmark<std_set<int>>("std::set", scan_keys, width);
+  scan_benchmark<bst_set<int>>("bst_set", scan_keys, width);
+  scan_benchmark<avl_set<int>>("avl_set", scan_keys, width);
+  scan_benchmark<rb_set<int>>("rb_set", scan_keys, width);
+  scan_benchmark<tree_23_set<int>>("tree_23_set", scan_keys, width);
+  scan_benchmark<b_set<int>>("b_set", scan_keys, width);
+  scan_benchmark<b_plus_set<int>>("b_plus_set", scan_keys, width);
+
   return 0;
 }
\ No newline at end of file